@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "epoch.h"
+#include "node_pool.h"
+
+/* one per thread that has ever read a list; never freed */
+struct epoch_reader {
+    /* 2 * epoch + 1 while inside a traversal entered in that epoch, else 0 */
+    unsigned long           state __attribute__((aligned(CACHE_LINE)));
+    struct epoch_reader     *next;
+};
+
+static unsigned long global_epoch = 1;
+static struct epoch_reader *readers;
+
+static __thread struct epoch_reader *my_reader;
+
+/*
+ * Full fence. ThreadSanitizer does not model fences (gcc warns under
+ * -fsanitize=thread), so there a seq_cst read-modify-write of one word
+ * stands in: of two of them one reads what the other wrote and so
+ * synchronizes with it, which orders what the fences would. Readers
+ * then contend on that word, which only matters to the timings of a
+ * sanitizer build.
+ */
+#ifdef __SANITIZE_THREAD__
+static int fence_word;
+#define full_fence()	((void) __atomic_fetch_add(&fence_word, 0, __ATOMIC_SEQ_CST))
+#else
+#define full_fence()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static struct epoch_reader *get_reader(void) {
+	struct epoch_reader *r;
+
+	if (my_reader != NULL) {
+		return my_reader;
+	}
+	if ((r = aligned_alloc(CACHE_LINE, sizeof(struct epoch_reader))) == NULL) {
+		perror("aligned_alloc");
+		exit(1);
+	}
+	r->state = 0;
+
+	// push onto the list of readers; entries are never removed
+	r->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&readers, &r->next, r, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	return my_reader = r;
+}
+
+void epoch_enter(void) {
+	struct epoch_reader *r = get_reader();
+	unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&r->state, 2 * epoch + 1, __ATOMIC_RELAXED);
+	// the announcement must be visible before any node is read; pairs
+	// with the fence in epoch_synchronize
+	full_fence();
+}
+
+void epoch_exit(void) {
+	__atomic_store_n(&my_reader->state, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Start a new epoch and wait until no reader is still inside a
+ * traversal entered in an earlier one. Nodes unlinked before the call
+ * can then no longer be reached by anyone.
+ */
+void epoch_synchronize(void) {
+	struct epoch_reader *r;
+	unsigned long epoch, state;
+
+	full_fence();
+	epoch = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+
+	for (r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		while ((state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE)) != 0 &&
+			state / 2 < epoch) {
+			sched_yield();
+		}
+	}
+}
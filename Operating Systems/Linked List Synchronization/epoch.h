@@ -0,0 +1,20 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+/*
+ * Epoch based protection of lock-free readers.
+ *
+ * A reader brackets every traversal with epoch_enter and epoch_exit,
+ * which only store to a word of the reader's own; it never waits. A
+ * thread that has made nodes unreachable calls epoch_synchronize before
+ * freeing them, which waits until every reader that was inside a
+ * traversal when the nodes were unlinked has left it.
+ *
+ * Traversals must not nest.
+ */
+
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_synchronize(void);
+
+#endif
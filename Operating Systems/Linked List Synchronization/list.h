@@ -0,0 +1,97 @@
+#ifndef __LIST_H__
+#define __LIST_H__
+
+#include <pthread.h>
+#include "epoch.h"
+#ifdef NODE_POOL
+#include "node_pool.h"
+#endif
+
+/*
+ * Sorted singly linked list of ints that many threads insert into.
+ *
+ * There are several implementations of the same functions, one per
+ * source file, and a program is linked with exactly one of them:
+ *
+ *   list_sync.c      one mutex, L->lock, held for the whole insert
+ *   list_hoh.c       a mutex per node, taken hand over hand (LIST_HOH)
+ *   list_lockfree.c  nodes linked in with compare-and-swap
+ *   list_skip.c      lock-free skip list, expected O(log n) inserts (LIST_SKIP)
+ *
+ * The files that include this header must be compiled with the same
+ * LIST_* macro as the implementation, since it changes struct node.
+ *
+ * Nodes come from malloc, or with -DNODE_POOL from the per-thread
+ * pools of node_pool.c; create_node and destroy_list go through
+ * NODE_ALLOC and NODE_FREE.
+ *
+ * Every implementation links a node in with a release store (or CAS)
+ * of the pointer to it, so the readers of list_read.c can walk the
+ * list with acquire loads while inserts go on, without a lock. Nodes
+ * are only freed by destroy_list, which waits for those readers with
+ * epoch_synchronize.
+ */
+
+struct node {
+    int             value;
+    struct node     *next;
+#ifdef LIST_HOH
+    /* guards next */
+    pthread_mutex_t lock;
+#endif
+#ifdef LIST_SKIP
+    /* next is level 0 and up[i - 1] is level i, for levels below height */
+    int             height;
+    struct node     *up[];
+#endif
+};
+
+/* levels of the skip list, enough for about 4^SKIP_LEVELS nodes */
+#define SKIP_LEVELS 16
+
+struct list {
+    struct node     *head;
+#ifdef LIST_SKIP
+    /* first node of levels 1 .. SKIP_LEVELS - 1 */
+    struct node     *head_up[SKIP_LEVELS - 1];
+#endif
+
+    /* guards the whole list in list_sync.c, only head in list_hoh.c */
+    pthread_mutex_t lock;
+
+    /* nodes in the list, raised after they are linked in */
+    int             count;
+};
+
+#ifdef NODE_POOL
+#define NODE_ALLOC(size) node_alloc(size)
+#define NODE_FREE(node) node_free(node)
+#define NODE_ALLOCATOR "pool"
+#else
+#define NODE_ALLOC(size) malloc(size)
+#define NODE_FREE(node) free(node)
+#define NODE_ALLOCATOR "malloc"
+#endif
+
+/* name of the implementation linked in, for benchmark output */
+extern const char list_impl[];
+
+void init_list(struct list *L);
+void destroy_list(struct list *L);
+
+struct node *create_node(int value);
+void insert(struct list *L, int value);
+
+/* insert all of values[0..n), which need not be sorted */
+void insert_batch(struct list *L, const int *values, int n);
+
+/* list_read.c, safe alongside inserts */
+int length(struct list *L);
+void print_list(struct list *L);
+int snapshot(struct list *L, int *values, int max);
+
+/* list_batch.c */
+int *sorted_copy(const int *values, int n);
+void build_sorted_parallel(struct list *L, const int *values, int n);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "list.h"
+
+/* Sorting of batches for insert_batch, and bulk construction of a list,
+ * shared by all list implementations.
+ *
+ * A batch is sorted with a merge sort whose halves are sorted by
+ * separate threads, down to one piece per processor; pieces below
+ * PARALLEL_SORT_MIN values are sorted with qsort by the calling thread.
+ */
+
+/* batches smaller than this are sorted by the calling thread alone */
+#define PARALLEL_SORT_MIN (1 << 15)
+
+struct sort_task {
+    int     *values, *tmp;
+    int     n;
+
+    /* number of threads this piece may still be split over */
+    int     threads;
+};
+
+static int compare_ints(const void *a, const void *b) {
+	int x = *(const int *) a, y = *(const int *) b;
+	return (x > y) - (x < y);
+}
+
+/* Merge the sorted runs values[0..mid) and values[mid..n) through tmp */
+static void merge(int *values, int *tmp, int mid, int n) {
+	int i = 0, j = mid, k = 0;
+
+	while (i < mid && j < n) {
+		tmp[k++] = values[j] < values[i] ? values[j++] : values[i++];
+	}
+	while (i < mid) {
+		tmp[k++] = values[i++];
+	}
+	while (j < n) {
+		tmp[k++] = values[j++];
+	}
+	memcpy(values, tmp, sizeof(int) * n);
+}
+
+static void *sort_piece(void *arg) {
+	struct sort_task *t = arg;
+	struct sort_task left, right;
+	pthread_t thread;
+	int mid = t->n / 2;
+
+	if (t->threads < 2 || t->n < PARALLEL_SORT_MIN) {
+		qsort(t->values, t->n, sizeof(int), compare_ints);
+		return NULL;
+	}
+
+	left.values = t->values;
+	left.tmp = t->tmp;
+	left.n = mid;
+	left.threads = t->threads / 2;
+	right.values = t->values + mid;
+	right.tmp = t->tmp + mid;
+	right.n = t->n - mid;
+	right.threads = t->threads - left.threads;
+
+	// the left half in a new thread, the right one in this one
+	if (pthread_create(&thread, NULL, sort_piece, &left) == 0) {
+		sort_piece(&right);
+		pthread_join(thread, NULL);
+	} else {
+		// no thread to spare, sort both halves here
+		sort_piece(&left);
+		sort_piece(&right);
+	}
+	merge(t->values, t->tmp, mid, t->n);
+	return NULL;
+}
+
+/**
+ * Return a newly allocated copy of values[0..n) in non-decreasing
+ * order, sorted in parallel when n is large. The caller frees it.
+ */
+int *sorted_copy(const int *values, int n) {
+	struct sort_task t;
+	int *sorted = malloc(sizeof(int) * (n + 1));
+
+	if (sorted == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(sorted, values, sizeof(int) * n);
+
+	t.values = sorted;
+	t.n = n;
+	t.threads = sysconf(_SC_NPROCESSORS_ONLN);
+	t.tmp = NULL;
+	if (t.threads > 1 && n >= PARALLEL_SORT_MIN) {
+		if ((t.tmp = malloc(sizeof(int) * n)) == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	sort_piece(&t);
+	free(t.tmp);
+
+	return sorted;
+}
+
+/**
+ * Initialise L as the sorted list of values[0..n). The values are
+ * sorted in parallel and linked in with a single insert_batch.
+ */
+void build_sorted_parallel(struct list *L, const int *values, int n) {
+	init_list(L);
+	insert_batch(L, values, n);
+}
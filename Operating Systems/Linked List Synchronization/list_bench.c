@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "list.h"
+#include "rand.h"
+
+/*
+ * Scaling benchmark of the list implementation this is linked with:
+ * for 1, 2, 4, ... up to the maximum number of threads, the threads
+ * insert random values into a fresh list until it holds -n values, and
+ * the insert rate is printed as one line of key=value pairs. The list
+ * is then checked to hold every value, in order. With -B the threads
+ * insert their values with insert_batch, that many at a time.
+ *
+ * With -R, that many reader threads take ordered snapshots of the list
+ * and read its length for as long as the inserts go on; their read rate
+ * is added to the line, along with the number of reads that saw the
+ * list out of order or shrinking (which must be 0).
+ *
+ * Finally a list of -n random values is made with build_sorted_parallel.
+ */
+
+static struct list L;
+static int ninserts, range, batch, nreaders;
+
+/* set once all inserters are done, to stop the readers */
+static int inserts_done;
+static unsigned int seed = 1;
+
+struct worker {
+    pthread_t       thread;
+    int             count;
+    unsigned int    rng;
+};
+
+struct reader {
+    pthread_t       thread;
+    long            reads, bad_reads;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *inserter(void *arg) {
+    struct worker *w = arg;
+    int *values;
+    int i, k, n;
+
+    if (batch == 0) {
+        for (i = 0; i < w->count; i++) {
+            insert(&L, rt_rand32(&w->rng) % range);
+        }
+        return NULL;
+    }
+
+    if ((values = malloc(sizeof(int) * batch)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < w->count; i += n) {
+        n = w->count - i < batch ? w->count - i : batch;
+        for (k = 0; k < n; k++) {
+            values[k] = rt_rand32(&w->rng) % range;
+        }
+        insert_batch(&L, values, n);
+    }
+    free(values);
+    return NULL;
+}
+
+/* Snapshot the list and read its length until inserts_done */
+static void *reader(void *arg) {
+    struct reader *r = arg;
+    int *values = malloc(sizeof(int) * ninserts);
+    int i, n, len, last_len = 0;
+
+    if (values == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while (!__atomic_load_n(&inserts_done, __ATOMIC_ACQUIRE)) {
+        len = length(&L);
+        n = snapshot(&L, values, ninserts);
+        // a node is linked in before it is counted
+        if (len < last_len || n < len) {
+            r->bad_reads++;
+        }
+        for (i = 1; i < n; i++) {
+            if (values[i] < values[i - 1]) {
+                r->bad_reads++;
+                break;
+            }
+        }
+        last_len = len;
+        r->reads++;
+    }
+    free(values);
+    return NULL;
+}
+
+/* Returns 1 if the list holds ninserts values in non-decreasing order */
+static int check_list(void) {
+    struct node *cur;
+    int count = 0;
+
+    for (cur = L.head; cur != NULL; cur = cur->next) {
+        if (cur->next != NULL && cur->next->value < cur->value) {
+            return 0;
+        }
+        count++;
+    }
+    return count == ninserts && length(&L) == ninserts;
+}
+
+static int run(int nthreads) {
+    struct worker *workers = calloc(nthreads, sizeof(struct worker));
+    struct reader *readers = calloc(nreaders + 1, sizeof(struct reader));
+    double start, elapsed;
+    long reads = 0, bad_reads = 0;
+    int i, ok;
+
+    if (workers == NULL || readers == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    init_list(&L);
+    inserts_done = 0;
+    for (i = 0; i < nthreads; i++) {
+        workers[i].count = ninserts / nthreads + (i < ninserts % nthreads);
+        workers[i].rng = (seed * 2654435761U + i) | 1;
+    }
+
+    start = now();
+    for (i = 0; i < nreaders; i++) {
+        if (pthread_create(&readers[i].thread, NULL, reader, &readers[i])) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, inserter, &workers[i])) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = now() - start;
+
+    __atomic_store_n(&inserts_done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < nreaders; i++) {
+        pthread_join(readers[i].thread, NULL);
+        reads += readers[i].reads;
+        bad_reads += readers[i].bad_reads;
+    }
+
+    ok = check_list() && bad_reads == 0;
+    printf("list=%s alloc=%s op=%s batch=%d threads=%d inserts=%d seconds=%.3f inserts_per_sec=%.0f",
+           list_impl, NODE_ALLOCATOR, batch ? "insert_batch" : "insert", batch, nthreads, ninserts,
+           elapsed, ninserts / elapsed);
+    if (nreaders) {
+        printf(" readers=%d reads=%ld reads_per_sec=%.0f bad_reads=%ld",
+               nreaders, reads, reads / elapsed, bad_reads);
+    }
+    printf(" sorted=%s\n", ok ? "yes" : "NO");
+
+    destroy_list(&L);
+    free(workers);
+    free(readers);
+    return ok;
+}
+
+/* Time build_sorted_parallel on ninserts random values */
+static int run_build(void) {
+    int *values = malloc(sizeof(int) * ninserts);
+    unsigned int rng = seed | 1;
+    double start, elapsed;
+    int i, ok;
+
+    if (values == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < ninserts; i++) {
+        values[i] = rt_rand32(&rng) % range;
+    }
+
+    start = now();
+    build_sorted_parallel(&L, values, ninserts);
+    elapsed = now() - start;
+
+    ok = check_list();
+    printf("list=%s alloc=%s op=build inserts=%d seconds=%.3f inserts_per_sec=%.0f sorted=%s\n",
+           list_impl, NODE_ALLOCATOR, ninserts, elapsed, ninserts / elapsed, ok ? "yes" : "NO");
+
+    destroy_list(&L);
+    free(values);
+    return ok;
+}
+
+static void usage(char *prog) {
+    printf("Usage: %s [-n inserts] [-t max_threads] [-r value_range] [-s seed] [-B batch] [-R readers]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = 64, nthreads, opt, ok = 1;
+
+    ninserts = 20000;
+    range = 1 << 30;
+    while ((opt = getopt(argc, argv, "n:t:r:s:B:R:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ninserts = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'r':
+            range = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            break;
+        case 'R':
+            nreaders = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (ninserts <= 0 || max_threads <= 0 || range <= 0 || batch < 0 || nreaders < 0) {
+        usage(argv[0]);
+    }
+
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        ok &= run(nthreads);
+    }
+    ok &= run_build();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "list.h"
+
+/* Sorted list with a lock per node, taken hand over hand.
+ *
+ * L->lock guards L->head and each node's lock guards its next pointer.
+ * An inserter holds at most two locks at a time, always the earlier
+ * node's first, so threads walk down the list one behind the other and
+ * inserts at different places proceed in parallel.
+ *
+ * Nodes are never removed while threads are inserting, so holding the
+ * lock of the node to link after is enough to insert; the next node is
+ * locked before the current one is released only so that no inserter
+ * can overtake another on the way down.
+ *
+ * Nodes are linked in with release stores, so length and print_list
+ * (list_read.c) take no lock, as in list_sync.c.
+ */
+
+const char list_impl[] = "hoh";
+
+void init_list(struct list *L) {
+	L->head = NULL;
+	L->count = 0;
+	pthread_mutex_init(&L->lock, NULL);
+}
+
+void destroy_list(struct list *L) {
+	struct node *cur = __atomic_exchange_n(&L->head, NULL, __ATOMIC_ACQ_REL), *next;
+	// readers may still be walking the detached nodes
+	epoch_synchronize();
+	while(cur != NULL) {
+		next = cur->next;
+		pthread_mutex_destroy(&cur->lock);
+		NODE_FREE(cur);
+		cur = next;
+	}
+	L->count = 0;
+	pthread_mutex_destroy(&L->lock);
+}
+
+struct node *create_node(int value) {
+    struct node *newnode = NODE_ALLOC(sizeof(struct node));
+    if (newnode == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    newnode->value = value;
+    newnode->next = NULL;
+    pthread_mutex_init(&newnode->lock, NULL);
+    return newnode;
+}
+
+void insert(struct list *L, int value){
+    struct node *newnode = create_node(value);
+    struct node *cur, *next;
+
+	pthread_mutex_lock(&L->lock);
+    cur = L->head;
+
+    if(cur == NULL || cur->value > value) {
+        newnode->next = cur;
+		__atomic_store_n(&L->head, newnode, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&L->lock);
+        return;
+    }
+
+	// hand the list lock over to the first node
+	pthread_mutex_lock(&cur->lock);
+	pthread_mutex_unlock(&L->lock);
+
+    while((next = cur->next) != NULL && next->value <= value) {
+		pthread_mutex_lock(&next->lock);
+		pthread_mutex_unlock(&cur->lock);
+        cur = next;
+    }
+
+    newnode->next = next;
+    __atomic_store_n(&cur->next, newnode, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&cur->lock);
+}
+
+/**
+ * Insert values[0..n): the batch is sorted beforehand and then merged
+ * into the list in one walk down it, hand over hand as in insert.
+ * Each new node is locked before the one it follows is released.
+ */
+void insert_batch(struct list *L, const int *values, int n) {
+	int *sorted = sorted_copy(values, n);
+	struct node *cur = NULL, *next, *newnode;
+	int i;
+
+	pthread_mutex_lock(&L->lock);
+	for (i = 0; i < n; i++) {
+		newnode = create_node(sorted[i]);
+
+		if (cur == NULL) {
+			next = L->head;
+			if (next == NULL || next->value > newnode->value) {
+				// new first node
+				newnode->next = next;
+				__atomic_store_n(&L->head, newnode, __ATOMIC_RELEASE);
+				__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+				continue;
+			}
+			pthread_mutex_lock(&next->lock);
+			pthread_mutex_unlock(&L->lock);
+			cur = next;
+		}
+
+		while((next = cur->next) != NULL && next->value <= newnode->value) {
+			pthread_mutex_lock(&next->lock);
+			pthread_mutex_unlock(&cur->lock);
+			cur = next;
+		}
+
+		newnode->next = next;
+		__atomic_store_n(&cur->next, newnode, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+		pthread_mutex_lock(&newnode->lock);
+		pthread_mutex_unlock(&cur->lock);
+		cur = newnode;
+	}
+
+	if (cur == NULL) {
+		pthread_mutex_unlock(&L->lock);
+	} else {
+		pthread_mutex_unlock(&cur->lock);
+	}
+	free(sorted);
+}
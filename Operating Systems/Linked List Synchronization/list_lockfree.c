@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "list.h"
+
+/* Lock-free sorted list, after Harris.
+ *
+ * An inserter finds the link that should point at its node, the
+ * address of the next pointer of the last node with a value <= its own
+ * (or L->head), and swings it from the node it saw there to the new
+ * node with a compare-and-swap. If another thread linked a node in
+ * first the CAS fails and the search resumes from the same link, which
+ * is still in the list: nodes are never removed while threads are
+ * inserting, so Harris's mark bit on deleted nodes is not needed.
+ *
+ * Nodes are published with release CASes and read with acquire
+ * loads, so a reader that sees a node also sees its value; see
+ * list_read.c.
+ */
+
+const char list_impl[] = "lockfree";
+
+void init_list(struct list *L) {
+	L->head = NULL;
+	L->count = 0;
+	pthread_mutex_init(&L->lock, NULL);
+}
+
+void destroy_list(struct list *L) {
+	struct node *cur = __atomic_exchange_n(&L->head, NULL, __ATOMIC_ACQ_REL), *next;
+	// readers may still be walking the detached nodes
+	epoch_synchronize();
+	while(cur != NULL) {
+		next = cur->next;
+		NODE_FREE(cur);
+		cur = next;
+	}
+	L->count = 0;
+	pthread_mutex_destroy(&L->lock);
+}
+
+struct node *create_node(int value) {
+    struct node *newnode = NODE_ALLOC(sizeof(struct node));
+    if (newnode == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    newnode->value = value;
+    newnode->next = NULL;
+    return newnode;
+}
+
+void insert(struct list *L, int value){
+    struct node *newnode = create_node(value);
+    struct node **link = &L->head;
+    struct node *cur = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+		while(cur != NULL && cur->value <= value) {
+			link = &cur->next;
+			cur = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+		}
+
+		newnode->next = cur;
+		// on failure cur is reloaded from link and the search goes on from there
+		if (__atomic_compare_exchange_n(link, &cur, newnode, 0,
+			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+			__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+			return;
+		}
+    }
+}
+
+/**
+ * Insert values[0..n): the batch is sorted beforehand and each value's
+ * search resumes from the link of the one before, so the whole batch
+ * is merged in one walk down the list.
+ */
+void insert_batch(struct list *L, const int *values, int n) {
+	int *sorted = sorted_copy(values, n);
+	struct node **link = &L->head;
+	struct node *cur = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+	struct node *newnode;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		newnode = create_node(sorted[i]);
+		for (;;) {
+			while(cur != NULL && cur->value <= newnode->value) {
+				link = &cur->next;
+				cur = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+			}
+			newnode->next = cur;
+			if (__atomic_compare_exchange_n(link, &cur, newnode, 0,
+				__ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+		}
+		__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+		// the next value goes after this one
+		link = &newnode->next;
+		cur = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+	}
+	free(sorted);
+}
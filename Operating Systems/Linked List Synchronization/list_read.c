@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "list.h"
+
+/* Reading the list while other threads insert into it, shared by all
+ * list implementations.
+ *
+ * Readers take no lock and never make an inserter wait. Each node is
+ * linked in with a release store of the pointer to it, so a reader
+ * that loads the pointer with acquire sees a complete node, and since
+ * nodes are only ever added the list it walks stays sorted. Nodes that
+ * appear behind the reader are missed, so a traversal sees the list as
+ * it was at some point during the walk, plus some of the nodes
+ * inserted since.
+ *
+ * Traversals are bracketed by epoch_enter and epoch_exit, so that
+ * destroy_list does not free nodes a reader is still on.
+ */
+
+/**
+ * Number of nodes in the list, from the counter the inserters keep.
+ * A node is counted just after it is linked in, so the count may lag
+ * behind a traversal by the inserts in progress.
+ */
+int length(struct list *L) {
+	return __atomic_load_n(&L->count, __ATOMIC_ACQUIRE);
+}
+
+void print_list(struct list *L) {
+	struct node *cur;
+
+	epoch_enter();
+	cur = __atomic_load_n(&L->head, __ATOMIC_ACQUIRE);
+    while(cur != NULL) {
+        printf("%d -> ", cur->value);
+        cur = __atomic_load_n(&cur->next, __ATOMIC_ACQUIRE);
+    }
+	epoch_exit();
+    printf("\n");
+}
+
+/**
+ * Copy the first max values of the list, in order, into values.
+ * Returns the number copied.
+ */
+int snapshot(struct list *L, int *values, int max) {
+	struct node *cur;
+	int n = 0;
+
+	epoch_enter();
+	cur = __atomic_load_n(&L->head, __ATOMIC_ACQUIRE);
+	while(cur != NULL && n < max) {
+		values[n++] = cur->value;
+		cur = __atomic_load_n(&cur->next, __ATOMIC_ACQUIRE);
+	}
+	epoch_exit();
+
+	return n;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "list.h"
+#include "rand.h"
+
+/* Sorted list kept as a lock-free skip list.
+ *
+ * Level 0 is the list itself, linked through next, so length,
+ * print_list and anything else that walks next see an ordinary sorted
+ * list. Each node is also on levels 1 .. height - 1, which are sorted
+ * lists too, but ever sparser: a node reaches level i with probability
+ * 4^-i. A search starts on the highest level and drops a level whenever
+ * the next node is too large, which takes O(log n) steps expected.
+ *
+ * A node is inserted into level 0 with a compare-and-swap, as in
+ * list_lockfree.c, which is the moment it is in the list; it is then
+ * linked into its upper levels one at a time, bottom up. A failed CAS
+ * only means another node was linked in at the same place, so the
+ * search resumes from the same predecessor. Nodes are never removed
+ * while threads are inserting. The readers of list_read.c only walk
+ * level 0.
+ */
+
+const char list_impl[] = "skip";
+
+/* state of each thread's generator of node heights */
+static __thread unsigned int height_rng;
+
+/* Link of node at level, or of the list head if node is NULL */
+static inline struct node **level_link(struct list *L, struct node *node, int level) {
+	if (node == NULL) {
+		return level ? &L->head_up[level - 1] : &L->head;
+	}
+	return level ? &node->up[level - 1] : &node->next;
+}
+
+/* Height of a new node: each further level with probability 1/4 */
+static int random_height(void) {
+	unsigned int x;
+	int height = 1;
+
+	if (height_rng == 0) {
+		height_rng = (unsigned int) (unsigned long) &height_rng | 1;
+	}
+	x = rt_rand32(&height_rng);
+
+	while (height < SKIP_LEVELS && (x & 3) == 0) {
+		height++;
+		x >>= 2;
+	}
+	return height;
+}
+
+void init_list(struct list *L) {
+	int i;
+
+	L->head = NULL;
+	for (i = 0; i < SKIP_LEVELS - 1; i++) {
+		L->head_up[i] = NULL;
+	}
+	L->count = 0;
+	pthread_mutex_init(&L->lock, NULL);
+}
+
+void destroy_list(struct list *L) {
+	struct node *cur = __atomic_exchange_n(&L->head, NULL, __ATOMIC_ACQ_REL), *next;
+	// readers may still be walking the detached nodes
+	epoch_synchronize();
+	while(cur != NULL) {
+		next = cur->next;
+		NODE_FREE(cur);
+		cur = next;
+	}
+	init_list(L);
+	pthread_mutex_destroy(&L->lock);
+}
+
+struct node *create_node(int value) {
+	int height = random_height(), i;
+    struct node *newnode = NODE_ALLOC(sizeof(struct node) + sizeof(struct node *) * (height - 1));
+    if (newnode == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    newnode->value = value;
+    newnode->next = NULL;
+    newnode->height = height;
+    for (i = 0; i < height - 1; i++) {
+		newnode->up[i] = NULL;
+    }
+    return newnode;
+}
+
+/**
+ * Starting from pred (NULL for the list head), walk level forward past
+ * every node with a value <= value and return the last one passed; *succ
+ * is set to the node after it.
+ */
+static struct node *find_on_level(struct list *L, struct node *pred, int level,
+								  int value, struct node **succ) {
+	struct node *cur = __atomic_load_n(level_link(L, pred, level), __ATOMIC_ACQUIRE);
+
+	while (cur != NULL && cur->value <= value) {
+		pred = cur;
+		cur = __atomic_load_n(level_link(L, pred, level), __ATOMIC_ACQUIRE);
+	}
+	*succ = cur;
+	return pred;
+}
+
+/**
+ * Link newnode into the list. preds[level] must hold, for every level,
+ * a node on that level (or NULL for the head) with a value <= newnode's;
+ * they are advanced to newnode's predecessors.
+ */
+static void insert_from(struct list *L, struct node *newnode, struct node **preds) {
+    struct node *succs[SKIP_LEVELS];
+    struct node *pred = NULL;
+    int level;
+
+	// predecessors on every level, from the top down, starting from
+	// whichever of preds[level] and the predecessor a level up is further
+	for (level = SKIP_LEVELS - 1; level >= 0; level--) {
+		if (preds[level] != NULL && (pred == NULL || preds[level]->value > pred->value)) {
+			pred = preds[level];
+		}
+		pred = find_on_level(L, pred, level, newnode->value, &succs[level]);
+		preds[level] = pred;
+	}
+
+	// bottom up, so a node on level i is always on the levels below it
+	for (level = 0; level < newnode->height; level++) {
+		for (;;) {
+			*level_link(L, newnode, level) = succs[level];
+			if (__atomic_compare_exchange_n(level_link(L, preds[level], level), &succs[level],
+				newnode, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+			preds[level] = find_on_level(L, preds[level], level, newnode->value, &succs[level]);
+		}
+		if (level == 0) {
+			__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+void insert(struct list *L, int value){
+    struct node *preds[SKIP_LEVELS] = {NULL};
+
+    insert_from(L, create_node(value), preds);
+}
+
+/**
+ * Insert values[0..n): the batch is sorted beforehand and each value's
+ * search starts from the predecessors of the one before, so the batch
+ * is merged in a single pass over each level.
+ */
+void insert_batch(struct list *L, const int *values, int n) {
+	int *sorted = sorted_copy(values, n);
+    struct node *preds[SKIP_LEVELS] = {NULL};
+	int i;
+
+	for (i = 0; i < n; i++) {
+		insert_from(L, create_node(sorted[i]), preds);
+	}
+	free(sorted);
+}
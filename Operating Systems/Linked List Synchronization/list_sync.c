@@ -9,14 +9,40 @@
 
  * Only need to add locking/synchronization to insert.
 
- * Do not need to add synchronization to length because it is never
- * called by multiple threads, only by main after the threads are finished.
+ * length and print_list (list_read.c) need no lock: insert links each
+ * node in with a release store, so they can run alongside it.
  */
 
 struct node *head = NULL;
 
+const char list_impl[] = "global";
+
+void init_list(struct list *L) {
+	L->head = NULL;
+	L->count = 0;
+	pthread_mutex_init(&L->lock, NULL);
+}
+
+/* Free every node; no thread may be inserting, readers are waited for */
+void destroy_list(struct list *L) {
+	struct node *cur = __atomic_exchange_n(&L->head, NULL, __ATOMIC_ACQ_REL), *next;
+	// readers may still be walking the detached nodes
+	epoch_synchronize();
+	while(cur != NULL) {
+		next = cur->next;
+		NODE_FREE(cur);
+		cur = next;
+	}
+	L->count = 0;
+	pthread_mutex_destroy(&L->lock);
+}
+
 struct node *create_node(int value) {
-    struct node *newnode = malloc(sizeof(struct node));
+    struct node *newnode = NODE_ALLOC(sizeof(struct node));
+    if (newnode == NULL) {
+        perror("malloc");
+        exit(1);
+    }
     newnode->value = value;
     newnode->next = NULL;
     return newnode;
@@ -29,12 +55,14 @@ void insert(struct list *L, int value){
     struct node *cur = L->head;
     
     if(L->head == NULL) {
-		L->head = newnode;
+		__atomic_store_n(&L->head, newnode, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
 		pthread_mutex_unlock(&L->lock);
         return; 
     } else if(L->head->value >value) {
         newnode->next = L->head;
-		L->head = newnode;
+		__atomic_store_n(&L->head, newnode, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
 		pthread_mutex_unlock(&L->lock);
         return;
     }
@@ -44,27 +72,43 @@ void insert(struct list *L, int value){
     }
     
     newnode->next = cur->next;
-    cur->next = newnode;
+    // publish the node only once it is complete
+    __atomic_store_n(&cur->next, newnode, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&L->count, 1, __ATOMIC_RELEASE);
     // head doesn't change
 	pthread_mutex_unlock(&L->lock);
     return;
 }
 
-int length(struct list *L) {
-	struct node *cur = L->head;
-	int count = 0;
-	while(cur != NULL) {
-		count++;
-		cur = cur->next;
+/**
+ * Insert values[0..n): the batch is sorted and made into a chain of
+ * nodes beforehand, then merged into the list in one pass, under one
+ * hold of the lock.
+ */
+void insert_batch(struct list *L, const int *values, int n) {
+	int *sorted = sorted_copy(values, n);
+	struct node *chain = NULL, **tail = &chain, *newnode, **link;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		*tail = create_node(sorted[i]);
+		tail = &(*tail)->next;
 	}
-	return count;
-}
+	free(sorted);
 
-void print_list(struct list *L) {
-	struct node *cur = L->head;
-    while(cur != NULL) {
-        printf("%d -> ", cur->value);
-        cur = cur->next;
-    }
-    printf("\n");
-}
\ No newline at end of file
+	pthread_mutex_lock(&L->lock);
+	link = &L->head;
+	while(chain != NULL) {
+		newnode = chain;
+		chain = chain->next;
+		// every value passed so far is <= the rest of the chain too
+		while(*link != NULL && (*link)->value <= newnode->value) {
+			link = &(*link)->next;
+		}
+		newnode->next = *link;
+		__atomic_store_n(link, newnode, __ATOMIC_RELEASE);
+		link = &newnode->next;
+	}
+	__atomic_add_fetch(&L->count, n, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&L->lock);
+}
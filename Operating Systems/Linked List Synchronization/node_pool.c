@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "node_pool.h"
+
+/* bytes of each slab, aligned to its size so a node finds its slab by masking */
+#define SLAB_SIZE (256 * 1024)
+
+struct free_slot {
+    struct free_slot    *next;
+};
+
+/* first cache line of every slab; a slab holds slots of a single class */
+struct slab {
+    struct node_pool    *owner;
+    struct slab         *next;
+    int                 cls;
+};
+
+struct node_pool {
+    /* only used by the owning thread */
+    struct free_slot    *free[POOL_CLASSES];
+    char                *bump[POOL_CLASSES], *bump_end[POOL_CLASSES];
+    struct slab         *slabs;
+
+    /* nodes freed by other threads, one stack per class */
+    struct free_slot    *remote[POOL_CLASSES] __attribute__((aligned(CACHE_LINE)));
+
+    /* set while a thread owns the pool; guarded by pools_lock */
+    int                 in_use;
+    struct node_pool    *next_pool;
+};
+
+static struct node_pool *pools;
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+static __thread struct node_pool *my_pool;
+
+/* pthread key destructor: the exiting thread gives its pool back */
+static void release_pool(void *arg) {
+	struct node_pool *pool = arg;
+
+	pthread_mutex_lock(&pools_lock);
+	pool->in_use = 0;
+	pthread_mutex_unlock(&pools_lock);
+}
+
+static void make_pool_key(void) {
+	pthread_key_create(&pool_key, release_pool);
+}
+
+/* The calling thread's pool, adopting a released one or making a new one */
+static struct node_pool *get_pool(void) {
+	struct node_pool *pool;
+
+	if (my_pool != NULL) {
+		return my_pool;
+	}
+
+	pthread_once(&pool_key_once, make_pool_key);
+	pthread_mutex_lock(&pools_lock);
+	for (pool = pools; pool != NULL && pool->in_use; pool = pool->next_pool)
+		;
+	if (pool == NULL) {
+		if ((pool = aligned_alloc(CACHE_LINE, sizeof(struct node_pool))) == NULL) {
+			perror("aligned_alloc");
+			exit(1);
+		}
+		memset(pool, 0, sizeof(struct node_pool));
+		pool->next_pool = pools;
+		pools = pool;
+	}
+	pool->in_use = 1;
+	pthread_mutex_unlock(&pools_lock);
+
+	pthread_setspecific(pool_key, pool);
+	return my_pool = pool;
+}
+
+/* Carve a slot of cls + 1 cache lines from pool's current slab of that class, starting a new one if needed */
+static void *carve(struct node_pool *pool, int cls) {
+	size_t size = (size_t) (cls + 1) * CACHE_LINE;
+	struct slab *slab;
+	void *slot;
+
+	if (pool->bump[cls] == NULL || pool->bump_end[cls] - pool->bump[cls] < (ptrdiff_t) size) {
+		if ((slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE)) == NULL) {
+			perror("aligned_alloc");
+			exit(1);
+		}
+		slab->owner = pool;
+		slab->next = pool->slabs;
+		slab->cls = cls;
+		pool->slabs = slab;
+		pool->bump[cls] = (char *) slab + CACHE_LINE;
+		pool->bump_end[cls] = (char *) slab + SLAB_SIZE;
+	}
+
+	slot = pool->bump[cls];
+	pool->bump[cls] += size;
+	return slot;
+}
+
+/**
+ * Allocate a node of size bytes from the calling thread's pool. The
+ * node starts on a cache line and is padded to a whole number of them.
+ * Exits if size is over POOL_CLASSES cache lines.
+ */
+void *node_alloc(size_t size) {
+	struct node_pool *pool = get_pool();
+	struct free_slot *slot;
+	int cls = (size + CACHE_LINE - 1) / CACHE_LINE - 1;
+
+	if (cls < 0) {
+		cls = 0;
+	}
+	if (cls >= POOL_CLASSES) {
+		fprintf(stderr, "node_alloc: %zu bytes is too large for a node\n", size);
+		exit(1);
+	}
+
+	if ((slot = pool->free[cls]) == NULL) {
+		// take over everything other threads have given back
+		slot = __atomic_exchange_n(&pool->remote[cls], NULL, __ATOMIC_ACQUIRE);
+		if (slot == NULL) {
+			return carve(pool, cls);
+		}
+	}
+	pool->free[cls] = slot->next;
+	return slot;
+}
+
+/**
+ * Return node, allocated by node_alloc, to the pool it came from.
+ */
+void node_free(void *node) {
+	struct slab *slab = (struct slab *) ((uintptr_t) node & ~((uintptr_t) SLAB_SIZE - 1));
+	struct node_pool *pool = slab->owner;
+	struct free_slot *slot = node;
+	int cls = slab->cls;
+
+	if (pool == my_pool) {
+		slot->next = pool->free[cls];
+		pool->free[cls] = slot;
+		return;
+	}
+
+	slot->next = __atomic_load_n(&pool->remote[cls], __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&pool->remote[cls], &slot->next, slot, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
@@ -0,0 +1,27 @@
+#ifndef __NODE_POOL_H__
+#define __NODE_POOL_H__
+
+#include <stddef.h>
+
+#define CACHE_LINE 64
+
+/*
+ * Per-thread pools of list nodes, used instead of malloc when the list
+ * is built with -DNODE_POOL.
+ *
+ * Each thread carves nodes out of its own slabs, in slots of whole,
+ * aligned cache lines, so nodes never straddle a line and nodes of
+ * different threads never share one. A freed node goes back to the
+ * pool of the thread that allocated it: straight onto its free list if
+ * that is the freeing thread, otherwise onto a lock-free stack that the
+ * owner takes over once its free list runs dry. The pool of a thread
+ * that exits is handed to the next thread that needs one.
+ */
+
+/* largest node the pools hand out, in cache lines */
+#define POOL_CLASSES 4
+
+void *node_alloc(size_t size);
+void node_free(void *node);
+
+#endif
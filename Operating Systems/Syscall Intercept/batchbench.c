@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "sctable.h"
+
+/*
+ * Benchmark of batched monitoring commands, built against the
+ * user-space build of the core.
+ *
+ * Every one of -p pids is set up to be monitored for every one of -s
+ * system calls, then torn down again, once with single
+ * sct_start_monitoring/sct_stop_monitoring calls (batch=1) and once
+ * with sct_apply_batch for batches of -b, 4 * -b, ... commands up to
+ * all of them. Each run prints one line of key=value pairs; ok=no means
+ * the table did not end up as the single calls leave it.
+ * Here no system call is saved by batching, so this is the price of
+ * checking a batch before applying it; the module saves one crossing
+ * into the kernel per command on top of that.
+ *
+ * Then a few batches that must fail are applied to a table holding
+ * half of the pairs, and each must leave the table as it was and report
+ * the command it failed on, by index and in that command's ret.
+ */
+
+#define PID_BASE	100
+
+static struct sctable table;
+static int nr, npids;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void setup(void) {
+	int s;
+
+	if (sct_init(&table, nr) != 0) {
+		fprintf(stderr, "sct_init failed\n");
+		exit(1);
+	}
+	for (s = 0; s < nr; s++)
+		sct_intercept(&table, s);
+}
+
+/* The i-th of the nr * npids commands, pid by pid */
+static void make_request(struct sct_request *req, int cmd, int i) {
+	req->cmd = cmd;
+	req->syscall = i % nr;
+	req->pid = PID_BASE + i / nr;
+	req->ret = 0;
+}
+
+/* Returns 1 if pair i is monitored exactly when (i & odd_mask) == odd */
+static int check_pairs(int odd_mask, int odd) {
+	int i;
+
+	if (sct_check(&table) != 0)
+		return 0;
+	for (i = 0; i < nr * npids; i++) {
+		if (sct_should_log(&table, i % nr, PID_BASE + i / nr) != ((i & odd_mask) == odd))
+			return 0;
+	}
+	return 1;
+}
+
+/* Apply cmd to all pairs, batch at a time; 1 means single calls */
+static double apply_all(struct sct_request *reqs, int cmd, int batch) {
+	int total = nr * npids, i, n, failed, ret;
+	double start;
+
+	for (i = 0; i < total; i++)
+		make_request(&reqs[i], cmd, i);
+
+	start = now();
+	for (i = 0; i < total; i += n) {
+		n = total - i < batch ? total - i : batch;
+		if (batch == 1 && cmd == REQUEST_START_MONITORING)
+			ret = sct_start_monitoring(&table, reqs[i].syscall, reqs[i].pid);
+		else if (batch == 1)
+			ret = sct_stop_monitoring(&table, reqs[i].syscall, reqs[i].pid);
+		else
+			ret = sct_apply_batch(&table, &reqs[i], n, &failed);
+		if (ret != 0) {
+			fprintf(stderr, "command %d failed: %d\n", i, ret);
+			exit(1);
+		}
+	}
+	return now() - start;
+}
+
+static int run(struct sct_request *reqs, int batch) {
+	int total = nr * npids, ok;
+	double up, down;
+
+	setup();
+	up = apply_all(reqs, REQUEST_START_MONITORING, batch);
+	ok = check_pairs(0, 0);
+	down = apply_all(reqs, REQUEST_STOP_MONITORING, batch);
+	ok &= check_pairs(0, 1);
+
+	printf("impl=%s batch=%d syscalls=%d pids=%d commands=%d setup_seconds=%.3f teardown_seconds=%.3f commands_per_sec=%.0f ok=%s\n",
+		batch == 1 ? "single" : "batch", batch, nr, npids, 2 * total, up, down,
+		2 * total / (up + down), ok ? "yes" : "no");
+
+	sct_destroy(&table);
+	return ok;
+}
+
+/*
+ * Apply a batch of n commands that fails on command bad, to a table
+ * monitoring the odd pairs, and check it had no effect.
+ */
+static int run_failing(const char *what, struct sct_request *reqs, int n, int bad, int expect) {
+	int ret, failed, ok, i;
+
+	for (i = 0; i < n; i++)
+		reqs[i].ret = 0;
+	ret = sct_apply_batch(&table, reqs, n, &failed);
+	ok = ret == expect && failed == bad && check_pairs(1, 1);
+	// only the command it failed on has its ret set
+	for (i = 0; i < n; i++)
+		ok &= reqs[i].ret == (i == bad ? expect : 0);
+	printf("impl=batch test=%s commands=%d ret=%d failed=%d ok=%s\n",
+		what, n, ret, failed, ok ? "yes" : "no");
+	return ok;
+}
+
+static int run_failures(struct sct_request *reqs) {
+	int total = nr * npids, half = total / 2, i, failed, ok = 1;
+
+	setup();
+	for (i = 1; i < total; i += 2)
+		sct_start_monitoring(&table, i % nr, PID_BASE + i / nr);
+
+	// starting the even pairs is fine until one of them is started twice
+	for (i = 0; i < half; i++)
+		make_request(&reqs[i], REQUEST_START_MONITORING, 2 * i);
+	reqs[half] = reqs[half / 2];
+	ok &= run_failing("start_twice", reqs, half + 1, half, -EBUSY);
+
+	// or until one of them is stopped before it is started
+	make_request(&reqs[half - 2], REQUEST_STOP_MONITORING, 2 * (half - 1));
+	ok &= run_failing("stop_unmonitored", reqs, half, half - 2, -EINVAL);
+
+	// stopping the odd pairs is fine until a command is not a monitoring one
+	for (i = 0; i < half; i++)
+		make_request(&reqs[i], REQUEST_STOP_MONITORING, 2 * i + 1);
+	reqs[half / 3].cmd = REQUEST_SYSCALL_INTERCEPT;
+	ok &= run_failing("bad_command", reqs, half, half / 3, -EINVAL);
+
+	// and commands cancelling out one another leave the table as it was
+	for (i = 0; i < half; i++) {
+		make_request(&reqs[2 * i], REQUEST_STOP_MONITORING, 2 * i + 1);
+		make_request(&reqs[2 * i + 1], REQUEST_START_MONITORING, 2 * i + 1);
+	}
+	ok &= run_failing("cancelling", reqs, 2 * half, -1, 0);
+
+	if (sct_apply_batch(&table, reqs, 0, &failed) != 0)
+		ok = 0;
+
+	sct_destroy(&table);
+	return ok;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-s syscalls] [-p pids] [-b min_batch]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	struct sct_request *reqs;
+	int min_batch = 16, batch, opt, ok = 1;
+
+	nr = 50;
+	npids = 200;
+	while ((opt = getopt(argc, argv, "s:p:b:")) != -1) {
+		switch (opt) {
+		case 's':
+			nr = atoi(optarg);
+			break;
+		case 'p':
+			npids = atoi(optarg);
+			break;
+		case 'b':
+			min_batch = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr <= 0 || npids <= 1 || min_batch <= 1) {
+		usage(argv[0]);
+	}
+	if ((reqs = calloc(nr * npids + 1, sizeof(struct sct_request))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	ok &= run(reqs, 1);
+	for (batch = min_batch; batch < nr * npids; batch *= 4)
+		ok &= run(reqs, batch);
+	ok &= run(reqs, nr * npids);
+	ok &= run_failures(reqs);
+
+	free(reqs);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include "evring.h"
+
+#ifndef __KERNEL__
+#include <stdio.h>
+#endif
+
+/**
+ * Set up an event buffer of nrings rings of ring_events events each,
+ * rounded up to a power of 2. Sleeps in the kernel.
+ * Returns -ENOMEM if out of memory.
+ */
+int sct_evbuf_init(struct sct_evbuf *buf, int nrings, unsigned long ring_events) {
+	unsigned long slots = 2;
+	int r;
+
+	while (slots < ring_events)
+		slots *= 2;
+
+	buf->nrings = nrings;
+	buf->next = 0;
+	if ((buf->rings = sct_zalloc(nrings * sizeof(struct sct_ring *))) == NULL)
+		return -ENOMEM;
+
+	for (r = 0; r < nrings; r++) {
+		buf->rings[r] = sct_vzalloc(sizeof(struct sct_ring) + slots * sizeof(struct sct_event));
+		if (buf->rings[r] == NULL) {
+			while (--r >= 0)
+				sct_vfree(buf->rings[r]);
+			sct_free(buf->rings);
+			return -ENOMEM;
+		}
+		buf->rings[r]->mask = slots - 1;
+	}
+	return 0;
+}
+
+void sct_evbuf_destroy(struct sct_evbuf *buf) {
+	int r;
+
+	for (r = 0; r < buf->nrings; r++)
+		sct_vfree(buf->rings[r]);
+	sct_free(buf->rings);
+}
+
+/**
+ * Record an event into the given ring, which only the caller records
+ * into. Returns -ENOSPC, and counts the event as dropped, if the ring
+ * is full.
+ */
+int sct_evbuf_record(struct sct_evbuf *buf, int ring, int pid, int syscall,
+	const unsigned long args[6]) {
+	struct sct_ring *r = buf->rings[ring];
+	unsigned long head = r->head;
+	struct sct_event *ev;
+	int i;
+
+	if (head - sct_load_acquire(&r->tail) > r->mask) {
+		SCT_WRITE_ONCE(r->dropped, r->dropped + 1);
+		return -ENOSPC;
+	}
+
+	ev = &r->events[head & r->mask];
+	ev->timestamp = sct_clock_ns();
+	ev->pid = pid;
+	ev->syscall = syscall;
+	for (i = 0; i < 6; i++)
+		ev->args[i] = args[i];
+
+	// the event must be complete before the reader can see it
+	sct_store_release(&r->head, head + 1);
+	return 0;
+}
+
+/**
+ * Move up to max recorded events into out, taking as many as there are
+ * from each ring in turn. Returns the number of events moved.
+ * Must not be called by two readers at once.
+ */
+int sct_evbuf_drain(struct sct_evbuf *buf, struct sct_event *out, int max) {
+	struct sct_ring *r;
+	unsigned long head, tail, n, i;
+	int done = 0, k, idx;
+
+	for (k = 0; k < buf->nrings && done < max; k++) {
+		idx = (buf->next + k) % buf->nrings;
+		r = buf->rings[idx];
+		tail = r->tail;
+		head = sct_load_acquire(&r->head);
+		n = head - tail;
+		if (n > (unsigned long) (max - done))
+			n = max - done;
+
+		for (i = 0; i < n; i++)
+			out[done + i] = r->events[(tail + i) & r->mask];
+		done += n;
+
+		// the slots may only be reused once they have been copied
+		sct_store_release(&r->tail, tail + n);
+	}
+	buf->next = (buf->next + 1) % buf->nrings;
+	return done;
+}
+
+/**
+ * Returns 1 if no ring holds an event, 0 otherwise.
+ */
+int sct_evbuf_empty(struct sct_evbuf *buf) {
+	struct sct_ring *r;
+	int k;
+
+	for (k = 0; k < buf->nrings; k++) {
+		r = buf->rings[k];
+		if (sct_load_acquire(&r->head) != r->tail)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Returns the number of events dropped so far, over all rings.
+ */
+unsigned long sct_evbuf_dropped(struct sct_evbuf *buf) {
+	unsigned long dropped = 0;
+	int k;
+
+	for (k = 0; k < buf->nrings; k++)
+		dropped += SCT_READ_ONCE(buf->rings[k]->dropped);
+	return dropped;
+}
+
+/**
+ * Write an event into str as the line log_message used to print, and
+ * return its length (or the length it would have, as snprintf does).
+ */
+int sct_event_format(const struct sct_event *ev, char *str, int size) {
+	return snprintf(str, size, "[%x]%lx(%lx,%lx,%lx,%lx,%lx,%lx)\n", ev->pid,
+		(unsigned long) ev->syscall,
+		ev->args[0], ev->args[1], ev->args[2], ev->args[3], ev->args[4], ev->args[5]);
+}
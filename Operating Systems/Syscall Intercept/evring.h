@@ -0,0 +1,66 @@
+#ifndef _EVRING_H
+#define _EVRING_H
+
+#include "sct_compat.h"
+
+/*
+ * Buffering of intercepted system call events, shared by the kernel
+ * module and the user-space library.
+ *
+ * An event buffer has one ring per CPU (per producer thread in user
+ * space). Only the owner of a ring records into it, with preemption
+ * disabled in the kernel, and only one reader at a time drains the
+ * buffer, so a ring needs no lock: the producer publishes an event by
+ * advancing head, the reader frees its slot by advancing tail. When a
+ * ring is full the event is counted as dropped and the producer goes
+ * on; it never waits for the reader.
+ *
+ * Events from different rings are not ordered with respect to each
+ * other; the reader can order them by timestamp.
+ */
+
+/* One intercepted system call, as read from the event device */
+struct sct_event {
+	/* nanoseconds, from sct_clock_ns */
+	unsigned long long timestamp;
+	int pid;
+	int syscall;
+	unsigned long args[6];
+};
+
+struct sct_ring {
+	/* next slot the producer writes */
+	unsigned long head __attribute__((aligned(SCT_CACHE_LINE)));
+
+	/* events dropped because the ring was full, written by the producer */
+	unsigned long dropped;
+
+	/* next slot the reader reads */
+	unsigned long tail __attribute__((aligned(SCT_CACHE_LINE)));
+
+	/* slots - 1; the number of slots is a power of 2 */
+	unsigned long mask __attribute__((aligned(SCT_CACHE_LINE)));
+
+	struct sct_event events[];
+};
+
+struct sct_evbuf {
+	int nrings;
+	struct sct_ring **rings;
+
+	/* ring the next drain starts with, so no ring is starved */
+	int next;
+};
+
+int sct_evbuf_init(struct sct_evbuf *buf, int nrings, unsigned long ring_events);
+void sct_evbuf_destroy(struct sct_evbuf *buf);
+
+int sct_evbuf_record(struct sct_evbuf *buf, int ring, int pid, int syscall,
+	const unsigned long args[6]);
+int sct_evbuf_drain(struct sct_evbuf *buf, struct sct_event *out, int max);
+int sct_evbuf_empty(struct sct_evbuf *buf);
+unsigned long sct_evbuf_dropped(struct sct_evbuf *buf);
+
+int sct_event_format(const struct sct_event *ev, char *str, int size);
+
+#endif /* _EVRING_H */
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "sctable.h"
+#include "rand.h"
+
+/*
+ * Exit storm benchmark of the table core: -p monitored pids, each for
+ * -k random system calls, exit at once, along with as many pids that
+ * were never monitored, spread over 1, 2, 4, ... up to -t threads. This
+ * is timed for tables of 64, 512 and 4096 system calls; sct_exit_pid
+ * only touches the sets that hold the pid, so its rate should not
+ * depend on the size of the table.
+ *
+ * For comparison, impl=scan removes each exiting pid by trying every
+ * system call in turn, which is what exit cleanup did before the index.
+ *
+ * Each run prints one line of key=value pairs. ok=no means some pid was
+ * still monitored after the storm.
+ */
+
+static struct sctable table;
+static int nr, npids, per_pid, scan;
+
+struct worker {
+	pthread_t thread;
+	int first, count;
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The i-th monitored pid; pid + 1 is never monitored */
+static pid_t storm_pid(int i) {
+	return 100 + 2 * i;
+}
+
+static void exit_pid(pid_t pid) {
+	int s;
+
+	if (!scan) {
+		sct_exit_pid(&table, pid);
+		return;
+	}
+	for (s = 0; s < nr; s++)
+		sct_stop_monitoring(&table, s, pid);
+}
+
+static void *exiter(void *arg) {
+	struct worker *w = arg;
+	int i;
+
+	for (i = w->first; i < w->first + w->count; i++) {
+		exit_pid(storm_pid(i));
+		exit_pid(storm_pid(i) + 1);
+	}
+	return NULL;
+}
+
+/* Monitor every pid for per_pid random system calls */
+static void setup(void) {
+	unsigned int rng = 1;
+	int i, k, s;
+
+	if (sct_init(&table, nr) != 0) {
+		fprintf(stderr, "sct_init failed\n");
+		exit(1);
+	}
+	for (s = 0; s < nr; s++)
+		sct_intercept(&table, s);
+
+	for (i = 0; i < npids; i++) {
+		for (k = 0; k < per_pid; k++) {
+			s = rt_rand32(&rng) % nr;
+			// -EBUSY if drawn twice for the same pid
+			if (sct_start_monitoring(&table, s, storm_pid(i)) == -ENOMEM) {
+				fprintf(stderr, "sct_start_monitoring failed\n");
+				exit(1);
+			}
+		}
+	}
+}
+
+/* Returns 1 if no pid is left monitored for any system call */
+static int check_table(void) {
+	int s;
+
+	if (sct_check(&table) != 0)
+		return 0;
+	for (s = 0; s < nr; s++) {
+		if (table.entries[s].monitored != 0 || table.entries[s].pids->count != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static int run(int nthreads) {
+	struct worker *workers = calloc(nthreads, sizeof(struct worker));
+	double start, elapsed;
+	int i, first = 0, ok;
+
+	if (workers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	setup();
+
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		workers[i].first = first;
+		workers[i].count = npids / nthreads + (i < npids % nthreads);
+		first += workers[i].count;
+		if (pthread_create(&workers[i].thread, NULL, exiter, &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].thread, NULL);
+	elapsed = now() - start;
+
+	ok = check_table();
+	printf("impl=%s syscalls=%d pids=%d syscalls_per_pid=%d threads=%d exits=%d seconds=%.3f exits_per_sec=%.0f ok=%s\n",
+		scan ? "scan" : "index", nr, npids, per_pid, nthreads, 2 * npids,
+		elapsed, 2 * npids / elapsed, ok ? "yes" : "no");
+
+	sct_destroy(&table);
+	free(workers);
+	return ok;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-p pids] [-k syscalls_per_pid] [-t max_threads]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int max_threads = 8, nthreads, opt, ok = 1;
+
+	npids = 4096;
+	per_pid = 4;
+	while ((opt = getopt(argc, argv, "p:k:t:")) != -1) {
+		switch (opt) {
+		case 'p':
+			npids = atoi(optarg);
+			break;
+		case 'k':
+			per_pid = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (npids <= 0 || per_pid <= 0 || max_threads <= 0) {
+		usage(argv[0]);
+	}
+
+	for (nr = 64; nr <= 4096; nr *= 8) {
+		for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+			scan = 0;
+			ok &= run(nthreads);
+			scan = 1;
+			ok &= run(nthreads);
+		}
+	}
+	return ok ? 0 : 1;
+}
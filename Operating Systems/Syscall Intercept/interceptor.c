@@ -9,7 +9,17 @@
 #include <linux/spinlock.h>
 #include <linux/semaphore.h>
 #include <linux/syscalls.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/srcu.h>
+#include <linux/wait.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
 #include "interceptor.h"
+#include "sctable.h"
+#include "evring.h"
+#include "sctstats.h"
 
 
 MODULE_DESCRIPTION("My kernel module");
@@ -44,153 +54,191 @@ void set_addr_ro(unsigned long addr) {
 
 //----- Data structures and bookkeeping -----------------------
 /**
- * This block contains the data structures needed for keeping track of
- * intercepted system calls (including their original calls), pid monitoring
- * synchronization on shared data, etc.
+ * Which system calls are intercepted and which pids are monitored for
+ * them is kept in a struct sctable, see sctable.h. Here we only keep
+ * the original system calls, which the table knows nothing about.
  */
 
-/* List structure - each intercepted syscall may have a list of monitored pids */
-struct pid_list {
-	pid_t pid;
-	struct list_head list;
-};
-
-
-/* Store info about intercepted/replaced system calls */
-typedef struct {
-
-	/* Original system call */
-	asmlinkage long (*f)(struct pt_regs);
+/* The bookkeeping table, one entry per system call */
+struct sctable sct;
 
-	/* Status: 1=intercepted, 0=not intercepted */
-	int intercepted;
+/* Original system calls, valid while they are intercepted */
+asmlinkage long (*orig_syscall[NR_syscalls])(struct pt_regs);
 
-	/* Are any PIDs being monitored for this syscall? */
-	int monitored;	
-	/* List of monitored PIDs */
-	int listcount;
-	struct list_head my_list;
-}mytable;
+/*
+ * Changes to the system call table must be synchronized; a mutex, as
+ * sct_intercept and sct_release may sleep on the table's batch lock
+ */
+DEFINE_MUTEX(sys_call_table_lock);
 
-/* An entry for each system call in this "metadata" table */
-mytable table[NR_syscalls];
+/* set under sys_call_table_lock once the module starts to exit */
+static int unloading;
 
-/* Access to the system call table and your metadata table must be synchronized */
-spinlock_t my_table_lock = SPIN_LOCK_UNLOCKED;
-spinlock_t sys_call_table_lock = SPIN_LOCK_UNLOCKED;
+/*
+ * Every function the system call table leads into runs inside a read
+ * section of entry_srcu, so that exit_function can wait for the calls
+ * still running in them before freeing what they use. SRCU, because
+ * the original system calls they make may sleep.
+ */
+DEFINE_STATIC_SRCU(entry_srcu);
 //-------------------------------------------------------------
 
 
-//----------LIST OPERATIONS------------------------------------
+//----- Event buffer and device -------------------------------
 /**
- * These operations are meant for manipulating the list of pids
+ * Monitored system calls are recorded into a ring of the CPU they run
+ * on (see evring.h) instead of being printed, and read in batches of
+ * struct sct_event from the EVENT_DEVICE character device.
  */
 
-/**
- * Add a pid to a syscall's list of monitored pids. 
- * Returns -ENOMEM if the operation is unsuccessful.
- */
-static int add_pid_sysc(pid_t pid, int sysc)
-{
-	struct pid_list *ple=(struct pid_list*)kmalloc(sizeof(struct pid_list), GFP_KERNEL);
+/* events each CPU can hold until they are read */
+#define EVENT_RING_SIZE		4096
 
-	if (!ple)
-		return -ENOMEM;
+/* events copied to the reader at a time */
+#define EVENT_READ_BATCH	64
 
-	INIT_LIST_HEAD(&ple->list);
-	ple->pid=pid;
+struct sct_evbuf events;
 
-	list_add(&ple->list, &(table[sysc].my_list));
-	table[sysc].listcount++;
+/* readers sleep here while there are no events */
+DECLARE_WAIT_QUEUE_HEAD(events_wait);
 
-	return 0;
-}
+/* one reader drains the rings at a time, into read_batch */
+DEFINE_MUTEX(events_read_lock);
+struct sct_event read_batch[EVENT_READ_BATCH];
 
 /**
- * Remove a pid from a system call's list of monitored pids.
- * Returns -EINVAL if no such pid was found in the list.
+ * Read as many whole events as fit in count bytes. Waits for an event
+ * if there is none, unless the file is non-blocking.
  */
-static int del_pid_sysc(pid_t pid, int sysc)
-{
-	struct list_head *i;
-	struct pid_list *ple;
-
-	list_for_each(i, &(table[sysc].my_list)) {
-
-		ple=list_entry(i, struct pid_list, list);
-		if(ple->pid == pid) {
-
-			list_del(i);
-			kfree(ple);
-
-			table[sysc].listcount--;
-			/* If there are no more pids in sysc's list of pids, then
-			 * stop the monitoring only if it's not for all pids (monitored=2) */
-			if(table[sysc].listcount == 0 && table[sysc].monitored == 1) {
-				table[sysc].monitored = 0;
-			}
-
-			return 0;
+static ssize_t events_read(struct file *file, char __user *ubuf, size_t count, loff_t *ppos) {
+	
+	size_t max = count / sizeof(struct sct_event), done = 0;
+	int n;
+	
+	if (max == 0) {
+		return -EINVAL;
+	}
+	
+	if (mutex_lock_interruptible(&events_read_lock)) {
+		return -ERESTARTSYS;
+	}
+	while (sct_evbuf_empty(&events)) {
+		mutex_unlock(&events_read_lock);
+		if (file->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		if (wait_event_interruptible(events_wait, !sct_evbuf_empty(&events)) ||
+			mutex_lock_interruptible(&events_read_lock)) {
+			return -ERESTARTSYS;
 		}
 	}
-
-	return -EINVAL;
+	
+	//drain the rings a batch at a time, until they or the user buffer run out
+	while (done < max) {
+		n = sct_evbuf_drain(&events, read_batch, min_t(size_t, max - done, EVENT_READ_BATCH));
+		if (n == 0) {
+			break;
+		}
+		if (copy_to_user(ubuf + done * sizeof(struct sct_event), read_batch,
+			n * sizeof(struct sct_event))) {
+			mutex_unlock(&events_read_lock);
+			return -EFAULT;
+		}
+		done += n;
+	}
+	mutex_unlock(&events_read_lock);
+	
+	return done * sizeof(struct sct_event);
 }
 
+static const struct file_operations events_fops = {
+	.owner = THIS_MODULE,
+	.read = events_read,
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice events_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = EVENT_DEVICE_NAME,
+	.fops = &events_fops,
+};
+//-------------------------------------------------------------
+
+
+//----- Counters and summary device ---------------------------
 /**
- * Remove a pid from all the lists of monitored pids (for all intercepted syscalls).
- * Returns -1 if this process is not being monitored in any list.
+ * Every monitored call is counted on the CPU it returns on, with its
+ * latency (see sctstats.h); a summary of the counters is taken when
+ * the STATS_DEVICE is opened, and read from it as text.
  */
-static int del_pid(pid_t pid)
-{
-	struct list_head *i, *n;
-	struct pid_list *ple;
-	int ispid = 0, s = 0;
-
-	for(s = 1; s < NR_syscalls; s++) {
 
-		list_for_each_safe(i, n, &(table[s].my_list)) {
+/* (system call, pid) pairs each CPU counts calls of */
+#define STATS_PID_SLOTS		4096
 
-			ple=list_entry(i, struct pid_list, list);
-			if(ple->pid == pid) {
+struct sct_stats stats;
 
-				list_del(i);
-				ispid = 1;
-				kfree(ple);
+/* a summary, as taken by stats_open */
+struct stats_text {
+	size_t len;
+	char text[];
+};
 
-				table[s].listcount--;
-				/* If there are no more pids in sysc's list of pids, then
-				 * stop the monitoring only if it's not for all pids (monitored=2) */
-				if(table[s].listcount == 0 && table[s].monitored == 1) {
-					table[s].monitored = 0;
-				}
-			}
+static int stats_open(struct inode *inode, struct file *file) {
+	
+	struct stats_text *t;
+	int size = 4096, len;
+	
+	//the counters may grow while we format them, so retry until they fit
+	for (;;) {
+		if ((t = vmalloc(sizeof(struct stats_text) + size)) == NULL) {
+			return -ENOMEM;
 		}
+		if ((len = sct_stats_format(&stats, t->text, size)) < 0) {
+			vfree(t);
+			return len;
+		}
+		if (len < size) {
+			break;
+		}
+		vfree(t);
+		size = len + len / 4 + 1;
 	}
-
-	if (ispid) return 0;
-	return -1;
+	t->len = len;
+	file->private_data = t;
+	
+	return 0;
 }
 
-/**
- * Clear the list of monitored pids for a specific syscall.
- */
-static void destroy_list(int sysc) {
+static ssize_t stats_read(struct file *file, char __user *ubuf, size_t count, loff_t *ppos) {
+	
+	struct stats_text *t = file->private_data;
+	
+	return simple_read_from_buffer(ubuf, count, ppos, t->text, t->len);
+}
 
-	struct list_head *i, *n;
-	struct pid_list *ple;
+static int stats_release(struct inode *inode, struct file *file) {
+	
+	vfree(file->private_data);
+	return 0;
+}
 
-	list_for_each_safe(i, n, &(table[sysc].my_list)) {
+static const struct file_operations stats_fops = {
+	.owner = THIS_MODULE,
+	.open = stats_open,
+	.read = stats_read,
+	.release = stats_release,
+	.llseek = default_llseek,
+};
 
-		ple=list_entry(i, struct pid_list, list);
-		list_del(i);
-		kfree(ple);
-	}
+static struct miscdevice stats_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = STATS_DEVICE_NAME,
+	.fops = &stats_fops,
+};
+//-------------------------------------------------------------
 
-	table[sysc].listcount = 0;
-	table[sysc].monitored = 0;
-}
 
+//----------PID OPERATIONS-------------------------------------
 /**
  * Check if two pids have the same owner - useful for checking if a pid 
  * requested to be monitored is owned by the requesting process.
@@ -201,36 +249,18 @@ static int check_pids_same_owner(pid_t pid1, pid_t pid2) {
 
 	struct task_struct *p1 = pid_task(find_vpid(pid1), PIDTYPE_PID);
 	struct task_struct *p2 = pid_task(find_vpid(pid2), PIDTYPE_PID);
-	if(p1->real_cred->uid != p2->real_cred->uid)
+	if (!uid_eq(p1->real_cred->uid, p2->real_cred->uid))
 		return -EPERM;
 	return 0;
 }
 
-/**
- * Check if a pid is already being monitored for a specific syscall.
- * Returns 1 if it already is, or 0 if pid is not in sysc's list.
- */
-static int check_pid_monitored(int sysc, pid_t pid) {
-
-	struct list_head *i;
-	struct pid_list *ple;
-
-	list_for_each(i, &(table[sysc].my_list)) {
-
-		ple=list_entry(i, struct pid_list, list);
-		if(ple->pid == pid) 
-			return 1;
-		
-	}
-	return 0;	
-}
 //----------------------------------------------------------------
 
 //----- Intercepting exit_group ----------------------------------
 /**
  * Since a process can exit without its owner specifically requesting
  * to stop monitoring it, we must intercept the exit_group system call
- * so that we can remove the exiting process's pid from *all* syscall lists.
+ * so that we can remove the exiting process's pid from *all* syscall pid sets.
  */  
 
 /** 
@@ -241,13 +271,14 @@ void (*orig_exit_group)(int);
 
 /**
  * Our custom exit_group system call.
- * When a process exits, make sure to remove that pid from all lists.
+ * When a process exits, make sure to remove that pid from all pid sets.
  */
 void my_exit_group(int status)
 {
-	spin_lock(&my_table_lock);
-	del_pid(current->pid); //remove pid from all lists
-	spin_unlock(&my_table_lock);
+	int idx = srcu_read_lock(&entry_srcu);
+	
+	sct_exit_pid(&sct, current->pid); //remove pid from all pid sets
+	srcu_read_unlock(&entry_srcu, idx); //exit_group does not return
 	orig_exit_group(status); //call original exit_group
 }
 //----------------------------------------------------------------
@@ -256,38 +287,207 @@ void my_exit_group(int status)
 
 /** 
  * This is the generic interceptor function.
- * It should just log a message and call the original syscall.
+ * It should just count the call, record it as an event if it is
+ * sampled, and call the original syscall.
  * 
- * - Check first to see if the syscall is being monitored for the current->pid. 
- * - Convention for the "monitored" flag in the mytable struct: 
- *     monitored=0 => not monitored
- *     monitored=1 => some pids are monitored, check the corresponding my_list
- *     monitored=2 => all pids are monitored for this syscall
+ * - Check first to see if the syscall is being monitored for the current->pid;
+ *   sct_should_log takes no lock and costs the same however many pids
+ *   are monitored.
+ * - The whole call, the original one included, is an entry_srcu read
+ *   section; the exit calls, which never return, leave it just before.
  */
 asmlinkage long interceptor(struct pt_regs reg) {
 	
-	int s;
+	asmlinkage long (*call)(struct pt_regs);
+	int s, cpu, sampled = 0, logged, idx;
+	unsigned long long start;
+	long ret;
 	s = reg.ax; //syscall number
 	
-	//log message if pid monitored
-	if ((table[s].monitored == 1 && check_pid_monitored(s, current->pid)) ||
-		(table[s].monitored == 2 && !check_pid_monitored(s, current->pid))) {
-		log_message(current->pid, reg.ax, reg.bx, reg.cx, reg.dx, reg.si, reg.di, reg.bp);
+	idx = srcu_read_lock(&entry_srcu);
+	
+	//record event if sampled, in the ring of this cpu
+	if ((logged = sct_should_log(&sct, s, current->pid))) {
+		cpu = get_cpu();
+		if ((sampled = sct_stats_sample(&stats, cpu))) {
+			unsigned long args[6] = { reg.bx, reg.cx, reg.dx, reg.si, reg.di, reg.bp };
+			
+			sct_evbuf_record(&events, cpu, current->pid, s, args);
+		}
+		put_cpu();
+	}
+	
+	//the event must be visible before we look for sleeping readers
+	if (sampled) {
+		smp_mb();
+		if (waitqueue_active(&events_wait)) {
+			wake_up_interruptible(&events_wait);
+		}
+	}
+	
+	if (s == __NR_exit || s == __NR_exit_group) {
+		call = orig_syscall[s];
+		srcu_read_unlock(&entry_srcu, idx);
+		return call(reg);
 	}
 	
-	return table[s].f(reg); //call original system call
+	if (!logged) {
+		ret = orig_syscall[s](reg); //call original system call
+		srcu_read_unlock(&entry_srcu, idx);
+		return ret;
+	}
+	
+	//time the original system call, and count it on the cpu it returns on
+	start = sct_clock_ns();
+	ret = orig_syscall[s](reg);
+	cpu = get_cpu();
+	sct_stats_account(&stats, cpu, s, current->pid, sct_clock_ns() - start);
+	put_cpu();
+	srcu_read_unlock(&entry_srcu, idx);
+	
+	return ret;
+}
+
+/**
+ * Check that the calling process may start or stop monitoring 'pid'
+ * for 'syscall': pid must exist and belong to the caller's user, and
+ * only a superuser may ask for all pids (pid=0).
+ */
+static int check_monitor_request(int syscall, int pid) {
+	
+	//invalid syscall number
+	if (syscall < 0 || syscall == MY_CUSTOM_SYSCALL || syscall >= NR_syscalls) {
+		return -EINVAL;
+	}
+	
+	//invalid pid
+	if (pid < 0 || (pid != 0 && pid_task(find_vpid(pid), PIDTYPE_PID) == NULL)) {
+		return -EINVAL;
+	}
+	
+	if (!uid_eq(current_uid(), GLOBAL_ROOT_UID)) {
+		if (pid != 0) {
+			if (check_pids_same_owner(current->pid, pid) != 0) {
+				//pid requested not owned by calling process
+				return -EPERM;
+			}
+		} else { //monitoring all pids only allowed for a superuser
+			return -EPERM;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Carry out a batch of n start/stop monitoring commands from user space,
+ * all or none of them: each is checked as if issued on its own, then
+ * the table applies them together. If the batch fails because of one
+ * command, its error is written back to that command's 'ret'.
+ */
+static long do_batch(struct sct_request __user *ureqs, int n) {
+	
+	struct sct_request *reqs;
+	int i, failed;
+	long ret = 0;
+	
+	if (n < 0 || n > MAX_BATCH) {
+		return -EINVAL;
+	}
+	if (n == 0) {
+		return 0;
+	}
+	if ((reqs = vmalloc(n * sizeof(struct sct_request))) == NULL) {
+		return -ENOMEM;
+	}
+	if (copy_from_user(reqs, ureqs, n * sizeof(struct sct_request))) {
+		vfree(reqs);
+		return -EFAULT;
+	}
+	
+	failed = -1;
+	for (i = 0; i < n; i++) {
+		if (reqs[i].cmd != REQUEST_START_MONITORING && reqs[i].cmd != REQUEST_STOP_MONITORING) {
+			ret = -EINVAL;
+		} else {
+			ret = check_monitor_request(reqs[i].syscall, reqs[i].pid);
+		}
+		if (ret != 0) {
+			reqs[i].ret = ret;
+			failed = i;
+			break;
+		}
+	}
+	if (ret == 0) {
+		ret = sct_apply_batch(&sct, reqs, n, &failed);
+	}
+	
+	//tell the caller which command the batch failed on
+	if (failed >= 0 && put_user(reqs[failed].ret, &ureqs[failed].ret)) {
+		ret = -EFAULT;
+	}
+	
+	vfree(reqs);
+	return ret;
 }
 
 /**
  * My system call - this function is called whenever a user issues a MY_CUSTOM_SYSCALL system call.
- * The parameters for this system call indicate one of 4 actions/commands:
+ * The parameters for this system call indicate one of 7 actions/commands:
  *      - REQUEST_SYSCALL_INTERCEPT to intercept the 'syscall' argument
  *      - REQUEST_SYSCALL_RELEASE to de-intercept the 'syscall' argument
  *      - REQUEST_START_MONITORING to start monitoring for 'pid' whenever it issues 'syscall' 
  *      - REQUEST_STOP_MONITORING to stop monitoring for 'pid'
  *      For the last two, if pid=0, that translates to "all pids".
+ *      - REQUEST_BATCH to carry out the 'syscall' start/stop monitoring
+ *      commands in the struct sct_request array 'arg' points to, all
+ *      or none of them; the command it fails on gets its 'ret' set
+ *      - REQUEST_SET_SAMPLING to record one monitored call in 'arg' as
+ *      an event, none if 'arg' is 0; the others are only counted
+ *      - REQUEST_RESET_STATS to start all counters over
+ *      For all other commands, 'arg' is the pid.
  */
-asmlinkage long my_syscall(int cmd, int syscall, int pid) {
+static long do_request(int cmd, int syscall, unsigned long arg);
+
+asmlinkage long my_syscall(int cmd, int syscall, unsigned long arg) {
+	
+	int idx = srcu_read_lock(&entry_srcu);
+	long ret = do_request(cmd, syscall, arg);
+	
+	srcu_read_unlock(&entry_srcu, idx);
+	return ret;
+}
+
+static long do_request(int cmd, int syscall, unsigned long arg) {
+	
+	int pid = (int) arg;
+	int ret;
+	
+	if (cmd == REQUEST_BATCH) {
+		return do_batch((struct sct_request __user *) arg, syscall);
+	}
+	
+	if (cmd == REQUEST_SET_SAMPLING) {
+		
+		//not root
+		if (!uid_eq(current_uid(), GLOBAL_ROOT_UID)) {
+			return -EPERM;
+		}
+		
+		sct_stats_set_sampling(&stats, (unsigned int) arg);
+		return 0;
+	}
+	
+	if (cmd == REQUEST_RESET_STATS) {
+		
+		//not root
+		if (!uid_eq(current_uid(), GLOBAL_ROOT_UID)) {
+			return -EPERM;
+		}
+		
+		sct_stats_reset(&stats);
+		return 0;
+	}
 	
 	//invalid syscall number
 	if (syscall < 0 || syscall == MY_CUSTOM_SYSCALL || syscall >= NR_syscalls) {
@@ -297,179 +497,67 @@ asmlinkage long my_syscall(int cmd, int syscall, int pid) {
 	if (cmd == REQUEST_SYSCALL_INTERCEPT) {
 		
 		//not root
-		if (current_uid() != 0) {
+		if (!uid_eq(current_uid(), GLOBAL_ROOT_UID)) {
 			return -EPERM;
 		}
 		
-		//system call already intercepted
-		if (table[syscall].intercepted == 1) {
-			return -EBUSY;
+		//mark intercepted, then save original system call and replace it
+		//with interceptor; fails with -EBUSY if already intercepted, and
+		//-ENODEV if the module is exiting
+		mutex_lock(&sys_call_table_lock);
+		if (unloading) {
+			ret = -ENODEV;
+		} else if ((ret = sct_intercept(&sct, syscall)) == 0) {
+			orig_syscall[syscall] = sys_call_table[syscall];
+			set_addr_rw((unsigned long) sys_call_table);
+			sys_call_table[syscall] = &interceptor;
+			set_addr_ro((unsigned long) sys_call_table);
 		}
-		
-		//save original system call and set intercepted flag
-		spin_lock(&my_table_lock);
-		table[syscall].f = sys_call_table[syscall];
-		table[syscall].intercepted = 1;
-		spin_unlock(&my_table_lock);
-		
-		//replace system call with interceptor
-		spin_lock(&sys_call_table_lock);
-		set_addr_rw((unsigned long) sys_call_table);
-		sys_call_table[syscall] = &interceptor;
-		set_addr_ro((unsigned long) sys_call_table);
-		spin_unlock(&sys_call_table_lock);
+		mutex_unlock(&sys_call_table_lock);
+		return ret;
 	
 	} else if (cmd == REQUEST_SYSCALL_RELEASE) {
 		
 		//not root
-		if (current_uid() != 0) {
+		if (!uid_eq(current_uid(), GLOBAL_ROOT_UID)) {
 			return -EPERM;
 		}
 		
-		//system call hasn't been intercepted yet, so can't release
-		if (table[syscall].intercepted == 0) {
-			return -EINVAL;
+		//restore original system call; fails with -EINVAL if it
+		//hasn't been intercepted yet
+		mutex_lock(&sys_call_table_lock);
+		if ((ret = sct_release(&sct, syscall)) == 0) {
+			set_addr_rw((unsigned long) sys_call_table);
+			sys_call_table[syscall] = orig_syscall[syscall];
+			set_addr_ro((unsigned long) sys_call_table);
 		}
-		
-		//restore original system call
-		spin_lock(&sys_call_table_lock);
-		set_addr_rw((unsigned long) sys_call_table);
-		sys_call_table[syscall] = table[syscall].f;
-		set_addr_ro((unsigned long) sys_call_table);
-		spin_unlock(&sys_call_table_lock);
-		
-		//reset intercepted status
-		spin_lock(&my_table_lock);
-		table[syscall].intercepted = 0;
-		spin_unlock(&my_table_lock);
+		mutex_unlock(&sys_call_table_lock);
+		return ret;
 		
 	} else if (cmd == REQUEST_START_MONITORING) {
 		
-		//invalid pid
-		if (pid < 0 || (pid != 0 && pid_task(find_vpid(pid), PIDTYPE_PID) == NULL)) {
-			return -EINVAL;
+		if ((ret = check_monitor_request(syscall, pid)) != 0) {
+			return ret;
 		}
 		
-		if (current_uid() != 0) {
-			if (pid != 0) {
-				if (check_pids_same_owner(current->pid, pid) != 0) {
-					//pid requested not owned by calling process
-					return -EPERM;
-				}
-			} else { //start monitoring all pids only allowed for a superuser
-				return -EPERM;
-			}
-		}
-		
-		//can't start monitoring if system call hasn't been intercepted
-		if (table[syscall].intercepted == 0) {
-			return -EINVAL;
-		}
-		
-		//pid already being monitored
-		if ((table[syscall].monitored == 1 && check_pid_monitored(syscall, pid) == 1) ||
-			(table[syscall].monitored == 2 && check_pid_monitored(syscall, pid) == 0)) {
-				return -EBUSY;
-		}
-		
-		if (pid == 0) {
-			
-			//clear blacklist, and start monitoring all pids
-			spin_lock(&my_table_lock);
-			destroy_list(syscall);
-			table[syscall].monitored = 2;
-			spin_unlock(&my_table_lock);
-		
-		} else {
-			
-			if (table[syscall].monitored == 2) {
-				
-				//blacklist removal for pid to start monitoring
-				spin_lock(&my_table_lock);
-				if (del_pid_sysc(pid, syscall) != 0) {
-					spin_unlock(&my_table_lock);
-					return -EBUSY; //pid not in blacklist, so already being monitored
-				}
-				spin_unlock(&my_table_lock);
-				return 0;
-				
-			}
-			
-			//add pid to list of monitored pids
-			spin_lock(&my_table_lock);
-			if (add_pid_sysc(pid, syscall) != 0) {
-				spin_unlock(&my_table_lock);
-				return -ENOMEM; //not enough memory available for list addition
-			}
-			table[syscall].monitored = 1;
-			spin_unlock(&my_table_lock);
-			
-		}
+		//fails with -EINVAL if the system call hasn't been intercepted,
+		//-EBUSY if pid is already being monitored
+		return sct_start_monitoring(&sct, syscall, pid);
 		
 	} else if (cmd == REQUEST_STOP_MONITORING) {
 		
-		//invalid pid
-		if (pid < 0 || (pid != 0 && pid_task(find_vpid(pid), PIDTYPE_PID) == NULL)) {
-			return -EINVAL;
+		if ((ret = check_monitor_request(syscall, pid)) != 0) {
+			return ret;
 		}
 		
-		if (current_uid() != 0) {
-			if (pid != 0) {
-				if (check_pids_same_owner(current->pid, pid) != 0) {
-					//pid requested not owned by calling process
-					return -EPERM;
-				}
-			} else { //stop monitoring all pids command only allowed for a superuser
-				return -EPERM;
-			}
-		}
+		//fails with -EINVAL if the system call hasn't been intercepted,
+		//or pid is not being monitored
+		return sct_stop_monitoring(&sct, syscall, pid);
 		
-		//system call hasn't been intercepted, or pid not being monitored
-		if ((table[syscall].intercepted == 0) ||
-			(table[syscall].monitored == 0) ||
-			(table[syscall].monitored == 1 && !check_pid_monitored(syscall, pid)) ||
-			(table[syscall].monitored == 2 && check_pid_monitored(syscall, pid))) {
-			return -EINVAL;
-		}
-		
-		if (pid == 0) {
-			
-			//stop monitoring all pids for syscall
-			spin_lock(&my_table_lock);
-			destroy_list(syscall);
-			spin_unlock(&my_table_lock);
-			
-		} else {
-			
-			if (table[syscall].monitored == 2) {
-				
-				//blacklist addition for pid to stop monitoring
-				spin_lock(&my_table_lock);
-				if (add_pid_sysc(pid, syscall) != 0) {
-					spin_unlock(&my_table_lock);
-					return -ENOMEM; //no memory available for blacklist addition
-				}
-				spin_unlock(&my_table_lock);
-				return 0;
-				
-			}
-			
-			//remove pid from list of monitored pids
-			spin_lock(&my_table_lock);
-			if (del_pid_sysc(pid, syscall) != 0) {
-				spin_unlock(&my_table_lock);
-				return -EINVAL; //pid already not being monitored
-			}
-			spin_unlock(&my_table_lock);
-			
-		}
-		
-	} else {
-		//invalid command
-		return -EINVAL;
 	}
 	
-	return 0;
+	//invalid command
+	return -EINVAL;
 }
 
 /**
@@ -483,9 +571,38 @@ long (*orig_custom_syscall)(void);
  */
 static int init_function(void) {
 	
-	int s;
+	int ret;
 	
-	spin_lock(&sys_call_table_lock);
+	//initialize table for bookkeeping
+	if (sct_init(&sct, NR_syscalls) != 0) {
+		return -ENOMEM;
+	}
+	
+	//one event ring and set of counters per cpu, and the devices they are read from
+	if (sct_evbuf_init(&events, nr_cpu_ids, EVENT_RING_SIZE) != 0) {
+		sct_destroy(&sct);
+		return -ENOMEM;
+	}
+	if (sct_stats_init(&stats, NR_syscalls, nr_cpu_ids, STATS_PID_SLOTS) != 0) {
+		sct_evbuf_destroy(&events);
+		sct_destroy(&sct);
+		return -ENOMEM;
+	}
+	if ((ret = misc_register(&events_dev)) != 0) {
+		sct_stats_destroy(&stats);
+		sct_evbuf_destroy(&events);
+		sct_destroy(&sct);
+		return ret;
+	}
+	if ((ret = misc_register(&stats_dev)) != 0) {
+		misc_deregister(&events_dev);
+		sct_stats_destroy(&stats);
+		sct_evbuf_destroy(&events);
+		sct_destroy(&sct);
+		return ret;
+	}
+	
+	mutex_lock(&sys_call_table_lock);
 	
 	//save original system calls
 	orig_custom_syscall = sys_call_table[MY_CUSTOM_SYSCALL];
@@ -499,19 +616,7 @@ static int init_function(void) {
 	
 	set_addr_ro((unsigned long) sys_call_table);
 	
-	spin_unlock(&sys_call_table_lock);
-	
-	spin_lock(&my_table_lock);
-	
-	//initialize table for bookkeeping
-	for (s = 0; s < NR_syscalls; s++) {
-		table[s].intercepted = 0;
-		table[s].monitored = 0;
-		table[s].listcount = 0;
-		INIT_LIST_HEAD (&(table[s].my_list));
-	}
-	
-	spin_unlock(&my_table_lock);
+	mutex_unlock(&sys_call_table_lock);
 	
 	return 0;
 }
@@ -523,25 +628,37 @@ static void exit_function(void) {
 	
 	int s;
 	
-	spin_lock(&my_table_lock);
+	mutex_lock(&sys_call_table_lock);
+	unloading = 1;
+	set_addr_rw((unsigned long) sys_call_table);
 	
-	//deintercept all system calls and cleanup all pid lists
+	//deintercept all system calls, and restore original system calls
 	for (s = 0; s < NR_syscalls; s++) {
-		destroy_list(s);
-		table[s].intercepted = 0;
+		if (sct_release(&sct, s) == 0) {
+			sys_call_table[s] = orig_syscall[s];
+		}
 	}
-	
-	spin_unlock(&my_table_lock);
-	
-	spin_lock(&sys_call_table_lock);
-	set_addr_rw((unsigned long) sys_call_table);
-	
-	//restore original system calls
 	sys_call_table[MY_CUSTOM_SYSCALL] = orig_custom_syscall;
 	sys_call_table[__NR_exit_group] = orig_exit_group;
 	
 	set_addr_ro((unsigned long) sys_call_table);
-	spin_unlock(&sys_call_table_lock);
+	mutex_unlock(&sys_call_table_lock);
+	
+	//wait for the calls still running in our functions; a monitored
+	//call that blocks, say a read, holds up the unload. Only a call that
+	//read the table just before it was restored, and has not reached
+	//srcu_read_lock yet, can slip through: nothing a module can close.
+	synchronize_srcu(&entry_srcu);
+	
+	//cleanup all pid sets, events and counters, nothing uses them any more
+	sct_destroy(&sct);
+	misc_deregister(&events_dev);
+	misc_deregister(&stats_dev);
+	if (sct_evbuf_dropped(&events)) {
+		printk(KERN_INFO "interceptor: %lu events dropped\n", sct_evbuf_dropped(&events));
+	}
+	sct_evbuf_destroy(&events);
+	sct_stats_destroy(&stats);
 	
 }
 
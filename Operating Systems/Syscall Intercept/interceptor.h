@@ -5,13 +5,54 @@
 #define REQUEST_SYSCALL_RELEASE         2
 #define REQUEST_START_MONITORING        3
 #define REQUEST_STOP_MONITORING         4
+#define REQUEST_BATCH                   5
+#define REQUEST_SET_SAMPLING            6
+#define REQUEST_RESET_STATS             7
 
 #define MY_CUSTOM_SYSCALL               0
 
+/**
+ * One command of a REQUEST_BATCH, which passes the number of commands
+ * as 'syscall' and a pointer to an array of them as 'arg'. Only
+ * REQUEST_START_MONITORING and REQUEST_STOP_MONITORING may be batched;
+ * either all commands succeed, in order, or none has any effect.
+ */
+struct sct_request {
+	int cmd;
+	int syscall;
+	int pid;
+
+	/*
+	 * Set to the error of a batch that fails because of this command,
+	 * which is what the command would have returned on its own; left
+	 * as it was otherwise, so clear it to find the command
+	 */
+	int ret;
+};
+
+/* most commands in one REQUEST_BATCH */
+#define MAX_BATCH                       65536
+
+/* Monitored system calls are read from here, as struct sct_event (evring.h) */
+#define EVENT_DEVICE_NAME               "sctevents"
+#define EVENT_DEVICE                    "/dev/" EVENT_DEVICE_NAME
+
+/*
+ * All monitored system calls are counted, and a summary of the counts
+ * (see sct_stats_format) is read from here; only one call in the
+ * number given to REQUEST_SET_SAMPLING is also recorded as an event.
+ * REQUEST_RESET_STATS starts the counts over, and frees the room kept
+ * for each (system call, pid) pair, which pids that have exited keep
+ * until then.
+ */
+#define STATS_DEVICE_NAME               "sctstats"
+#define STATS_DEVICE                    "/dev/" STATS_DEVICE_NAME
+
 #ifdef __KERNEL__
 
-asmlinkage long my_syscall(int cmd, int syscall, int pid);
+asmlinkage long my_syscall(int cmd, int syscall, unsigned long arg);
 
+/* The text form of an event, see sct_event_format */
 #define log_message(pid, syscall, arg1, arg2, arg3, arg4, arg5, arg6) \
 	printk(KERN_DEBUG "[%x]%lx(%lx,%lx,%lx,%lx,%lx,%lx)\n", pid, \
 		syscall, \
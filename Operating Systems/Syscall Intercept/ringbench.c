@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "evring.h"
+
+/*
+ * Producer/consumer benchmark of the event buffer, built against the
+ * user-space build of the core.
+ *
+ * For 1, 2, 4, ... up to -t producer threads, each producer records -n
+ * events into a ring of its own, as each CPU does in the module, while
+ * one consumer drains them -b at a time. impl=locked instead puts all
+ * producers on one ring behind a mutex. Each run prints one line of
+ * key=value pairs; ok=no means an event was lost without being counted
+ * as dropped, or a producer's events were read out of order.
+ *
+ * Producers that find their ring full drop the event, as in the module.
+ * With -l they yield and try again instead, so that every event reaches
+ * the consumer and consumed_per_sec is the rate of the whole pipeline;
+ * dropped then counts the retries.
+ */
+
+static struct sct_evbuf buf;
+static pthread_mutex_t buf_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nevents, batch, ring_size, locked, lossless;
+
+/* producers still recording */
+static int producing;
+
+struct producer {
+	pthread_t thread;
+	int id;
+};
+
+struct consumer {
+	pthread_t thread;
+	long consumed, out_of_order;
+
+	/* next sequence number expected from each producer */
+	unsigned long *next_seq;
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int record(struct producer *p, unsigned long args[6]) {
+	int ret;
+
+	if (!locked)
+		return sct_evbuf_record(&buf, p->id, p->id, 1, args);
+	pthread_mutex_lock(&buf_lock);
+	ret = sct_evbuf_record(&buf, 0, p->id, 1, args);
+	pthread_mutex_unlock(&buf_lock);
+	return ret;
+}
+
+static void *producer(void *arg) {
+	struct producer *p = arg;
+	unsigned long args[6] = { 0 };
+	int i;
+
+	for (i = 0; i < nevents; i++) {
+		args[0] = i;
+		while (record(p, args) != 0 && lossless)
+			sched_yield();
+	}
+	__atomic_sub_fetch(&producing, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static int drain(struct sct_event *out) {
+	int n;
+
+	if (!locked)
+		return sct_evbuf_drain(&buf, out, batch);
+	pthread_mutex_lock(&buf_lock);
+	n = sct_evbuf_drain(&buf, out, batch);
+	pthread_mutex_unlock(&buf_lock);
+	return n;
+}
+
+static void *consumer(void *arg) {
+	struct consumer *c = arg;
+	struct sct_event *out = malloc(batch * sizeof(struct sct_event));
+	int i, n, done;
+
+	if (out == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	do {
+		// read producing first, so nothing recorded before it hit 0 is missed
+		done = __atomic_load_n(&producing, __ATOMIC_ACQUIRE) == 0;
+		while ((n = drain(out)) > 0) {
+			for (i = 0; i < n; i++) {
+				// events are dropped, never reordered
+				if (out[i].args[0] < c->next_seq[out[i].pid])
+					c->out_of_order++;
+				c->next_seq[out[i].pid] = out[i].args[0] + 1;
+			}
+			c->consumed += n;
+		}
+		if (!done)
+			sched_yield();
+	} while (!done);
+
+	free(out);
+	return NULL;
+}
+
+static int run(int n) {
+	struct producer *producers = calloc(n, sizeof(struct producer));
+	struct consumer c = { 0 };
+	double start, elapsed;
+	long produced = (long) n * nevents;
+	unsigned long dropped;
+	int i, ok;
+
+	c.next_seq = calloc(n, sizeof(unsigned long));
+	if (producers == NULL || c.next_seq == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	if (sct_evbuf_init(&buf, locked ? 1 : n, ring_size) != 0) {
+		fprintf(stderr, "sct_evbuf_init failed\n");
+		exit(1);
+	}
+
+	producing = n;
+	start = now();
+	if (pthread_create(&c.thread, NULL, consumer, &c)) {
+		perror("pthread_create");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		producers[i].id = i;
+		if (pthread_create(&producers[i].thread, NULL, producer, &producers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(producers[i].thread, NULL);
+	pthread_join(c.thread, NULL);
+	elapsed = now() - start;
+
+	dropped = sct_evbuf_dropped(&buf);
+	if (lossless)
+		ok = c.consumed == produced && c.out_of_order == 0;
+	else
+		ok = c.consumed + (long) dropped == produced && c.out_of_order == 0;
+	printf("impl=%s mode=%s producers=%d batch=%d ring=%d events=%ld seconds=%.3f events_per_sec=%.0f consumed=%ld consumed_per_sec=%.0f dropped=%lu ok=%s\n",
+		locked ? "locked" : "percpu", lossless ? "lossless" : "lossy", n, batch, ring_size,
+		produced, elapsed, produced / elapsed, c.consumed, c.consumed / elapsed,
+		dropped, ok ? "yes" : "no");
+
+	sct_evbuf_destroy(&buf);
+	free(producers);
+	free(c.next_seq);
+	return ok;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-n events_per_producer] [-t max_producers] [-b batch] [-s ring_size] [-l]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int max_producers = 8, n, opt, ok = 1;
+
+	nevents = 1000000;
+	batch = 64;
+	ring_size = 4096;
+	while ((opt = getopt(argc, argv, "n:t:b:s:l")) != -1) {
+		switch (opt) {
+		case 'n':
+			nevents = atoi(optarg);
+			break;
+		case 't':
+			max_producers = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 's':
+			ring_size = atoi(optarg);
+			break;
+		case 'l':
+			lossless = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nevents <= 0 || max_producers <= 0 || batch <= 0 || ring_size <= 0) {
+		usage(argv[0]);
+	}
+
+	for (n = 1; n <= max_producers; n *= 2) {
+		locked = 0;
+		ok &= run(n);
+		locked = 1;
+		ok &= run(n);
+	}
+	return ok ? 0 : 1;
+}
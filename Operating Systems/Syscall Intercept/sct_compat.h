@@ -0,0 +1,220 @@
+#ifndef _SCT_COMPAT_H
+#define _SCT_COMPAT_H
+
+/*
+ * The few kernel facilities the syscall table core (sctable.c) needs,
+ * mapped onto the kernel when built into the module and onto libc and
+ * pthreads when built as the user-space library.
+ *
+ * Readers of RCU protected data use sct_rcu_read_lock/unlock and
+ * sct_rcu_dereference; writers publish with sct_rcu_assign and free
+ * what readers may still see with sct_call_rcu.
+ *
+ * The module targets 32-bit x86 Linux 4.0 to 4.3: the kernel side
+ * below needs WRITE_ONCE (4.0), and interceptor reads the arguments
+ * from the pt_regs frame the assembly entry code leaves on the stack,
+ * which 4.4 replaced with C.
+ */
+
+#ifdef __KERNEL__
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/cache.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/ktime.h>
+
+#define SCT_CACHE_LINE		SMP_CACHE_BYTES
+
+/* called with spinlocks held, so never sleep */
+#define sct_alloc(size)		kmalloc(size, GFP_ATOMIC)
+#define sct_zalloc(size)	kzalloc(size, GFP_ATOMIC)
+#define sct_free(p)		kfree(p)
+
+/* large buffers, allocated outside of any lock */
+#define sct_vzalloc(size)	vzalloc(size)
+#define sct_vfree(p)		vfree(p)
+
+typedef spinlock_t sct_lock_t;
+#define sct_lock_init(l)	spin_lock_init(l)
+#define sct_lock(l)		spin_lock(l)
+#define sct_unlock(l)		spin_unlock(l)
+
+/* sleeping reader-writer lock */
+typedef struct rw_semaphore sct_rwsem_t;
+#define sct_rwsem_init(l)	init_rwsem(l)
+#define sct_down_read(l)	down_read(l)
+#define sct_up_read(l)		up_read(l)
+#define sct_down_write(l)	down_write(l)
+#define sct_up_write(l)		up_write(l)
+
+typedef seqcount_t sct_seq_t;
+#define sct_seq_init(s)			seqcount_init(s)
+#define sct_read_seqbegin(s)		read_seqcount_begin(s)
+#define sct_read_seqretry(s, start)	read_seqcount_retry(s, start)
+#define sct_write_seqbegin(s)		write_seqcount_begin(s)
+#define sct_write_seqend(s)		write_seqcount_end(s)
+
+#define SCT_READ_ONCE(x)	READ_ONCE(x)
+#define SCT_WRITE_ONCE(x, v)	WRITE_ONCE(x, v)
+#define sct_load_acquire(p)	smp_load_acquire(p)
+#define sct_store_release(p, v)	smp_store_release(p, v)
+
+/* global and monotonic, as a call may end on another cpu than it began */
+#define sct_clock_ns()		ktime_get_ns()
+#define sct_div64(a, b)		div64_u64(a, b)
+#define sct_fls64(x)		fls64(x)
+
+#define sct_rcu_head		rcu_head
+#define sct_rcu_read_lock()	rcu_read_lock()
+#define sct_rcu_read_unlock()	rcu_read_unlock()
+#define sct_rcu_dereference(p)	rcu_dereference(p)
+#define sct_rcu_assign(p, v)	rcu_assign_pointer(p, v)
+#define sct_call_rcu(head, fn)	call_rcu(head, fn)
+#define sct_synchronize_rcu()	synchronize_rcu()
+#define sct_rcu_barrier()	rcu_barrier()
+
+#else /* user space */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define sct_alloc(size)		malloc(size)
+#define sct_zalloc(size)	calloc(1, size)
+#define sct_free(p)		free(p)
+
+#define SCT_CACHE_LINE		64
+
+/* large buffers, cache line aligned */
+static inline void *sct_vzalloc(size_t size) {
+	size_t aligned = (size + SCT_CACHE_LINE - 1) & ~(size_t) (SCT_CACHE_LINE - 1);
+	void *p = aligned_alloc(SCT_CACHE_LINE, aligned);
+
+	if (p)
+		memset(p, 0, aligned);
+	return p;
+}
+#define sct_vfree(p)		free(p)
+
+typedef pthread_mutex_t sct_lock_t;
+#define sct_lock_init(l)	pthread_mutex_init(l, NULL)
+#define sct_lock(l)		pthread_mutex_lock(l)
+#define sct_unlock(l)		pthread_mutex_unlock(l)
+
+typedef pthread_rwlock_t sct_rwsem_t;
+#define sct_rwsem_init(l)	pthread_rwlock_init(l, NULL)
+#define sct_down_read(l)	pthread_rwlock_rdlock(l)
+#define sct_up_read(l)		pthread_rwlock_unlock(l)
+#define sct_down_write(l)	pthread_rwlock_wrlock(l)
+#define sct_up_write(l)		pthread_rwlock_unlock(l)
+
+/*
+ * A fence of the given order. ThreadSanitizer does not model fences
+ * (gcc warns under -fsanitize=thread), so there a seq_cst
+ * read-modify-write of one word, defined in sct_urcu.c, stands in: of
+ * two of them one reads what the other wrote and so synchronizes with
+ * it, which orders at least what the fences would. Every thread then
+ * contends on that word, which only matters to the timings of a
+ * sanitizer build.
+ */
+#ifdef __SANITIZE_THREAD__
+extern int sct_fence_word;
+#define sct_fence(order)	((void) __atomic_fetch_add(&sct_fence_word, 0, __ATOMIC_SEQ_CST))
+#else
+#define sct_fence(order)	__atomic_thread_fence(order)
+#endif
+
+/*
+ * Sequence counter: odd while a writer, which must hold a lock, is
+ * changing what it protects. A reader retries if the count was odd or
+ * changed while it read.
+ */
+typedef struct {
+	unsigned int seq;
+} sct_seq_t;
+
+static inline void sct_seq_init(sct_seq_t *s) {
+	s->seq = 0;
+}
+
+static inline unsigned int sct_read_seqbegin(sct_seq_t *s) {
+	unsigned int seq;
+
+	while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1)
+		sched_yield();
+	return seq;
+}
+
+static inline int sct_read_seqretry(sct_seq_t *s, unsigned int start) {
+	sct_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void sct_write_seqbegin(sct_seq_t *s) {
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	sct_fence(__ATOMIC_RELEASE);
+}
+
+static inline void sct_write_seqend(sct_seq_t *s) {
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+#define SCT_READ_ONCE(x)	__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SCT_WRITE_ONCE(x, v)	__atomic_store_n(&(x), v, __ATOMIC_RELAXED)
+#define sct_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define sct_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static inline unsigned long long sct_clock_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define sct_div64(a, b)		((a) / (b))
+
+/* 1 + the index of the highest bit set, 0 if none */
+static inline int sct_fls64(unsigned long long x) {
+	return x == 0 ? 0 : 64 - __builtin_clzll(x);
+}
+
+/*
+ * Minimal RCU for user space, see sct_urcu.c: readers announce
+ * themselves in a per-thread word and never block; sct_call_rcu waits
+ * for a grace period and then runs the callback. Waiting instead of
+ * deferring is fine here, writers are rare and may sleep.
+ */
+struct sct_rcu_head {
+	struct sct_rcu_head *next;
+};
+
+void sct_rcu_read_lock(void);
+void sct_rcu_read_unlock(void);
+void sct_synchronize_rcu(void);
+
+#define sct_rcu_dereference(p)	__atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define sct_rcu_assign(p, v)	__atomic_store_n(&(p), v, __ATOMIC_RELEASE)
+#define sct_call_rcu(head, fn)	do { sct_synchronize_rcu(); (fn)(head); } while (0)
+#define sct_rcu_barrier()	do { } while (0)
+
+#define container_of(ptr, type, member) \
+	((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#endif /* __KERNEL__ */
+
+#endif /* _SCT_COMPAT_H */
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "sct_compat.h"
+
+/*
+ * User-space stand-in for the kernel's RCU, for the user-space build of
+ * the syscall table core. Every thread that enters a read-side section
+ * gets a record holding the grace period it entered in; a writer starts
+ * a new grace period and waits for every record from an older one to
+ * leave. Read-side sections may nest.
+ */
+
+/* one per thread that has ever entered a read-side section; never freed */
+struct urcu_reader {
+	/* 2 * grace period + 1 while inside a read-side section, else 0 */
+	unsigned long state __attribute__((aligned(SCT_CACHE_LINE)));
+	int depth;
+	struct urcu_reader *next;
+};
+
+static unsigned long grace_period = 1;
+static struct urcu_reader *readers;
+
+static __thread struct urcu_reader *my_reader;
+
+#ifdef __SANITIZE_THREAD__
+/* what sct_fence writes to instead of fencing, see sct_compat.h */
+int sct_fence_word;
+#endif
+
+static struct urcu_reader *get_reader(void) {
+	struct urcu_reader *r;
+
+	if (my_reader != NULL) {
+		return my_reader;
+	}
+	if ((r = aligned_alloc(SCT_CACHE_LINE, sizeof(struct urcu_reader))) == NULL) {
+		perror("aligned_alloc");
+		exit(1);
+	}
+	r->state = 0;
+	r->depth = 0;
+
+	r->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&readers, &r->next, r, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	return my_reader = r;
+}
+
+void sct_rcu_read_lock(void) {
+	struct urcu_reader *r = get_reader();
+	unsigned long gp;
+
+	if (r->depth++ > 0) {
+		return;
+	}
+	gp = __atomic_load_n(&grace_period, __ATOMIC_RELAXED);
+	__atomic_store_n(&r->state, 2 * gp + 1, __ATOMIC_RELAXED);
+	// pairs with the fence in sct_synchronize_rcu
+	sct_fence(__ATOMIC_SEQ_CST);
+}
+
+void sct_rcu_read_unlock(void) {
+	if (--my_reader->depth == 0) {
+		__atomic_store_n(&my_reader->state, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * Wait until every read-side section that began before the call has
+ * ended. Must not be called from inside one.
+ */
+void sct_synchronize_rcu(void) {
+	struct urcu_reader *r;
+	unsigned long gp, state;
+
+	sct_fence(__ATOMIC_SEQ_CST);
+	gp = __atomic_add_fetch(&grace_period, 1, __ATOMIC_SEQ_CST);
+
+	for (r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		while ((state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE)) != 0 &&
+			state / 2 < gp) {
+			sched_yield();
+		}
+	}
+}
@@ -0,0 +1,959 @@
+#include "sctable.h"
+
+/*
+ * Pid sets are changed in place where that is safe for a concurrent
+ * lookup: a pid is added by storing it into a free slot, and removed by
+ * overwriting its slot with a tombstone, so a lookup never stops early
+ * at a slot that was occupied when the pid it looks for was added.
+ * Anything else (growing, shrinking, dropping tombstones) builds a new
+ * set, publishes it with sct_rcu_assign and frees the old one after a
+ * grace period.
+ */
+
+#define PIDSET_MIN_SLOTS	8
+
+#define SLOT_EMPTY		0
+#define SLOT_TOMBSTONE		((pid_t) -1)
+
+#define INDEX_MIN_BUCKETS	64
+#define SCT_LONG_BITS		(8 * sizeof(unsigned long))
+
+static unsigned int pid_hash(pid_t pid) {
+	unsigned int h = (unsigned int) pid * 2654435761U;
+	return h ^ (h >> 16);
+}
+
+static struct pidset *pidset_alloc(unsigned int slots) {
+	struct pidset *set = sct_zalloc(sizeof(struct pidset) + slots * sizeof(pid_t));
+
+	if (set)
+		set->mask = slots - 1;
+	return set;
+}
+
+static void pidset_free_rcu(struct sct_rcu_head *head) {
+	sct_free(container_of(head, struct pidset, rcu));
+}
+
+/**
+ * Returns 1 if pid is in set, 0 otherwise. Safe against concurrent
+ * changes when called inside an RCU read-side section.
+ */
+static int pidset_contains(struct pidset *set, pid_t pid) {
+	unsigned int i = pid_hash(pid) & set->mask;
+	pid_t slot;
+
+	while ((slot = SCT_READ_ONCE(set->slots[i])) != SLOT_EMPTY) {
+		if (slot == pid)
+			return 1;
+		i = (i + 1) & set->mask;
+	}
+	return 0;
+}
+
+/* Insert a pid known not to be in set, which must have a free slot */
+static void pidset_put(struct pidset *set, pid_t pid) {
+	unsigned int i = pid_hash(pid) & set->mask;
+	int tomb = -1;
+
+	for (; set->slots[i] != SLOT_EMPTY; i = (i + 1) & set->mask) {
+		if (set->slots[i] == SLOT_TOMBSTONE && tomb < 0)
+			tomb = i;
+	}
+	if (tomb >= 0) {
+		i = tomb;
+	} else {
+		set->used++;
+	}
+	SCT_WRITE_ONCE(set->slots[i], pid);
+	set->count++;
+}
+
+/**
+ * Replace e's pid set by a copy without tombstones, sized for count pids
+ * to fill at most a quarter of it. Returns -ENOMEM if out of memory, in
+ * which case e is unchanged.
+ */
+static int pidset_rebuild(struct sct_entry *e, unsigned int count) {
+	struct pidset *old = e->pids, *set;
+	unsigned int slots = PIDSET_MIN_SLOTS, i;
+
+	while (slots < count * 4)
+		slots *= 2;
+	if ((set = pidset_alloc(slots)) == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i <= old->mask; i++) {
+		if (old->slots[i] != SLOT_EMPTY && old->slots[i] != SLOT_TOMBSTONE)
+			pidset_put(set, old->slots[i]);
+	}
+	sct_rcu_assign(e->pids, set);
+	sct_call_rcu(&old->rcu, pidset_free_rcu);
+	return 0;
+}
+
+/**
+ * Add a pid to e's set of pids. Returns -ENOMEM if the set had to grow
+ * and there is no memory for it.
+ */
+static int pidset_add(struct sct_entry *e, pid_t pid) {
+	struct pidset *set = e->pids;
+
+	if (pidset_contains(set, pid))
+		return 0;
+
+	// keep at least half the slots empty, so lookups stay short
+	if ((set->used + 1) * 2 > set->mask + 1) {
+		if (pidset_rebuild(e, set->count + 1) != 0)
+			return -ENOMEM;
+		set = e->pids;
+	}
+	pidset_put(set, pid);
+	return 0;
+}
+
+/**
+ * Remove a pid from e's set of pids.
+ * Returns -EINVAL if no such pid was found in the set.
+ */
+static int pidset_del(struct sct_entry *e, pid_t pid) {
+	struct pidset *set = e->pids;
+	unsigned int i = pid_hash(pid) & set->mask;
+
+	for (; set->slots[i] != pid; i = (i + 1) & set->mask) {
+		if (set->slots[i] == SLOT_EMPTY)
+			return -EINVAL;
+	}
+	SCT_WRITE_ONCE(set->slots[i], SLOT_TOMBSTONE);
+	set->count--;
+
+	// give back the memory of a set that has mostly emptied, unless a
+	// batch counts on it; if that fails, the larger set simply stays
+	if (!e->reserved && set->mask + 1 > PIDSET_MIN_SLOTS && set->count * 8 < set->mask + 1)
+		pidset_rebuild(e, set->count);
+	return 0;
+}
+
+/**
+ * Clear e's set of pids, and stop monitoring.
+ */
+static void pidset_clear(struct sct_entry *e) {
+	struct pidset *set = e->pids, *empty;
+	unsigned int i;
+
+	if (!e->reserved && set->mask + 1 > PIDSET_MIN_SLOTS &&
+		(empty = pidset_alloc(PIDSET_MIN_SLOTS)) != NULL) {
+		sct_rcu_assign(e->pids, empty);
+		sct_call_rcu(&set->rcu, pidset_free_rcu);
+	} else {
+		// a lookup racing with this may still see some of the pids,
+		// which is no different from it running just before the clear
+		for (i = 0; i <= set->mask; i++)
+			SCT_WRITE_ONCE(set->slots[i], SLOT_EMPTY);
+		set->count = set->used = 0;
+	}
+	SCT_WRITE_ONCE(e->monitored, 0);
+}
+
+/**
+ * Make room in e's set of pids for extra more pids, so that adding them
+ * needs no memory. Returns -ENOMEM if out of memory.
+ */
+static int pidset_reserve(struct sct_entry *e, unsigned int extra) {
+	struct pidset *set = e->pids;
+
+	if ((set->used + extra) * 2 <= set->mask + 1)
+		return 0;
+	return pidset_rebuild(e, set->count + extra);
+}
+
+//----- Reverse index from pids to system calls ---------------
+/**
+ * Every pid in some system call's pid set has a pid_rec in its shard of
+ * the index, with a bit set for each such system call. Only writers use
+ * it, under the shard's lock, which they take while holding the lock of
+ * the entry whose set they change.
+ */
+
+static struct pid_index *index_shard(struct sctable *t, pid_t pid) {
+	return &t->index[(pid_hash(pid) >> 24) % SCT_INDEX_SHARDS];
+}
+
+static struct pid_rec **index_bucket(struct pid_index *idx, pid_t pid) {
+	return &idx->buckets[pid_hash(pid) & (idx->nbuckets - 1)];
+}
+
+/* Returns the link pointing to pid's record, or to NULL if it has none */
+static struct pid_rec **index_find(struct pid_index *idx, pid_t pid) {
+	struct pid_rec **link = index_bucket(idx, pid);
+
+	while (*link != NULL && (*link)->pid != pid)
+		link = &(*link)->next;
+	return link;
+}
+
+/* Double the number of buckets; if out of memory, chains just get longer */
+static void index_grow(struct pid_index *idx) {
+	struct pid_rec **old = idx->buckets, *rec, *next, **link;
+	unsigned int n = idx->nbuckets, i;
+
+	if ((idx->buckets = sct_zalloc(2 * n * sizeof(struct pid_rec *))) == NULL) {
+		idx->buckets = old;
+		return;
+	}
+	idx->nbuckets = 2 * n;
+	for (i = 0; i < n; i++) {
+		for (rec = old[i]; rec != NULL; rec = next) {
+			next = rec->next;
+			link = index_bucket(idx, rec->pid);
+			rec->next = *link;
+			*link = rec;
+		}
+	}
+	sct_free(old);
+}
+
+static struct pid_rec *alloc_rec(struct sctable *t) {
+	return sct_zalloc(sizeof(struct pid_rec) + t->bitmap_longs * sizeof(unsigned long));
+}
+
+/**
+ * Record that the pid set of syscall holds pid. A new record is taken
+ * from the list spare, if there is one.
+ * Returns -ENOMEM if out of memory.
+ */
+static int index_set(struct sctable *t, int syscall, pid_t pid, struct pid_rec **spare) {
+	struct pid_index *idx = index_shard(t, pid);
+	unsigned long bit = 1UL << (syscall % SCT_LONG_BITS);
+	struct pid_rec **link, *rec;
+	int ret = 0;
+
+	sct_lock(&idx->lock);
+	link = index_find(idx, pid);
+	if ((rec = *link) == NULL) {
+		if (spare != NULL && *spare != NULL) {
+			rec = *spare;
+			*spare = rec->next;
+		} else {
+			rec = alloc_rec(t);
+		}
+		if (rec == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		rec->pid = pid;
+		rec->next = *link;
+		*link = rec;
+		if (++idx->npids > idx->nbuckets)
+			index_grow(idx);
+	}
+	if (!(rec->syscalls[syscall / SCT_LONG_BITS] & bit)) {
+		rec->syscalls[syscall / SCT_LONG_BITS] |= bit;
+		rec->count++;
+	}
+out:
+	sct_unlock(&idx->lock);
+	return ret;
+}
+
+/* Record that the pid set of syscall no longer holds pid */
+static void index_clear(struct sctable *t, int syscall, pid_t pid) {
+	struct pid_index *idx = index_shard(t, pid);
+	unsigned long bit = 1UL << (syscall % SCT_LONG_BITS);
+	struct pid_rec **link, *rec;
+
+	sct_lock(&idx->lock);
+	link = index_find(idx, pid);
+	rec = *link;
+	if (rec != NULL && (rec->syscalls[syscall / SCT_LONG_BITS] & bit)) {
+		rec->syscalls[syscall / SCT_LONG_BITS] &= ~bit;
+		if (--rec->count == 0) {
+			*link = rec->next;
+			idx->npids--;
+			sct_free(rec);
+		}
+	}
+	sct_unlock(&idx->lock);
+}
+
+/* Unlink and return pid's record, or NULL if it has none */
+static struct pid_rec *index_take(struct sctable *t, pid_t pid) {
+	struct pid_index *idx = index_shard(t, pid);
+	struct pid_rec **link, *rec;
+
+	sct_lock(&idx->lock);
+	link = index_find(idx, pid);
+	if ((rec = *link) != NULL) {
+		*link = rec->next;
+		idx->npids--;
+	}
+	sct_unlock(&idx->lock);
+	return rec;
+}
+//-------------------------------------------------------------
+
+/*
+ * Changes to the pid set of an entry, kept in step with the index.
+ * The caller holds the entry's lock.
+ */
+
+static int entry_add_pid(struct sctable *t, int syscall, pid_t pid, struct pid_rec **spare) {
+	int ret;
+
+	if ((ret = index_set(t, syscall, pid, spare)) != 0)
+		return ret;
+	if ((ret = pidset_add(&t->entries[syscall], pid)) != 0)
+		index_clear(t, syscall, pid);
+	return ret;
+}
+
+static int entry_del_pid(struct sctable *t, int syscall, pid_t pid) {
+	int ret;
+
+	if ((ret = pidset_del(&t->entries[syscall], pid)) == 0)
+		index_clear(t, syscall, pid);
+	return ret;
+}
+
+static void entry_clear(struct sctable *t, int syscall) {
+	struct pidset *set = t->entries[syscall].pids;
+	unsigned int i;
+
+	for (i = 0; i <= set->mask; i++) {
+		if (set->slots[i] != SLOT_EMPTY && set->slots[i] != SLOT_TOMBSTONE)
+			index_clear(t, syscall, set->slots[i]);
+	}
+	pidset_clear(&t->entries[syscall]);
+}
+
+/*
+ * An entry is changed between entry_lock and entry_unlock, which also
+ * make lookups that overlap the change retry.
+ */
+
+static void entry_lock(struct sct_entry *e) {
+	sct_lock(&e->lock);
+	sct_write_seqbegin(&e->seq);
+}
+
+static void entry_unlock(struct sct_entry *e) {
+	sct_write_seqend(&e->seq);
+	sct_unlock(&e->lock);
+}
+
+static struct sct_entry *get_entry(struct sctable *t, int syscall) {
+	if (syscall < 0 || syscall >= t->nr)
+		return NULL;
+	return &t->entries[syscall];
+}
+
+static void free_index(struct sctable *t, int shards) {
+	struct pid_rec *rec, *next;
+	unsigned int i;
+	int k;
+
+	for (k = 0; k < shards; k++) {
+		for (i = 0; i < t->index[k].nbuckets; i++) {
+			for (rec = t->index[k].buckets[i]; rec != NULL; rec = next) {
+				next = rec->next;
+				sct_free(rec);
+			}
+		}
+		sct_free(t->index[k].buckets);
+	}
+}
+
+/**
+ * Set up an empty table for system calls 0 to nr - 1. Sleeps in the
+ * kernel. Returns -ENOMEM if out of memory.
+ */
+int sct_init(struct sctable *t, int nr) {
+	struct pid_index *idx;
+	int s, k;
+
+	t->nr = nr;
+	sct_rwsem_init(&t->batch_lock);
+	t->bitmap_longs = (nr + SCT_LONG_BITS - 1) / SCT_LONG_BITS;
+	for (k = 0; k < SCT_INDEX_SHARDS; k++) {
+		idx = &t->index[k];
+		sct_lock_init(&idx->lock);
+		idx->nbuckets = INDEX_MIN_BUCKETS;
+		idx->npids = 0;
+		if ((idx->buckets = sct_zalloc(idx->nbuckets * sizeof(struct pid_rec *))) == NULL) {
+			free_index(t, k);
+			return -ENOMEM;
+		}
+	}
+
+	// entries are cache line aligned, so their locks don't share lines
+	if ((t->entries = sct_vzalloc(nr * sizeof(struct sct_entry))) == NULL) {
+		free_index(t, SCT_INDEX_SHARDS);
+		return -ENOMEM;
+	}
+	for (s = 0; s < nr; s++) {
+		sct_lock_init(&t->entries[s].lock);
+		sct_seq_init(&t->entries[s].seq);
+		if ((t->entries[s].pids = pidset_alloc(PIDSET_MIN_SLOTS)) == NULL) {
+			while (--s >= 0)
+				sct_free(t->entries[s].pids);
+			sct_vfree(t->entries);
+			free_index(t, SCT_INDEX_SHARDS);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Free the table. Nothing may call into it any more, but lookups
+ * started before may still be running.
+ */
+void sct_destroy(struct sctable *t) {
+	int s;
+
+	free_index(t, SCT_INDEX_SHARDS);
+
+	sct_synchronize_rcu();
+	for (s = 0; s < t->nr; s++)
+		sct_free(t->entries[s].pids);
+	sct_vfree(t->entries);
+
+	// wait for the sets that are still queued to be freed
+	sct_rcu_barrier();
+}
+
+/**
+ * Returns 1 if the call of syscall by pid should be logged, 0 otherwise.
+ * Takes no lock.
+ */
+int sct_should_log(struct sctable *t, int syscall, pid_t pid) {
+	struct sct_entry *e = get_entry(t, syscall);
+	unsigned int seq;
+	int monitored, in;
+
+	if (e == NULL)
+		return 0;
+
+	do {
+		seq = sct_read_seqbegin(&e->seq);
+		in = 0;
+		if ((monitored = SCT_READ_ONCE(e->monitored)) != 0) {
+			sct_rcu_read_lock();
+			in = pidset_contains(sct_rcu_dereference(e->pids), pid);
+			sct_rcu_read_unlock();
+		}
+	} while (sct_read_seqretry(&e->seq, seq));
+
+	if (monitored == 0)
+		return 0;
+	return monitored == 1 ? in : !in;
+}
+
+/**
+ * Returns 1 if syscall is intercepted, 0 otherwise.
+ */
+int sct_is_intercepted(struct sctable *t, int syscall) {
+	struct sct_entry *e = get_entry(t, syscall);
+
+	return e != NULL && SCT_READ_ONCE(e->intercepted);
+}
+
+/**
+ * Mark syscall as intercepted.
+ * Returns -EBUSY if it already is.
+ */
+int sct_intercept(struct sctable *t, int syscall) {
+	struct sct_entry *e = get_entry(t, syscall);
+	int ret = 0;
+
+	if (e == NULL)
+		return -EINVAL;
+
+	sct_down_read(&t->batch_lock);
+	entry_lock(e);
+	if (e->intercepted)
+		ret = -EBUSY;
+	else
+		SCT_WRITE_ONCE(e->intercepted, 1);
+	entry_unlock(e);
+	sct_up_read(&t->batch_lock);
+	return ret;
+}
+
+/**
+ * Mark syscall as no longer intercepted.
+ * Returns -EINVAL if it was not intercepted.
+ */
+int sct_release(struct sctable *t, int syscall) {
+	struct sct_entry *e = get_entry(t, syscall);
+	int ret = 0;
+
+	if (e == NULL)
+		return -EINVAL;
+
+	sct_down_read(&t->batch_lock);
+	entry_lock(e);
+	if (!e->intercepted)
+		ret = -EINVAL;
+	else
+		SCT_WRITE_ONCE(e->intercepted, 0);
+	entry_unlock(e);
+	sct_up_read(&t->batch_lock);
+	return ret;
+}
+
+/*
+ * Start and stop monitoring, with the entry's lock held.
+ */
+
+static int entry_start(struct sctable *t, int syscall, pid_t pid, struct pid_rec **spare) {
+	struct sct_entry *e = &t->entries[syscall];
+	int in = pid != 0 && pidset_contains(e->pids, pid), ret;
+
+	if (!e->intercepted)
+		return -EINVAL;
+	if ((e->monitored == 1 && in) || (e->monitored == 2 && !in))
+		return -EBUSY;
+
+	if (pid == 0) {
+		// clear the blacklist, and start monitoring all pids
+		entry_clear(t, syscall);
+		SCT_WRITE_ONCE(e->monitored, 2);
+	} else if (e->monitored == 2) {
+		// blacklist removal for pid to start monitoring
+		entry_del_pid(t, syscall, pid);
+	} else {
+		if ((ret = entry_add_pid(t, syscall, pid, spare)) != 0)
+			return ret;
+		SCT_WRITE_ONCE(e->monitored, 1);
+	}
+	return 0;
+}
+
+static int entry_stop(struct sctable *t, int syscall, pid_t pid, struct pid_rec **spare) {
+	struct sct_entry *e = &t->entries[syscall];
+	int in = pid != 0 && pidset_contains(e->pids, pid);
+
+	if (!e->intercepted || e->monitored == 0 ||
+		(e->monitored == 1 && !in) || (e->monitored == 2 && in))
+		return -EINVAL;
+
+	if (pid == 0) {
+		// stop monitoring all pids for syscall
+		entry_clear(t, syscall);
+	} else if (e->monitored == 2) {
+		// blacklist addition for pid to stop monitoring
+		return entry_add_pid(t, syscall, pid, spare);
+	} else {
+		entry_del_pid(t, syscall, pid);
+		if (e->pids->count == 0)
+			SCT_WRITE_ONCE(e->monitored, 0);
+	}
+	return 0;
+}
+
+/**
+ * Start monitoring pid for syscall, or all pids if pid is 0.
+ * Returns -EINVAL if syscall is not intercepted, -EBUSY if pid is
+ * already monitored and -ENOMEM if out of memory.
+ */
+int sct_start_monitoring(struct sctable *t, int syscall, pid_t pid) {
+	struct sct_entry *e = get_entry(t, syscall);
+	int ret;
+
+	if (e == NULL || pid < 0)
+		return -EINVAL;
+
+	sct_down_read(&t->batch_lock);
+	entry_lock(e);
+	ret = entry_start(t, syscall, pid, NULL);
+	entry_unlock(e);
+	sct_up_read(&t->batch_lock);
+	return ret;
+}
+
+/**
+ * Stop monitoring pid for syscall, or all pids if pid is 0.
+ * Returns -EINVAL if syscall is not intercepted or pid is not monitored,
+ * and -ENOMEM if out of memory.
+ */
+int sct_stop_monitoring(struct sctable *t, int syscall, pid_t pid) {
+	struct sct_entry *e = get_entry(t, syscall);
+	int ret;
+
+	if (e == NULL || pid < 0)
+		return -EINVAL;
+
+	sct_down_read(&t->batch_lock);
+	entry_lock(e);
+	ret = entry_stop(t, syscall, pid, NULL);
+	entry_unlock(e);
+	sct_up_read(&t->batch_lock);
+	return ret;
+}
+
+/**
+ * Remove an exiting pid from the pid sets of all system calls. Only the
+ * sets the index says hold it are touched, each under its own lock.
+ * Returns -1 if it was in none of them.
+ */
+int sct_exit_pid(struct sctable *t, pid_t pid) {
+	struct pid_rec *rec;
+	struct sct_entry *e;
+	unsigned long bits;
+	int w, s;
+
+	sct_down_read(&t->batch_lock);
+	if ((rec = index_take(t, pid)) == NULL) {
+		sct_up_read(&t->batch_lock);
+		return -1;
+	}
+
+	for (w = 0; w < t->bitmap_longs; w++) {
+		for (bits = rec->syscalls[w]; bits != 0; bits &= bits - 1) {
+			s = w * SCT_LONG_BITS + __builtin_ctzl(bits);
+			e = &t->entries[s];
+
+			entry_lock(e);
+			// the pid may have been added again since its record was
+			// taken, in which case the new record has this bit too
+			entry_del_pid(t, s, pid);
+			// stop the monitoring only if it's not for all pids
+			if (e->pids->count == 0 && e->monitored == 1)
+				SCT_WRITE_ONCE(e->monitored, 0);
+			entry_unlock(e);
+		}
+	}
+	sct_up_read(&t->batch_lock);
+
+	sct_free(rec);
+	return 0;
+}
+
+//----- Batches of commands -----------------------------------
+/**
+ * A batch is checked in full before anything is changed: with the batch
+ * lock held for writing, so no other change is under way, each command
+ * is played against a shadow of the entries it touches, so the outcome
+ * of every command is known up front. Room for every pid the batch may
+ * add is then made in the pid sets and the index, with no entry lock
+ * held, after which applying the commands cannot fail. They are applied
+ * one entry at a time, each under its own lock.
+ */
+
+/* The state of an entry as the batch has left it so far */
+struct shadow_entry {
+	int syscall;
+	int monitored;
+
+	/* the pid set was cleared; pids not in pairs are not in it */
+	int cleared;
+
+	/* bumped when the set is cleared, to void the entry's pairs */
+	int gen;
+
+	unsigned int count;
+
+	/* pids the batch may add to the set */
+	unsigned int adds;
+
+	/* the first and last command for the entry, linked through next */
+	int first, last;
+};
+
+/* Whether the batch has left a pid in an entry's set */
+struct shadow_pair {
+	int syscall;
+	pid_t pid;
+	int gen;
+	int in;
+	int used;
+};
+
+/*
+ * Everything but t sits in one allocation sized by the batch, never by
+ * the table, and only the entries the batch touches are walked
+ */
+struct shadow {
+	struct sctable *t;
+
+	/* one per system call touched, in order of first command */
+	struct shadow_entry *entries;
+	int nentries;
+
+	/* hash of syscall to 1 + index in entries, 0 if free, and of pairs;
+	   both have mask + 1 slots */
+	int *slots;
+	struct shadow_pair *pairs;
+	unsigned int mask;
+
+	/* the next command for the same entry, or -1 */
+	int *next;
+
+	/* pids the batch may add to any set, each needing an index record */
+	unsigned int adds;
+};
+
+/* The shadow entry of syscall, added if the batch had not touched it */
+static struct shadow_entry *shadow_entry(struct shadow *sh, int syscall) {
+	unsigned int i = (syscall * 2654435761U) & sh->mask;
+	struct shadow_entry *se;
+
+	for (; sh->slots[i] != 0; i = (i + 1) & sh->mask) {
+		if (sh->entries[sh->slots[i] - 1].syscall == syscall)
+			return &sh->entries[sh->slots[i] - 1];
+	}
+	se = &sh->entries[sh->nentries++];
+	se->syscall = syscall;
+	sh->slots[i] = sh->nentries;
+	return se;
+}
+
+static struct shadow_pair *shadow_pair(struct shadow *sh, int syscall, pid_t pid) {
+	unsigned int i = (pid_hash(pid) ^ (syscall * 2654435761U)) & sh->mask;
+
+	for (; sh->pairs[i].used; i = (i + 1) & sh->mask) {
+		if (sh->pairs[i].syscall == syscall && sh->pairs[i].pid == pid)
+			return &sh->pairs[i];
+	}
+	sh->pairs[i].used = 1;
+	sh->pairs[i].syscall = syscall;
+	sh->pairs[i].pid = pid;
+	sh->pairs[i].gen = -1;
+	return &sh->pairs[i];
+}
+
+static int shadow_in(struct shadow *sh, struct shadow_entry *se, pid_t pid) {
+	struct shadow_pair *pair;
+
+	if (pid == 0)
+		return 0;
+	pair = shadow_pair(sh, se->syscall, pid);
+	if (pair->gen == se->gen)
+		return pair->in;
+	return !se->cleared && pidset_contains(sh->t->entries[se->syscall].pids, pid);
+}
+
+static void shadow_set(struct shadow *sh, struct shadow_entry *se, pid_t pid, int in) {
+	struct shadow_pair *pair = shadow_pair(sh, se->syscall, pid);
+
+	pair->gen = se->gen;
+	pair->in = in;
+	if (in) {
+		se->count++;
+		se->adds++;
+		sh->adds++;
+	} else {
+		se->count--;
+	}
+}
+
+static void shadow_clear(struct shadow_entry *se) {
+	se->cleared = 1;
+	se->gen++;
+	se->count = 0;
+}
+
+/**
+ * Play one command against the shadow, as entry_start or entry_stop
+ * would carry it out. Returns what they would return, short of -ENOMEM.
+ */
+static int shadow_play(struct shadow *sh, const struct sct_request *req) {
+	struct shadow_entry *se = shadow_entry(sh, req->syscall);
+	int in = shadow_in(sh, se, req->pid);
+
+	if (!sh->t->entries[req->syscall].intercepted)
+		return -EINVAL;
+
+	if (req->cmd == REQUEST_START_MONITORING) {
+		if ((se->monitored == 1 && in) || (se->monitored == 2 && !in))
+			return -EBUSY;
+		if (req->pid == 0) {
+			shadow_clear(se);
+			se->monitored = 2;
+		} else if (se->monitored == 2) {
+			shadow_set(sh, se, req->pid, 0);
+		} else {
+			shadow_set(sh, se, req->pid, 1);
+			se->monitored = 1;
+		}
+	} else {
+		if (se->monitored == 0 || (se->monitored == 1 && !in) || (se->monitored == 2 && in))
+			return -EINVAL;
+		if (req->pid == 0) {
+			shadow_clear(se);
+			se->monitored = 0;
+		} else if (se->monitored == 2) {
+			shadow_set(sh, se, req->pid, 1);
+		} else {
+			shadow_set(sh, se, req->pid, 0);
+			if (se->count == 0)
+				se->monitored = 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Carry out the n commands in reqs, in order, or none of them. Each
+ * entry they touch is changed under its lock once for the whole batch,
+ * so lookups see either none or all of the batch's changes to it.
+ * Sleeps in the kernel. Returns 0, or what the first failing command
+ * would have returned on its own (storing it in the command's ret, and
+ * its index in *failed), or -ENOMEM if out of memory.
+ */
+int sct_apply_batch(struct sctable *t, struct sct_request *reqs, int n, int *failed) {
+	struct shadow sh = { t, NULL, 0, NULL, NULL, 0, NULL, 0 };
+	struct pid_rec *spare = NULL, *rec;
+	struct shadow_entry *se;
+	struct sct_entry *e;
+	int ret = 0, i, k;
+	unsigned int pairs = 2;
+	void *mem;
+
+	*failed = -1;
+	for (i = 0; i < n; i++) {
+		if ((reqs[i].cmd != REQUEST_START_MONITORING && reqs[i].cmd != REQUEST_STOP_MONITORING) ||
+			get_entry(t, reqs[i].syscall) == NULL || reqs[i].pid < 0) {
+			*failed = i;
+			reqs[i].ret = -EINVAL;
+			return -EINVAL;
+		}
+	}
+	if (n == 0)
+		return 0;
+
+	while (pairs < 2 * (unsigned int) n)
+		pairs *= 2;
+	sh.mask = pairs - 1;
+	mem = sct_vzalloc(pairs * (sizeof(struct shadow_pair) + sizeof(int)) +
+		n * (sizeof(struct shadow_entry) + sizeof(int)));
+	if (mem == NULL)
+		return -ENOMEM;
+	sh.pairs = mem;
+	sh.entries = (struct shadow_entry *) (sh.pairs + pairs);
+	sh.slots = (int *) (sh.entries + n);
+	sh.next = sh.slots + pairs;
+
+	// one shadow entry per system call touched, with its commands in order
+	for (i = 0; i < n; i++) {
+		k = sh.nentries;
+		se = shadow_entry(&sh, reqs[i].syscall);
+		if (k != sh.nentries)
+			se->first = i;
+		else
+			sh.next[se->last] = i;
+		se->last = i;
+		sh.next[i] = -1;
+	}
+
+	sct_down_write(&t->batch_lock);
+	for (k = 0; k < sh.nentries; k++) {
+		se = &sh.entries[k];
+		se->monitored = t->entries[se->syscall].monitored;
+		se->count = t->entries[se->syscall].pids->count;
+	}
+	for (i = 0; i < n; i++) {
+		if ((ret = shadow_play(&sh, &reqs[i])) != 0) {
+			*failed = i;
+			reqs[i].ret = ret;
+			goto unlock;
+		}
+	}
+
+	// one spare index record for each pid that may be added, and a set
+	// that grows is replaced by a larger copy of itself, which lookups
+	// may see at any time
+	for (k = 0; k < (int) sh.adds; k++) {
+		if ((rec = alloc_rec(t)) == NULL) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		rec->next = spare;
+		spare = rec;
+	}
+	for (k = 0; k < sh.nentries; k++) {
+		se = &sh.entries[k];
+		if ((ret = pidset_reserve(&t->entries[se->syscall], se->adds)) != 0)
+			goto unlock;
+	}
+
+	// nothing can fail from here on
+	for (k = 0; k < sh.nentries; k++) {
+		se = &sh.entries[k];
+		e = &t->entries[se->syscall];
+		entry_lock(e);
+		e->reserved = 1;
+		for (i = se->first; i >= 0; i = sh.next[i]) {
+			if (reqs[i].cmd == REQUEST_START_MONITORING)
+				entry_start(t, se->syscall, reqs[i].pid, &spare);
+			else
+				entry_stop(t, se->syscall, reqs[i].pid, &spare);
+		}
+		e->reserved = 0;
+		entry_unlock(e);
+	}
+
+unlock:
+	sct_up_write(&t->batch_lock);
+	while ((rec = spare) != NULL) {
+		spare = rec->next;
+		sct_free(rec);
+	}
+	sct_vfree(mem);
+	return ret;
+}
+//-------------------------------------------------------------
+
+/**
+ * Check that the pid sets and the index agree with each other and with
+ * the monitored flags. Nothing may change the table meanwhile.
+ * Returns -EINVAL if they don't.
+ */
+int sct_check(struct sctable *t) {
+	struct sct_entry *e;
+	struct pid_rec *rec, **link;
+	struct pid_index *idx;
+	unsigned int i, count, bits = 0, npids = 0;
+	int s, k, w;
+	pid_t pid;
+
+	for (s = 0; s < t->nr; s++) {
+		e = &t->entries[s];
+		if ((e->monitored == 1) != (e->pids->count != 0 && e->monitored != 2))
+			return -EINVAL;
+
+		count = 0;
+		for (i = 0; i <= e->pids->mask; i++) {
+			pid = e->pids->slots[i];
+			if (pid == SLOT_EMPTY || pid == SLOT_TOMBSTONE)
+				continue;
+			// every pid in a set is found by a lookup, and in the index
+			link = index_find(index_shard(t, pid), pid);
+			if (!pidset_contains(e->pids, pid) || *link == NULL ||
+				!((*link)->syscalls[s / SCT_LONG_BITS] & (1UL << (s % SCT_LONG_BITS))))
+				return -EINVAL;
+			count++;
+		}
+		if (count != e->pids->count)
+			return -EINVAL;
+		bits += count;
+	}
+
+	// and the index holds nothing else
+	for (k = 0; k < SCT_INDEX_SHARDS; k++) {
+		idx = &t->index[k];
+		for (i = 0; i < idx->nbuckets; i++) {
+			for (rec = idx->buckets[i]; rec != NULL; rec = rec->next) {
+				for (w = 0, count = 0; w < t->bitmap_longs; w++)
+					count += __builtin_popcountl(rec->syscalls[w]);
+				if (count != rec->count || count == 0)
+					return -EINVAL;
+				bits -= count;
+				npids++;
+			}
+		}
+		npids -= idx->npids;
+	}
+	return bits == 0 && npids == 0 ? 0 : -EINVAL;
+}
@@ -0,0 +1,119 @@
+#ifndef _SCTABLE_H
+#define _SCTABLE_H
+
+#include "sct_compat.h"
+#include "interceptor.h"
+
+/*
+ * Bookkeeping of intercepted and monitored system calls, shared by the
+ * kernel module (interceptor.c) and the user-space library built from
+ * the same sources.
+ *
+ * Each system call has an entry saying whether it is intercepted and
+ * which pids are monitored for it:
+ *     monitored=0 => not monitored
+ *     monitored=1 => only the pids in the entry's set are monitored
+ *     monitored=2 => all pids are monitored, except those in the set
+ *
+ * sct_should_log is called on every intercepted system call and takes
+ * no lock; the pid sets are open addressing hash sets published with
+ * RCU, so a lookup is O(1) however many pids are monitored, and a
+ * sequence count per entry lets it retry rather than see an entry
+ * halfway through a change. All other calls change the table, each
+ * under the lock of the entry it changes, so that changes to different
+ * system calls don't contend. They return 0 or a negative errno, as
+ * my_syscall does.
+ *
+ * They also hold the table's batch lock for reading, and so may sleep
+ * in the kernel; a batch of commands holds it for writing, so that it
+ * is checked and applied with no other change under way, and needs no
+ * more than one entry lock at a time.
+ *
+ * The table also indexes the pid sets the other way round, from each
+ * pid to the system calls whose set holds it, so that an exiting pid is
+ * removed from those sets only instead of from every system call's.
+ * The index is split into shards by pid, each with a lock of its own,
+ * taken inside an entry lock.
+ */
+
+/* Open addressing hash set of pids, with linear probing */
+struct pidset {
+	struct sct_rcu_head rcu;
+
+	/* slots - 1; the number of slots is a power of 2 */
+	unsigned int mask;
+
+	/* pids in the set, and slots that are not empty (pids and tombstones) */
+	unsigned int count, used;
+
+	pid_t slots[];
+};
+
+struct sct_entry {
+	/* serializes changes to the entry */
+	sct_lock_t lock;
+
+	/* odd while monitored and pids are changed together */
+	sct_seq_t seq;
+
+	/* 1=intercepted, 0=not intercepted */
+	int intercepted;
+
+	/* see above */
+	int monitored;
+
+	/* never NULL between sct_init and sct_destroy */
+	struct pidset *pids;
+
+	/* set while a batch has made room in pids, which must not shrink */
+	int reserved;
+} __attribute__((aligned(SCT_CACHE_LINE)));
+
+/* The system calls whose pid set holds a pid */
+struct pid_rec {
+	pid_t pid;
+	struct pid_rec *next;
+
+	/* number of bits set in syscalls */
+	int count;
+	unsigned long syscalls[];
+};
+
+#define SCT_INDEX_SHARDS	16
+
+/* Chained hash table of the pids in any pid set, for one shard of pids */
+struct pid_index {
+	sct_lock_t lock;
+	struct pid_rec **buckets;
+	unsigned int nbuckets, npids;
+} __attribute__((aligned(SCT_CACHE_LINE)));
+
+struct sctable {
+	int nr;
+	struct sct_entry *entries;
+
+	/* written by batches, read by every other change; see above */
+	sct_rwsem_t batch_lock;
+
+	struct pid_index index[SCT_INDEX_SHARDS];
+
+	/* longs in a pid_rec's bitmap of system calls */
+	int bitmap_longs;
+};
+
+int sct_init(struct sctable *t, int nr);
+void sct_destroy(struct sctable *t);
+
+int sct_should_log(struct sctable *t, int syscall, pid_t pid);
+int sct_is_intercepted(struct sctable *t, int syscall);
+
+int sct_intercept(struct sctable *t, int syscall);
+int sct_release(struct sctable *t, int syscall);
+int sct_start_monitoring(struct sctable *t, int syscall, pid_t pid);
+int sct_stop_monitoring(struct sctable *t, int syscall, pid_t pid);
+int sct_exit_pid(struct sctable *t, pid_t pid);
+int sct_apply_batch(struct sctable *t, struct sct_request *reqs, int n, int *failed);
+
+int sct_check(struct sctable *t);
+
+#endif /* _SCTABLE_H */
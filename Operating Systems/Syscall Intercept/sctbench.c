@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "sctable.h"
+#include "rand.h"
+
+/*
+ * Benchmark of the check the interceptor makes on every intercepted
+ * system call, built against the user-space build of the table core.
+ *
+ * For 1, 4, 16, ... up to -p monitored pids, and 1, 2, 4, ... up to -t
+ * threads, the threads call sct_should_log for -d milliseconds, half of
+ * the time for a monitored pid and half of the time for one that is
+ * not. The same is then timed on a list of the monitored pids walked
+ * like check_pid_monitored used to. Each run prints one line of
+ * key=value pairs; ok=no means some lookup gave the wrong answer.
+ *
+ * With -w, a writer thread keeps starting and stopping the monitoring
+ * of other pids during the sct_should_log runs, which makes the pid set
+ * grow and shrink under the readers.
+ */
+
+#define SYSCALL		1
+#define NR_SYSCALLS	8
+
+/* pids that are never monitored, and those the writer churns */
+#define UNMONITORED_BASE	1000000
+#define CHURN_BASE		2000000
+#define CHURN_PIDS		256
+
+/* The pid list the pid sets replace */
+struct pid_list {
+	pid_t pid;
+	struct pid_list *next;
+};
+
+struct reader {
+	pthread_t thread;
+	unsigned int rng;
+	long lookups, hits, expected_hits;
+};
+
+static struct sctable table;
+static struct pid_list *list;
+static int npids, duration_ms, use_list;
+static int stop;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The i-th monitored pid */
+static pid_t monitored_pid(int i) {
+	return 100 + i * 7;
+}
+
+static int list_monitored(pid_t pid) {
+	struct pid_list *p;
+
+	for (p = list; p != NULL; p = p->next) {
+		if (p->pid == pid)
+			return 1;
+	}
+	return 0;
+}
+
+static void *reader(void *arg) {
+	struct reader *r = arg;
+	unsigned int x;
+	pid_t pid;
+	int in, i;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		// check stop only every so often
+		for (i = 0; i < 64; i++) {
+			x = rt_rand32(&r->rng);
+			in = x & 1;
+			pid = in ? monitored_pid((x >> 1) % npids) : UNMONITORED_BASE + (x >> 1) % 4096;
+			if (use_list ? list_monitored(pid) : sct_should_log(&table, SYSCALL, pid))
+				r->hits++;
+			r->expected_hits += in;
+		}
+		r->lookups += i;
+	}
+	return NULL;
+}
+
+/* Start and stop monitoring pids no reader looks up, until stop */
+static void *writer(void *arg) {
+	long *ops = arg;
+	int i;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		for (i = 0; i < CHURN_PIDS; i++) {
+			if (sct_start_monitoring(&table, SYSCALL, CHURN_BASE + i) != 0) {
+				fprintf(stderr, "sct_start_monitoring failed\n");
+				exit(1);
+			}
+		}
+		for (i = 0; i < CHURN_PIDS; i++) {
+			if (sct_stop_monitoring(&table, SYSCALL, CHURN_BASE + i) != 0) {
+				fprintf(stderr, "sct_stop_monitoring failed\n");
+				exit(1);
+			}
+		}
+		*ops += 2 * CHURN_PIDS;
+	}
+	return NULL;
+}
+
+static int run(int nthreads, int churn) {
+	struct reader *readers = calloc(nthreads, sizeof(struct reader));
+	pthread_t writer_thread;
+	long lookups = 0, hits = 0, expected_hits = 0, writes = 0;
+	double start, elapsed;
+	int i, ok;
+
+	if (readers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	stop = 0;
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		readers[i].rng = (i + 1) * 2654435761U | 1;
+		if (pthread_create(&readers[i].thread, NULL, reader, &readers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	if (churn && pthread_create(&writer_thread, NULL, writer, &writes)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	usleep(duration_ms * 1000);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(readers[i].thread, NULL);
+		lookups += readers[i].lookups;
+		hits += readers[i].hits;
+		expected_hits += readers[i].expected_hits;
+	}
+	if (churn)
+		pthread_join(writer_thread, NULL);
+	elapsed = now() - start;
+
+	ok = hits == expected_hits;
+	printf("impl=%s pids=%d threads=%d writer=%s lookups=%ld seconds=%.3f lookups_per_sec=%.0f",
+		use_list ? "list" : "pidset", npids, nthreads, churn ? "yes" : "no",
+		lookups, elapsed, lookups / elapsed);
+	if (churn)
+		printf(" writes_per_sec=%.0f", writes / elapsed);
+	printf(" ok=%s\n", ok ? "yes" : "no");
+
+	free(readers);
+	return ok;
+}
+
+/* Monitor pids [0, n) for SYSCALL, in the table and in the list */
+static void setup(int n) {
+	struct pid_list *p;
+	int i;
+
+	for (i = npids; i < n; i++) {
+		if (sct_start_monitoring(&table, SYSCALL, monitored_pid(i)) != 0) {
+			fprintf(stderr, "sct_start_monitoring failed\n");
+			exit(1);
+		}
+		if ((p = malloc(sizeof(struct pid_list))) == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		p->pid = monitored_pid(i);
+		p->next = list;
+		list = p;
+	}
+	npids = n;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-p max_pids] [-t max_threads] [-d milliseconds] [-w]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int max_pids = 4096, max_threads = 8, churn = 0, n, nthreads, opt, ok = 1;
+
+	duration_ms = 200;
+	while ((opt = getopt(argc, argv, "p:t:d:w")) != -1) {
+		switch (opt) {
+		case 'p':
+			max_pids = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration_ms = atoi(optarg);
+			break;
+		case 'w':
+			churn = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_pids <= 0 || max_threads <= 0 || duration_ms <= 0) {
+		usage(argv[0]);
+	}
+
+	if (sct_init(&table, NR_SYSCALLS) != 0 || sct_intercept(&table, SYSCALL) != 0) {
+		fprintf(stderr, "sct_init failed\n");
+		exit(1);
+	}
+
+	for (n = 1; n <= max_pids; n *= 4) {
+		setup(n);
+		for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+			use_list = 0;
+			ok &= run(nthreads, churn);
+			use_list = 1;
+			ok &= run(nthreads, 0);
+		}
+	}
+
+	sct_destroy(&table);
+	return ok ? 0 : 1;
+}
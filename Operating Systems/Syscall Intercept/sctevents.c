@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "interceptor.h"
+#include "evring.h"
+
+/*
+ * Print the system calls the interceptor module records, one line per
+ * event in the format log_message used to print, as they are read from
+ * EVENT_DEVICE in batches. With -t each line starts with the event's
+ * timestamp in nanoseconds.
+ */
+
+#define READ_EVENTS 256
+
+int main(int argc, char *argv[]) {
+	struct sct_event events[READ_EVENTS];
+	char line[256];
+	ssize_t n;
+	int fd, i, timestamps = 0, opt;
+
+	while ((opt = getopt(argc, argv, "t")) != -1) {
+		if (opt != 't') {
+			printf("Usage: %s [-t]\n", argv[0]);
+			exit(1);
+		}
+		timestamps = 1;
+	}
+
+	if ((fd = open(EVENT_DEVICE, O_RDONLY)) == -1) {
+		perror("open");
+		exit(1);
+	}
+	while ((n = read(fd, events, sizeof(events))) > 0) {
+		for (i = 0; i < n / (ssize_t) sizeof(struct sct_event); i++) {
+			sct_event_format(&events[i], line, sizeof(line));
+			if (timestamps)
+				printf("%llu ", events[i].timestamp);
+			fputs(line, stdout);
+		}
+		fflush(stdout);
+	}
+	if (n == -1) {
+		perror("read");
+		exit(1);
+	}
+	close(fd);
+	return 0;
+}
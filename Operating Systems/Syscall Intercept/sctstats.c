@@ -0,0 +1,355 @@
+#include "sctstats.h"
+
+#ifndef __KERNEL__
+#include <stdio.h>
+#endif
+
+/**
+ * Set up counters for nr system calls on ncpus CPUs, each with room for
+ * pid_slots (rounded up to a power of 2) (system call, pid) pairs.
+ * Every call is sampled until sct_stats_set_sampling says otherwise.
+ * Sleeps in the kernel. Returns -ENOMEM if out of memory.
+ */
+int sct_stats_init(struct sct_stats *st, int nr, int ncpus, unsigned long pid_slots) {
+	struct sct_cpustats *c;
+	unsigned long slots = 2;
+	int i;
+
+	while (slots < pid_slots)
+		slots *= 2;
+
+	st->nr = nr;
+	st->ncpus = ncpus;
+	st->sample_every = 1;
+	if ((st->cpus = sct_zalloc(ncpus * sizeof(struct sct_cpustats *))) == NULL)
+		return -ENOMEM;
+
+	// one block per cpu: the counters, then the arrays they point to
+	for (i = 0; i < ncpus; i++) {
+		c = sct_vzalloc(sizeof(struct sct_cpustats) +
+			nr * (sizeof(unsigned long long) + (1 + SCT_LAT_BUCKETS) * sizeof(unsigned long)) +
+			slots * sizeof(struct sct_pidstat));
+		if (c == NULL) {
+			while (--i >= 0)
+				sct_vfree(st->cpus[i]);
+			sct_free(st->cpus);
+			return -ENOMEM;
+		}
+		c->mask = slots - 1;
+		c->ns = (unsigned long long *) (c + 1);
+		c->pids = (struct sct_pidstat *) (c->ns + nr);
+		c->calls = (unsigned long *) (c->pids + slots);
+		c->hist = c->calls + nr;
+		st->cpus[i] = c;
+	}
+	return 0;
+}
+
+void sct_stats_destroy(struct sct_stats *st) {
+	int i;
+
+	for (i = 0; i < st->ncpus; i++)
+		sct_vfree(st->cpus[i]);
+	sct_free(st->cpus);
+}
+
+/**
+ * Record one call in every calls as an event from now on; none if
+ * every is 0.
+ */
+void sct_stats_set_sampling(struct sct_stats *st, unsigned int every) {
+	SCT_WRITE_ONCE(st->sample_every, every);
+}
+
+/**
+ * Start all counters over from zero, and free every pid slot. Each cpu
+ * clears its own when it next counts a call, readers leave it out
+ * until then.
+ */
+void sct_stats_reset(struct sct_stats *st) {
+	SCT_WRITE_ONCE(st->reset, st->reset + 1);
+}
+
+/* Clear the counters of c, on its own cpu, if they predate the last reset */
+static void cpu_catch_up(struct sct_stats *st, struct sct_cpustats *c) {
+	unsigned long reset = SCT_READ_ONCE(st->reset), j;
+	int s;
+
+	if (c->reset == reset)
+		return;
+	for (j = 0; j <= c->mask; j++) {
+		SCT_WRITE_ONCE(c->pids[j].used, 0);
+		SCT_WRITE_ONCE(c->pids[j].calls, 0);
+		SCT_WRITE_ONCE(c->pids[j].ns, 0);
+	}
+	for (s = 0; s < st->nr; s++) {
+		SCT_WRITE_ONCE(c->calls[s], 0);
+		SCT_WRITE_ONCE(c->ns[s], 0);
+	}
+	for (j = 0; j < (unsigned long) st->nr * SCT_LAT_BUCKETS; j++)
+		SCT_WRITE_ONCE(c->hist[j], 0);
+	SCT_WRITE_ONCE(c->sampled, 0);
+	SCT_WRITE_ONCE(c->unattributed, 0);
+	SCT_WRITE_ONCE(c->npids, 0);
+	// readers that see the new reset must see the zeros
+	sct_store_release(&c->reset, reset);
+}
+
+/* The counters of cpu i for readers, or NULL if they predate the last reset */
+static struct sct_cpustats *cpu_stats(struct sct_stats *st, int i) {
+	struct sct_cpustats *c = st->cpus[i];
+
+	return sct_load_acquire(&c->reset) == SCT_READ_ONCE(st->reset) ? c : NULL;
+}
+
+/**
+ * Returns 1 if the call about to be made on this cpu is to be recorded
+ * as an event, 0 otherwise. Only called on its own cpu.
+ */
+int sct_stats_sample(struct sct_stats *st, int cpu) {
+	struct sct_cpustats *c = st->cpus[cpu];
+	unsigned long every = SCT_READ_ONCE(st->sample_every), left = c->until_sample;
+
+	cpu_catch_up(st, c);
+	if (every == 0)
+		return 0;
+	// left is more than every if sampling was made more frequent since
+	if (left > 1 && left <= every) {
+		c->until_sample = left - 1;
+		return 0;
+	}
+	c->until_sample = every;
+	SCT_WRITE_ONCE(c->sampled, c->sampled + 1);
+	return 1;
+}
+
+static unsigned long pid_hash(int syscall, int pid) {
+	return (unsigned long) pid * 2654435761UL ^ (unsigned long) syscall * 40503UL;
+}
+
+/*
+ * The slot of (syscall, pid) in pids, or the free slot it would take,
+ * or NULL if neither is found.
+ */
+static struct sct_pidstat *pid_slot(struct sct_pidstat *pids, unsigned long mask,
+	int syscall, int pid) {
+	struct sct_pidstat *ps;
+	unsigned long i, h = pid_hash(syscall, pid);
+
+	for (i = 0; i <= mask; i++) {
+		ps = &pids[(h + i) & mask];
+		if (!sct_load_acquire(&ps->used) || (ps->syscall == syscall && ps->pid == pid))
+			return ps;
+	}
+	return NULL;
+}
+
+static int lat_bucket(unsigned long long ns) {
+	int b = sct_fls64(ns);
+
+	return b < SCT_LAT_BUCKETS ? b : SCT_LAT_BUCKETS - 1;
+}
+
+/**
+ * Count a call of pid to syscall, on this cpu, that took ns. Only
+ * called on its own cpu. Once 3/4 of the pid slots are taken, calls of
+ * pairs not seen before are only counted per system call.
+ */
+void sct_stats_account(struct sct_stats *st, int cpu, int syscall, int pid,
+	unsigned long long ns) {
+	struct sct_cpustats *c = st->cpus[cpu];
+	struct sct_pidstat *ps;
+	unsigned long *h = &c->hist[syscall * SCT_LAT_BUCKETS + lat_bucket(ns)];
+
+	cpu_catch_up(st, c);
+	SCT_WRITE_ONCE(c->calls[syscall], c->calls[syscall] + 1);
+	SCT_WRITE_ONCE(c->ns[syscall], c->ns[syscall] + ns);
+	SCT_WRITE_ONCE(*h, *h + 1);
+
+	ps = pid_slot(c->pids, c->mask, syscall, pid);
+	if (ps != NULL && !ps->used) {
+		if (c->npids >= (c->mask + 1) / 4 * 3) {
+			ps = NULL;
+		} else {
+			ps->syscall = syscall;
+			ps->pid = pid;
+			// readers must see who the slot is for before they see it used
+			sct_store_release(&ps->used, 1);
+			SCT_WRITE_ONCE(c->npids, c->npids + 1);
+		}
+	}
+	if (ps == NULL) {
+		SCT_WRITE_ONCE(c->unattributed, c->unattributed + 1);
+		return;
+	}
+	SCT_WRITE_ONCE(ps->calls, ps->calls + 1);
+	SCT_WRITE_ONCE(ps->ns, ps->ns + ns);
+}
+
+/**
+ * Returns the number of calls counted for syscall, over all cpus.
+ */
+unsigned long sct_stats_calls(struct sct_stats *st, int syscall) {
+	struct sct_cpustats *c;
+	unsigned long calls = 0;
+	int i;
+
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) != NULL)
+			calls += SCT_READ_ONCE(c->calls[syscall]);
+	}
+	return calls;
+}
+
+/**
+ * Returns the number of calls of pid counted for syscall, over all
+ * cpus; calls it made while a cpu's pid slots were full are not among
+ * them.
+ */
+unsigned long sct_stats_pid_calls(struct sct_stats *st, int syscall, int pid) {
+	struct sct_cpustats *c;
+	struct sct_pidstat *ps;
+	unsigned long calls = 0;
+	int i;
+
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) == NULL)
+			continue;
+		ps = pid_slot(c->pids, c->mask, syscall, pid);
+		if (ps != NULL && sct_load_acquire(&ps->used))
+			calls += SCT_READ_ONCE(ps->calls);
+	}
+	return calls;
+}
+
+/**
+ * Returns the number of calls sampled, over all cpus.
+ */
+unsigned long sct_stats_sampled(struct sct_stats *st) {
+	struct sct_cpustats *c;
+	unsigned long sampled = 0;
+	int i;
+
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) != NULL)
+			sampled += SCT_READ_ONCE(c->sampled);
+	}
+	return sampled;
+}
+
+/**
+ * Returns the number of calls not counted per pid, over all cpus.
+ */
+unsigned long sct_stats_unattributed(struct sct_stats *st) {
+	struct sct_cpustats *c;
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) != NULL)
+			n += SCT_READ_ONCE(c->unattributed);
+	}
+	return n;
+}
+
+/* Upper bound of the latency of pct percent of the calls in hist */
+static unsigned long long lat_percentile(const unsigned long *hist,
+	unsigned long calls, int pct) {
+	unsigned long long want = ((unsigned long long) calls * pct + 99) / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < SCT_LAT_BUCKETS - 1; b++) {
+		seen += hist[b];
+		if (seen >= want)
+			break;
+	}
+	return b == 0 ? 0 : 1ULL << b;
+}
+
+// append to str as snprintf would, counting what does not fit
+#define APPEND(...) \
+	(len += snprintf(len < size ? str + len : NULL, len < size ? size - len : 0, __VA_ARGS__))
+
+/**
+ * Write a summary of the counters into str, one line of key=value pairs
+ * for all calls, then one per system call and one per (system call,
+ * pid) called. Returns its length (or the length it would have, as
+ * snprintf does), or -ENOMEM if out of memory. Sleeps in the kernel.
+ */
+int sct_stats_format(struct sct_stats *st, char *str, int size) {
+	struct sct_cpustats *c;
+	struct sct_pidstat *merged = NULL, *ps, *m;
+	unsigned long *hist = NULL, calls, total = 0, slots = 2, mask, j, npids = 0;
+	unsigned long long ns;
+	int len = 0, i, s, b;
+
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) != NULL)
+			npids += SCT_READ_ONCE(c->npids);
+	}
+	// room for pairs counted while we read, too
+	while (slots < 2 * npids + 64)
+		slots *= 2;
+	mask = slots - 1;
+	hist = sct_vzalloc(SCT_LAT_BUCKETS * sizeof(unsigned long));
+	merged = sct_vzalloc(slots * sizeof(struct sct_pidstat));
+	if (hist == NULL || merged == NULL) {
+		len = -ENOMEM;
+		goto out;
+	}
+
+	for (s = 0; s < st->nr; s++)
+		total += sct_stats_calls(st, s);
+	APPEND("sample_every=%u calls=%lu sampled=%lu unattributed=%lu\n",
+		SCT_READ_ONCE(st->sample_every), total, sct_stats_sampled(st),
+		sct_stats_unattributed(st));
+
+	for (s = 0; s < st->nr; s++) {
+		calls = 0;
+		ns = 0;
+		for (b = 0; b < SCT_LAT_BUCKETS; b++)
+			hist[b] = 0;
+		for (i = 0; i < st->ncpus; i++) {
+			if ((c = cpu_stats(st, i)) == NULL)
+				continue;
+			calls += SCT_READ_ONCE(c->calls[s]);
+			ns += SCT_READ_ONCE(c->ns[s]);
+			for (b = 0; b < SCT_LAT_BUCKETS; b++)
+				hist[b] += SCT_READ_ONCE(c->hist[s * SCT_LAT_BUCKETS + b]);
+		}
+		if (calls == 0)
+			continue;
+		APPEND("syscall=%d calls=%lu mean_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu\n",
+			s, calls, sct_div64(ns, calls), lat_percentile(hist, calls, 50),
+			lat_percentile(hist, calls, 90), lat_percentile(hist, calls, 99));
+	}
+
+	// add up each pair over all cpus, then print them
+	for (i = 0; i < st->ncpus; i++) {
+		if ((c = cpu_stats(st, i)) == NULL)
+			continue;
+		for (j = 0; j <= c->mask; j++) {
+			ps = &c->pids[j];
+			if (!sct_load_acquire(&ps->used))
+				continue;
+			if ((m = pid_slot(merged, mask, ps->syscall, ps->pid)) == NULL)
+				break;
+			m->used = 1;
+			m->syscall = ps->syscall;
+			m->pid = ps->pid;
+			m->calls += SCT_READ_ONCE(ps->calls);
+			m->ns += SCT_READ_ONCE(ps->ns);
+		}
+	}
+	for (j = 0; j <= mask; j++) {
+		m = &merged[j];
+		if (m->used && m->calls != 0)
+			APPEND("syscall=%d pid=%d calls=%lu mean_ns=%llu\n",
+				m->syscall, m->pid, m->calls, sct_div64(m->ns, m->calls));
+	}
+
+out:
+	sct_vfree(hist);
+	sct_vfree(merged);
+	return len;
+}
@@ -0,0 +1,93 @@
+#ifndef _SCTSTATS_H
+#define _SCTSTATS_H
+
+#include "sct_compat.h"
+
+/*
+ * Aggregate counters of monitored system calls, shared by the kernel
+ * module and the user-space library.
+ *
+ * Every monitored call is counted, per system call and per (system
+ * call, pid), and its latency goes into a histogram of its system call;
+ * only one in sample_every calls is also recorded as a full event.
+ * Each CPU (each thread in user space) counts into its own struct
+ * sct_cpustats, with preemption disabled in the kernel, so counting
+ * takes no lock and shares no cache line. Readers add the CPUs up on
+ * demand; they may see a call counted on one counter and not yet on
+ * another, which is fine for statistics.
+ *
+ * The (system call, pid) slots are never given back one by one, so
+ * pids that have exited keep theirs until sct_stats_reset. That only
+ * bumps a count; each CPU clears its own counters the next time it
+ * counts a call, and until then readers leave it out.
+ */
+
+/*
+ * Latency buckets: bucket 0 counts calls that took no time, bucket b
+ * those that took [2^(b-1), 2^b) ns, the last one also all that took
+ * longer.
+ */
+#define SCT_LAT_BUCKETS		32
+
+/* Calls of one pid to one system call, on one CPU */
+struct sct_pidstat {
+	/* set, with release, once syscall and pid are */
+	int used;
+	int syscall;
+	int pid;
+	unsigned long calls;
+	unsigned long long ns;
+};
+
+struct sct_cpustats {
+	/* the sct_stats reset the counters date from */
+	unsigned long reset;
+
+	/* calls left until the next sampled one */
+	unsigned long until_sample;
+	unsigned long sampled;
+
+	/* calls not counted per pid because pids was full */
+	unsigned long unattributed;
+
+	/* slots of pids in use, and their number - 1 (a power of 2) */
+	unsigned long npids;
+	unsigned long mask;
+
+	/* per system call */
+	unsigned long long *ns;
+	unsigned long *calls;
+	unsigned long *hist;
+
+	struct sct_pidstat *pids;
+} __attribute__((aligned(SCT_CACHE_LINE)));
+
+struct sct_stats {
+	int nr;
+	int ncpus;
+
+	/* record one call in this many as an event, none if 0 */
+	unsigned int sample_every;
+
+	/* bumped by every sct_stats_reset */
+	unsigned long reset;
+
+	struct sct_cpustats **cpus;
+};
+
+int sct_stats_init(struct sct_stats *st, int nr, int ncpus, unsigned long pid_slots);
+void sct_stats_destroy(struct sct_stats *st);
+
+void sct_stats_set_sampling(struct sct_stats *st, unsigned int every);
+void sct_stats_reset(struct sct_stats *st);
+int sct_stats_sample(struct sct_stats *st, int cpu);
+void sct_stats_account(struct sct_stats *st, int cpu, int syscall, int pid,
+	unsigned long long ns);
+
+unsigned long sct_stats_calls(struct sct_stats *st, int syscall);
+unsigned long sct_stats_pid_calls(struct sct_stats *st, int syscall, int pid);
+unsigned long sct_stats_sampled(struct sct_stats *st);
+unsigned long sct_stats_unattributed(struct sct_stats *st);
+int sct_stats_format(struct sct_stats *st, char *str, int size);
+
+#endif /* _SCTSTATS_H */
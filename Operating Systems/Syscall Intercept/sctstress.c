@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "sctable.h"
+#include "rand.h"
+
+/*
+ * Randomized multithreaded stress and throughput run of the table core,
+ * built against the user-space build of the core.
+ *
+ * In the model phase, each of 1, 2, 4, ... up to -t writer threads owns
+ * -p pids (few, so that pid sets keep emptying) and starts monitoring,
+ * stops monitoring and exits them at random, for random system calls
+ * out of -s, -n times. As no one else
+ * touches its pids, each writer knows what every call must return and
+ * counts the calls that return something else. Meanwhile -r reader
+ * threads call sct_should_log for pids monitored from the start for
+ * every even system call (which must always be logged) and for pids
+ * never monitored (which must never be). Once all are done, the table
+ * must hold exactly what the writers expect and pass sct_check.
+ *
+ * In the chaos phase the writers also intercept and release system
+ * calls and start and stop monitoring of all pids, with pids shared by
+ * all writers, so only sct_check is left to judge the outcome.
+ *
+ * Each run prints one line of key=value pairs; ok=no on any error.
+ */
+
+#define PINNED_PIDS	8
+#define PINNED_BASE	10
+#define NEVER_BASE	900000
+#define WRITER_BASE	1000
+
+static struct sctable table;
+static int nr, npids, nops, nreaders, chaos;
+static int stop;
+
+struct writer {
+	pthread_t thread;
+	int id;
+	unsigned int rng;
+	long errors;
+
+	/* model: state[s * npids + i] is 1 if pid i is monitored for s */
+	char *state;
+};
+
+struct reader {
+	pthread_t thread;
+	unsigned int rng;
+	long lookups, errors;
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t writer_pid(int w, int i) {
+	return WRITER_BASE + w * npids + i;
+}
+
+/* One random start, stop or exit of one of w's own pids, checked against w's model */
+static void model_op(struct writer *w) {
+	unsigned int x = rt_rand32(&w->rng);
+	int s = x % nr, i = (x >> 8) % npids, op = (x >> 24) % 20, ret, expect, k;
+	pid_t pid = writer_pid(w->id, i);
+	char *st = &w->state[s * npids + i];
+
+	if (op < 9) {
+		ret = sct_start_monitoring(&table, s, pid);
+		expect = *st ? -EBUSY : 0;
+		*st = 1;
+	} else if (op < 18) {
+		ret = sct_stop_monitoring(&table, s, pid);
+		expect = *st ? 0 : -EINVAL;
+		*st = 0;
+	} else {
+		ret = sct_exit_pid(&table, pid);
+		expect = -1;
+		for (k = 0; k < nr; k++) {
+			if (w->state[k * npids + i])
+				expect = 0;
+			w->state[k * npids + i] = 0;
+		}
+	}
+	if (ret != expect)
+		w->errors++;
+}
+
+/* One random call of any kind, on pids shared by all writers */
+static void chaos_op(struct writer *w) {
+	unsigned int x = rt_rand32(&w->rng);
+	int s = x % nr, op = (x >> 24) % 16;
+	pid_t pid = (x >> 8) % 16 == 0 ? 0 : writer_pid(0, (x >> 12) % npids);
+
+	switch (op) {
+	case 0:
+		sct_intercept(&table, s);
+		break;
+	case 1:
+		sct_release(&table, s);
+		break;
+	case 2:
+		sct_exit_pid(&table, pid);
+		break;
+	default:
+		if (op & 1)
+			sct_start_monitoring(&table, s, pid);
+		else
+			sct_stop_monitoring(&table, s, pid);
+	}
+}
+
+static void *writer(void *arg) {
+	struct writer *w = arg;
+	int i;
+
+	for (i = 0; i < nops; i++) {
+		if (chaos)
+			chaos_op(w);
+		else
+			model_op(w);
+	}
+	return NULL;
+}
+
+static void *reader(void *arg) {
+	struct reader *r = arg;
+	unsigned int x;
+	int s, logged;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		x = rt_rand32(&r->rng);
+		s = x % nr;
+		if (x & (1 << 20)) {
+			logged = sct_should_log(&table, s, NEVER_BASE + (x >> 21) % 64);
+			if (!chaos && logged)
+				r->errors++;
+		} else {
+			logged = sct_should_log(&table, s, PINNED_BASE + (x >> 21) % PINNED_PIDS);
+			if (!chaos && logged != (s % 2 == 0))
+				r->errors++;
+		}
+		r->lookups++;
+	}
+	return NULL;
+}
+
+/* Returns the number of (syscall, pid) pairs the table and the models disagree on */
+static long compare_models(struct writer *writers, int nwriters) {
+	long errors = 0;
+	int w, s, i;
+
+	for (w = 0; w < nwriters; w++) {
+		for (s = 0; s < nr; s++) {
+			for (i = 0; i < npids; i++) {
+				if (sct_should_log(&table, s, writer_pid(w, i)) != writers[w].state[s * npids + i])
+					errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+static int run(int nwriters) {
+	struct writer *writers = calloc(nwriters, sizeof(struct writer));
+	struct reader *readers = calloc(nreaders + 1, sizeof(struct reader));
+	long errors = 0, lookups = 0;
+	double start, elapsed;
+	int i, s, checked, ok;
+
+	if (writers == NULL || readers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	if (sct_init(&table, nr) != 0) {
+		fprintf(stderr, "sct_init failed\n");
+		exit(1);
+	}
+	for (s = 0; s < nr; s++) {
+		sct_intercept(&table, s);
+		for (i = 0; s % 2 == 0 && i < PINNED_PIDS; i++)
+			sct_start_monitoring(&table, s, PINNED_BASE + i);
+	}
+
+	stop = 0;
+	start = now();
+	for (i = 0; i < nreaders; i++) {
+		readers[i].rng = (i + 1) * 2246822519U | 1;
+		if (pthread_create(&readers[i].thread, NULL, reader, &readers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nwriters; i++) {
+		writers[i].id = i;
+		writers[i].rng = (i + 1) * 2654435761U | 1;
+		if ((writers[i].state = calloc(nr * npids, 1)) == NULL) {
+			perror("calloc");
+			exit(1);
+		}
+		if (pthread_create(&writers[i].thread, NULL, writer, &writers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nwriters; i++) {
+		pthread_join(writers[i].thread, NULL);
+		errors += writers[i].errors;
+	}
+	elapsed = now() - start;
+
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < nreaders; i++) {
+		pthread_join(readers[i].thread, NULL);
+		errors += readers[i].errors;
+		lookups += readers[i].lookups;
+	}
+
+	if (!chaos)
+		errors += compare_models(writers, nwriters);
+	checked = sct_check(&table) == 0;
+	ok = errors == 0 && checked;
+	printf("phase=%s writers=%d readers=%d syscalls=%d ops=%ld seconds=%.3f ops_per_sec=%.0f lookups_per_sec=%.0f errors=%ld consistent=%s ok=%s\n",
+		chaos ? "chaos" : "model", nwriters, nreaders, nr, (long) nwriters * nops,
+		elapsed, nwriters * nops / elapsed, lookups / elapsed, errors,
+		checked ? "yes" : "no", ok ? "yes" : "no");
+
+	sct_destroy(&table);
+	for (i = 0; i < nwriters; i++)
+		free(writers[i].state);
+	free(writers);
+	free(readers);
+	return ok;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-t max_writers] [-r readers] [-s syscalls] [-p pids_per_writer] [-n ops_per_writer]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int max_writers = 8, n, opt, ok = 1;
+
+	nreaders = 2;
+	nr = 64;
+	npids = 8;
+	nops = 200000;
+	while ((opt = getopt(argc, argv, "t:r:s:p:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_writers = atoi(optarg);
+			break;
+		case 'r':
+			nreaders = atoi(optarg);
+			break;
+		case 's':
+			nr = atoi(optarg);
+			break;
+		case 'p':
+			npids = atoi(optarg);
+			break;
+		case 'n':
+			nops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_writers <= 0 || nreaders < 0 || nr <= 0 || npids <= 0 || nops <= 0) {
+		usage(argv[0]);
+	}
+
+	for (chaos = 0; chaos <= 1; chaos++) {
+		for (n = 1; n <= max_writers; n *= 2)
+			ok &= run(n);
+	}
+	return ok ? 0 : 1;
+}
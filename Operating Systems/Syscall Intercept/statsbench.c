@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "sctstats.h"
+#include "evring.h"
+#include "rand.h"
+
+/*
+ * Benchmark of the counters against recording every call, built
+ * against the user-space build of the core.
+ *
+ * For 1, 2, 4, ... up to -t threads, each standing in for a CPU, each
+ * thread makes -n monitored calls of a dummy system call, for random
+ * pids of its own (-p of them) and system calls (-s of them), while one
+ * consumer drains the event buffer as the device reader would, and
+ * now and then takes a summary of the counters as the stats device
+ * would:
+ *
+ *	impl=log	records every call as an event, as the module did
+ *			before it counted calls
+ *	impl=sample	times and counts every call and records one in -N
+ *	impl=count	times and counts every call and records none
+ *
+ * Each run prints one line of key=value pairs. ok=no means the counters
+ * do not match the calls made, replayed after the run, or the number
+ * of calls sampled is not one in -N, or the counters do not start
+ * over, with every pid slot free again, after sct_stats_reset. With -v the summary the stats
+ * device would show is printed after each run.
+ *
+ * Counting times each call with two sct_clock_ns calls; in user space
+ * these are clock_gettime calls, which are most of its cost.
+ */
+
+#define PID_BASE	1000
+
+enum impl { LOG, SAMPLE, COUNT };
+static const char *impl_names[] = { "log", "sample", "count" };
+
+static struct sct_stats stats;
+static struct sct_evbuf buf;
+static int nr, npids, ncalls, every, verbose;
+static unsigned long pid_slots;
+static enum impl impl;
+
+/* threads still calling */
+static int calling;
+
+struct caller {
+	pthread_t thread;
+	int id;
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int caller_seed(int id) {
+	return (id + 1) * 2654435761U | 1;
+}
+
+/* Stands in for the original system call */
+static __attribute__((noinline)) long dummy_syscall(const unsigned long args[6]) {
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		sum = sum * 31 + args[i];
+	return sum;
+}
+
+static void *caller(void *arg) {
+	struct caller *c = arg;
+	unsigned int rng = caller_seed(c->id);
+	unsigned long args[6] = { 0 };
+	unsigned long long start;
+	int i, s, pid;
+
+	for (i = 0; i < ncalls; i++) {
+		rt_rand32(&rng);
+		s = rng % nr;
+		pid = PID_BASE + c->id * npids + (rng >> 8) % npids;
+		args[0] = i;
+
+		if (impl == LOG || sct_stats_sample(&stats, c->id))
+			sct_evbuf_record(&buf, c->id, pid, s, args);
+		if (impl == LOG) {
+			dummy_syscall(args);
+			continue;
+		}
+		start = sct_clock_ns();
+		dummy_syscall(args);
+		sct_stats_account(&stats, c->id, s, pid, sct_clock_ns() - start);
+	}
+	__atomic_sub_fetch(&calling, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *consumer(void *arg) {
+	struct sct_event out[64];
+	unsigned long rounds = 0;
+	int done;
+
+	do {
+		done = __atomic_load_n(&calling, __ATOMIC_ACQUIRE) == 0;
+		while (sct_evbuf_drain(&buf, out, 64) > 0)
+			;
+		if (impl != LOG && ++rounds % 1024 == 0)
+			sct_stats_format(&stats, NULL, 0);
+		if (!done)
+			sched_yield();
+	} while (!done);
+	return NULL;
+}
+
+/* Returns 1 if the counters hold what n callers made */
+static int check_counts(int n) {
+	unsigned long *expect = calloc(nr * npids, sizeof(unsigned long));
+	unsigned long total = 0, attributed = 0, per_caller, got;
+	unsigned int rng;
+	int ok = 1, id, i, s, p, len;
+	char *text;
+
+	if (expect == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for (s = 0; s < nr; s++)
+		total += sct_stats_calls(&stats, s);
+	ok &= total == (unsigned long) n * ncalls;
+
+	// replay each caller's calls
+	for (id = 0; id < n; id++) {
+		rng = caller_seed(id);
+		for (i = 0; i < nr * npids; i++)
+			expect[i] = 0;
+		for (i = 0; i < ncalls; i++) {
+			rt_rand32(&rng);
+			expect[(rng % nr) * npids + (rng >> 8) % npids]++;
+		}
+		for (s = 0; s < nr; s++) {
+			for (p = 0; p < npids; p++) {
+				got = sct_stats_pid_calls(&stats, s, PID_BASE + id * npids + p);
+				// a pair may have been left out if its cpu ran out of slots
+				if (got != 0 || sct_stats_unattributed(&stats) == 0)
+					ok &= got == expect[s * npids + p];
+				attributed += got;
+			}
+		}
+	}
+	ok &= attributed + sct_stats_unattributed(&stats) == total;
+
+	per_caller = every == 0 || impl == COUNT ? 0 : (ncalls + every - 1) / every;
+	ok &= sct_stats_sampled(&stats) == n * per_caller;
+
+	// formatting into too small a buffer must tell how much was needed
+	len = sct_stats_format(&stats, NULL, 0);
+	if ((text = malloc(len + 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	ok &= sct_stats_format(&stats, text, len + 1) == len;
+	if (verbose)
+		fputs(text, stdout);
+
+	free(text);
+	free(expect);
+	return ok;
+}
+
+/*
+ * Reset the counters and check they read as zero, then that each cpu
+ * counts a pair it has not seen per pid again, full as its slots may
+ * have been. The callers are done, so we count for them.
+ */
+static int check_reset(int n) {
+	unsigned long total = 0;
+	int ok = 1, id, s;
+
+	sct_stats_reset(&stats);
+	for (s = 0; s < nr; s++)
+		total += sct_stats_calls(&stats, s);
+	ok &= total == 0 && sct_stats_sampled(&stats) == 0 && sct_stats_unattributed(&stats) == 0;
+
+	for (id = 0; id < n; id++)
+		sct_stats_account(&stats, id, 0, PID_BASE - 1 - id, 1);
+	for (id = 0; id < n; id++)
+		ok &= sct_stats_pid_calls(&stats, 0, PID_BASE - 1 - id) == 1;
+	ok &= sct_stats_calls(&stats, 0) == (unsigned long) n && sct_stats_unattributed(&stats) == 0;
+	return ok;
+}
+
+static int run(int n) {
+	struct caller *callers = calloc(n, sizeof(struct caller));
+	pthread_t reader;
+	double start, elapsed;
+	long calls = (long) n * ncalls;
+	int i, ok = 1;
+
+	if (callers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	if (sct_stats_init(&stats, nr, n, pid_slots) != 0 || sct_evbuf_init(&buf, n, 4096) != 0) {
+		fprintf(stderr, "init failed\n");
+		exit(1);
+	}
+	sct_stats_set_sampling(&stats, impl == COUNT ? 0 : every);
+
+	calling = n;
+	start = now();
+	if (pthread_create(&reader, NULL, consumer, NULL)) {
+		perror("pthread_create");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		callers[i].id = i;
+		if (pthread_create(&callers[i].thread, NULL, caller, &callers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(callers[i].thread, NULL);
+	pthread_join(reader, NULL);
+	elapsed = now() - start;
+
+	if (impl != LOG)
+		ok = check_counts(n);
+	printf("impl=%s threads=%d syscalls=%d pids=%d sample_every=%d calls=%ld seconds=%.3f calls_per_sec=%.0f ns_per_call=%.1f sampled=%lu unattributed=%lu dropped=%lu ok=%s\n",
+		impl_names[impl], n, nr, npids, impl == SAMPLE ? every : impl == LOG ? 1 : 0,
+		calls, elapsed, calls / elapsed, elapsed * 1e9 * n / calls,
+		impl == LOG ? (unsigned long) calls : sct_stats_sampled(&stats),
+		sct_stats_unattributed(&stats), sct_evbuf_dropped(&buf), ok ? "yes" : "no");
+	if (impl != LOG && !check_reset(n)) {
+		printf("impl=%s threads=%d reset=failed ok=no\n", impl_names[impl], n);
+		ok = 0;
+	}
+
+	sct_evbuf_destroy(&buf);
+	sct_stats_destroy(&stats);
+	free(callers);
+	return ok;
+}
+
+static void usage(char *prog) {
+	printf("Usage: %s [-n calls_per_thread] [-t max_threads] [-s syscalls] [-p pids_per_thread] [-N sample_every] [-k pid_slots] [-v]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int max_threads = 8, n, opt, ok = 1;
+
+	ncalls = 1000000;
+	nr = 64;
+	npids = 16;
+	every = 100;
+	pid_slots = 4096;
+	while ((opt = getopt(argc, argv, "n:t:s:p:N:k:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			ncalls = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			nr = atoi(optarg);
+			break;
+		case 'p':
+			npids = atoi(optarg);
+			break;
+		case 'N':
+			every = atoi(optarg);
+			break;
+		case 'k':
+			pid_slots = atol(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (ncalls <= 0 || max_threads <= 0 || nr <= 0 || npids <= 0 || every < 0 || pid_slots <= 0) {
+		usage(argv[0]);
+	}
+
+	for (n = 1; n <= max_threads; n *= 2) {
+		for (impl = LOG; impl <= COUNT; impl++)
+			ok &= run(n);
+	}
+	return ok ? 0 : 1;
+}
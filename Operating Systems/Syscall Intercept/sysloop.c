@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+/*
+ * Workload for measuring the cost of monitoring a system call: makes
+ * -n getppid system calls and prints one line of key=value pairs with
+ * the time each took. Run it bare, under usermon, and with the module
+ * monitoring it, labelling each run with -l, to compare the backends.
+ */
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	char *label = "bare";
+	double start, elapsed;
+	int ncalls = 100000, i, opt;
+
+	while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+		switch (opt) {
+		case 'n':
+			ncalls = atoi(optarg);
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		default:
+			printf("Usage: %s [-n calls] [-l label]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (ncalls <= 0) {
+		printf("Usage: %s [-n calls] [-l label]\n", argv[0]);
+		exit(1);
+	}
+
+	start = now();
+	for (i = 0; i < ncalls; i++)
+		syscall(SYS_getppid);
+	elapsed = now() - start;
+
+	printf("monitor=%s syscall=%d calls=%d seconds=%.3f ns_per_call=%.1f\n",
+		label, SYS_getppid, ncalls, elapsed, elapsed * 1e9 / ncalls);
+	return 0;
+}
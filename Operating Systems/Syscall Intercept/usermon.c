@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "interceptor.h"
+#include "sctable.h"
+#include "sctstats.h"
+#include "evring.h"
+
+/*
+ * User-space stand-in for the interceptor module, for hosts where it
+ * cannot be loaded: runs a program under ptrace and monitors the system
+ * calls it and the processes it starts make. The commands are those of
+ * MY_CUSTOM_SYSCALL (interceptor.h), with the same results, carried out
+ * on the same table (sctable.h); monitored calls are counted and
+ * sampled as in the module (sctstats.h) and printed in the format
+ * sctevents prints (evring.h).
+ *
+ * Usage: usermon [options] -- program [args]
+ *	-i syscall	intercept syscall
+ *	-m syscall	intercept syscall and monitor it for all pids
+ *	-b backend	ptrace (default) stops the program at every system
+ *			call, intercepted or not; seccomp installs a filter
+ *			in the program that stops it only at the system
+ *			calls intercepted when it starts
+ *	-N every	record one monitored call in every as an event
+ *	-o file		print events to file instead of stderr
+ *	-t		start each event line with its timestamp
+ *	-q		count events but print none
+ *	-s		print a summary of the counters to stderr at the end
+ *
+ * A monitored call is timed from the stop at its entry to the stop at
+ * its exit, so its latency includes the cost of two stops. usermon
+ * exits with the program's exit status.
+ */
+
+/* the system call numbers the table covers */
+#define USERMON_NR_SYSCALLS	512
+
+/* events recorded until they are printed */
+#define EVENT_RING_SIZE		4096
+
+/* events printed at a time */
+#define PRINT_BATCH		64
+
+#if defined(__x86_64__)
+#define USERMON_AUDIT_ARCH	AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#define USERMON_AUDIT_ARCH	AUDIT_ARCH_I386
+#elif defined(__aarch64__)
+#define USERMON_AUDIT_ARCH	AUDIT_ARCH_AARCH64
+#endif
+
+enum backend { BACKEND_PTRACE, BACKEND_SECCOMP };
+static const char *backend_names[] = { "ptrace", "seccomp" };
+
+static struct sctable sct;
+static struct sct_stats stats;
+static struct sct_evbuf events;
+
+static enum backend backend;
+static FILE *out;
+static int timestamps, quiet;
+
+/* syscall stops seen */
+static unsigned long stops;
+
+/* A traced process */
+struct tracee {
+	pid_t pid;
+
+	/* set once its first stop has been seen */
+	int started;
+
+	/* set between the entry and exit of a monitored call */
+	int in_call;
+	int syscall;
+	unsigned long long start;
+
+	struct tracee *next;
+};
+
+#define TRACEE_BUCKETS		256
+
+static struct tracee *tracees[TRACEE_BUCKETS];
+
+//----- Commands ------------------------------------------------
+/**
+ * Check that 'pid' may be monitored for 'syscall': pid must exist and
+ * be one usermon may signal.
+ */
+static int check_monitor_request(int syscall, int pid) {
+
+	//invalid syscall number
+	if (syscall < 0 || syscall == MY_CUSTOM_SYSCALL || syscall >= USERMON_NR_SYSCALLS) {
+		return -EINVAL;
+	}
+
+	//invalid pid
+	if (pid < 0) {
+		return -EINVAL;
+	}
+	if (pid != 0 && kill(pid, 0) == -1) {
+		return errno == EPERM ? -EPERM : -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Carry out a command of MY_CUSTOM_SYSCALL on usermon's table, with the
+ * same arguments and results as the module (see my_syscall), except
+ * that there is no superuser: usermon only monitors its own children.
+ */
+static long usermon_command(int cmd, int syscall, unsigned long arg) {
+
+	struct sct_request *reqs = (struct sct_request *) arg;
+	int pid = (int) arg;
+	int ret, i, failed;
+
+	if (cmd == REQUEST_BATCH) {
+		if (syscall < 0 || syscall > MAX_BATCH) {
+			return -EINVAL;
+		}
+		for (i = 0; i < syscall; i++) {
+			if (reqs[i].cmd != REQUEST_START_MONITORING && reqs[i].cmd != REQUEST_STOP_MONITORING) {
+				return reqs[i].ret = -EINVAL;
+			}
+			if ((ret = check_monitor_request(reqs[i].syscall, reqs[i].pid)) != 0) {
+				return reqs[i].ret = ret;
+			}
+		}
+		return sct_apply_batch(&sct, reqs, syscall, &failed);
+	}
+
+	if (cmd == REQUEST_SET_SAMPLING) {
+		sct_stats_set_sampling(&stats, (unsigned int) arg);
+		return 0;
+	}
+
+	if (cmd == REQUEST_RESET_STATS) {
+		sct_stats_reset(&stats);
+		return 0;
+	}
+
+	//invalid syscall number
+	if (syscall < 0 || syscall == MY_CUSTOM_SYSCALL || syscall >= USERMON_NR_SYSCALLS) {
+		return -EINVAL;
+	}
+
+	if (cmd == REQUEST_SYSCALL_INTERCEPT) {
+		return sct_intercept(&sct, syscall);
+	} else if (cmd == REQUEST_SYSCALL_RELEASE) {
+		return sct_release(&sct, syscall);
+	} else if (cmd == REQUEST_START_MONITORING) {
+		if ((ret = check_monitor_request(syscall, pid)) != 0) {
+			return ret;
+		}
+		return sct_start_monitoring(&sct, syscall, pid);
+	} else if (cmd == REQUEST_STOP_MONITORING) {
+		if ((ret = check_monitor_request(syscall, pid)) != 0) {
+			return ret;
+		}
+		return sct_stop_monitoring(&sct, syscall, pid);
+	}
+
+	//invalid command
+	return -EINVAL;
+}
+
+static void command(int cmd, int syscall, unsigned long arg) {
+	long ret = usermon_command(cmd, syscall, arg);
+
+	if (ret != 0) {
+		fprintf(stderr, "command %d for system call %d failed: %s\n", cmd, syscall, strerror(-ret));
+		exit(1);
+	}
+}
+//---------------------------------------------------------------
+
+//----- Tracees -------------------------------------------------
+static struct tracee *find_tracee(pid_t pid) {
+	struct tracee **b = &tracees[pid % TRACEE_BUCKETS], *t;
+
+	for (t = *b; t != NULL; t = t->next) {
+		if (t->pid == pid)
+			return t;
+	}
+	if ((t = calloc(1, sizeof(struct tracee))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	t->pid = pid;
+	t->next = *b;
+	return *b = t;
+}
+
+static void remove_tracee(pid_t pid) {
+	struct tracee **p = &tracees[pid % TRACEE_BUCKETS], *t;
+
+	for (; (t = *p) != NULL; p = &t->next) {
+		if (t->pid == pid) {
+			*p = t->next;
+			free(t);
+			return;
+		}
+	}
+}
+//---------------------------------------------------------------
+
+//----- Events --------------------------------------------------
+static void print_events(void) {
+	struct sct_event batch[PRINT_BATCH];
+	char line[256];
+	int n, i;
+
+	while ((n = sct_evbuf_drain(&events, batch, PRINT_BATCH)) > 0) {
+		for (i = 0; i < n && !quiet; i++) {
+			sct_event_format(&batch[i], line, sizeof(line));
+			if (timestamps)
+				fprintf(out, "%llu ", batch[i].timestamp);
+			fputs(line, out);
+		}
+	}
+}
+
+/**
+ * Handle a stop at the entry or exit of a system call, as the module's
+ * interceptor does around the original system call. Returns the ptrace
+ * request to resume the tracee with.
+ */
+static int syscall_stop(struct tracee *t, int resume) {
+	struct __ptrace_syscall_info info;
+	unsigned long args[6];
+	int s, i;
+
+	stops++;
+	if (ptrace(PTRACE_GET_SYSCALL_INFO, t->pid, sizeof(info), &info) == -1) {
+		return resume;
+	}
+
+	if (info.op == PTRACE_SYSCALL_INFO_EXIT) {
+		if (t->in_call) {
+			sct_stats_account(&stats, 0, t->syscall, t->pid, sct_clock_ns() - t->start);
+			t->in_call = 0;
+		}
+		return resume;
+	}
+
+	//the seccomp backend may also see the entry stop of a call it stopped at
+	if (t->in_call) {
+		return PTRACE_SYSCALL;
+	}
+
+	if (info.op == PTRACE_SYSCALL_INFO_SECCOMP) {
+		s = info.seccomp.nr;
+		for (i = 0; i < 6; i++)
+			args[i] = info.seccomp.args[i];
+	} else if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+		s = info.entry.nr;
+		for (i = 0; i < 6; i++)
+			args[i] = info.entry.args[i];
+	} else {
+		return resume;
+	}
+
+	if (!sct_should_log(&sct, s, t->pid)) {
+		return resume;
+	}
+	if (sct_stats_sample(&stats, 0)) {
+		sct_evbuf_record(&events, 0, t->pid, s, args);
+	}
+
+	//stop again at its exit, to time it
+	t->in_call = 1;
+	t->syscall = s;
+	t->start = sct_clock_ns();
+	return PTRACE_SYSCALL;
+}
+
+/**
+ * Trace child and every process it starts until all have exited.
+ * Returns child's wait status.
+ */
+static int trace(pid_t child) {
+	struct tracee *t;
+	int status, child_status = 0, sig, event, resume, deliver;
+	int options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+		PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+	pid_t pid;
+
+	if (backend == BACKEND_SECCOMP) {
+		options |= PTRACE_O_TRACESECCOMP;
+	}
+
+	for (;;) {
+		if ((pid = waitpid(-1, &status, __WALL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ECHILD)
+				break;
+			perror("waitpid");
+			exit(1);
+		}
+
+		//as my_exit_group does, remove the pid from all pid sets
+		if (WIFEXITED(status) || WIFSIGNALED(status)) {
+			sct_exit_pid(&sct, pid);
+			remove_tracee(pid);
+			if (pid == child)
+				child_status = status;
+			continue;
+		}
+		if (!WIFSTOPPED(status)) {
+			continue;
+		}
+
+		t = find_tracee(pid);
+		sig = WSTOPSIG(status);
+		event = status >> 16;
+		resume = backend == BACKEND_PTRACE ? PTRACE_SYSCALL : PTRACE_CONT;
+		deliver = 0;
+
+		if (sig == (SIGTRAP | 0x80) || event == PTRACE_EVENT_SECCOMP) {
+			resume = syscall_stop(t, resume);
+		} else if (event != 0) {
+			//fork, clone and exec events need nothing done
+		} else if (!t->started && sig == SIGSTOP) {
+			//the first stop of every tracee; the children of the
+			//child inherit the options
+			if (pid == child && ptrace(PTRACE_SETOPTIONS, pid, NULL, options) == -1) {
+				perror("ptrace");
+				exit(1);
+			}
+		} else {
+			deliver = sig;
+		}
+		t->started = 1;
+
+		//fails if the tracee has been killed meanwhile, which waitpid will tell
+		ptrace(resume, pid, NULL, deliver);
+
+		if (!sct_evbuf_empty(&events))
+			print_events();
+	}
+
+	print_events();
+	return child_status;
+}
+//---------------------------------------------------------------
+
+/*
+ * Stop the calling process at every system call intercepted now, and
+ * let all others through. Must be called after PTRACE_TRACEME: without
+ * a tracer the filtered calls fail with ENOSYS.
+ */
+static int install_filter(void) {
+#ifdef USERMON_AUDIT_ARCH
+	struct sock_filter *filter = malloc((5 + 2 * USERMON_NR_SYSCALLS) * sizeof(struct sock_filter));
+	struct sock_fprog prog;
+	int n = 0, s;
+
+	if (filter == NULL) {
+		return -1;
+	}
+	//system calls of another architecture have other numbers
+	filter[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+	filter[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, USERMON_AUDIT_ARCH, 1, 0);
+	filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+	filter[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+	for (s = 0; s < USERMON_NR_SYSCALLS; s++) {
+		if (sct_is_intercepted(&sct, s)) {
+			filter[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, s, 0, 1);
+			filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+		}
+	}
+	filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+
+	prog.len = n;
+	prog.filter = filter;
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+		return -1;
+	}
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static pid_t spawn(char *argv[]) {
+	pid_t pid;
+
+	if ((pid = fork()) == -1) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		//wait for the tracer to set its options
+		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
+			perror("ptrace");
+			_exit(1);
+		}
+		raise(SIGSTOP);
+		if (backend == BACKEND_SECCOMP && install_filter() == -1) {
+			perror("seccomp");
+			_exit(1);
+		}
+		execvp(argv[0], argv);
+		perror("execvp");
+		_exit(1);
+	}
+	return pid;
+}
+
+static void usage(char *prog) {
+	fprintf(stderr, "Usage: %s [-i syscall] [-m syscall] [-b ptrace|seccomp] [-N sample_every] [-o file] [-t] [-q] [-s] -- program [args]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int opt, s, summary = 0, status, len;
+	char *text;
+
+	if (sct_init(&sct, USERMON_NR_SYSCALLS) != 0 ||
+		sct_stats_init(&stats, USERMON_NR_SYSCALLS, 1, 4096) != 0 ||
+		sct_evbuf_init(&events, 1, EVENT_RING_SIZE) != 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	out = stderr;
+
+	while ((opt = getopt(argc, argv, "+i:m:b:N:o:tqs")) != -1) {
+		switch (opt) {
+		case 'i':
+			command(REQUEST_SYSCALL_INTERCEPT, atoi(optarg), 0);
+			break;
+		case 'm':
+			s = atoi(optarg);
+			if (!sct_is_intercepted(&sct, s))
+				command(REQUEST_SYSCALL_INTERCEPT, s, 0);
+			command(REQUEST_START_MONITORING, s, 0);
+			break;
+		case 'b':
+			if (strcmp(optarg, "ptrace") == 0)
+				backend = BACKEND_PTRACE;
+			else if (strcmp(optarg, "seccomp") == 0)
+				backend = BACKEND_SECCOMP;
+			else
+				usage(argv[0]);
+			break;
+		case 'N':
+			command(REQUEST_SET_SAMPLING, 0, atoi(optarg));
+			break;
+		case 'o':
+			if ((out = fopen(optarg, "w")) == NULL) {
+				perror("fopen");
+				exit(1);
+			}
+			break;
+		case 't':
+			timestamps = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 's':
+			summary = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc) {
+		usage(argv[0]);
+	}
+
+	status = trace(spawn(&argv[optind]));
+	fflush(out);
+
+	if (summary) {
+		len = sct_stats_format(&stats, NULL, 0);
+		if ((text = malloc(len + 1)) == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		sct_stats_format(&stats, text, len + 1);
+		fprintf(stderr, "backend=%s stops=%lu dropped=%lu\n%s", backend_names[backend],
+			stops, sct_evbuf_dropped(&events), text);
+		free(text);
+	}
+
+	sct_evbuf_destroy(&events);
+	sct_stats_destroy(&stats);
+	sct_destroy(&sct);
+	return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
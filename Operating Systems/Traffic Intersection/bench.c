@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "traffic.h"
+#include "rand.h"
+
+/*
+ * Benchmark mode of traffic (-b): generated schedules, a report of the
+ * run's throughput and contention, and a check that the run obeyed the
+ * rules of the intersection.
+ */
+
+extern struct intersection isection;
+
+/**
+ * Fill cars with count cars numbered 0..count-1. The in_direction of a
+ * car is picked with the relative weights of enum direction, its
+ * out_direction uniformly. The same seed always gives the same schedule.
+ */
+void generate_schedule(struct car_table *cars, long count, int weights[4], unsigned int seed) {
+	unsigned int rng = seed * 2654435761U + 1;
+	int total = 0, i, r;
+	long c;
+
+	for (i = 0; i < 4; i++) {
+		total += weights[i];
+	}
+
+	cars->count = count;
+	cars->id = malloc(sizeof(int) * (count + 1));
+	cars->in_dir = malloc(count + 1);
+	cars->out_dir = malloc(count + 1);
+	if (!cars->id || !cars->in_dir || !cars->out_dir) {
+		perror("malloc");
+		exit(1);
+	}
+
+	rng = rng ? rng : 1;
+	for (c = 0; c < count; c++) {
+		r = rt_rand32(&rng) % total;
+		for (i = 0; r >= weights[i]; i++) {
+			r -= weights[i];
+		}
+		cars->id[c] = c;
+		cars->in_dir[c] = i;
+		cars->out_dir[c] = rt_rand32(&rng) % MAX_DIRECTION;
+	}
+}
+
+/**
+ * Check a finished run: every car crossed exactly once and left through
+ * its out_direction, each lane let through all of its cars, and no two
+ * cars were in the same quadrant at once. Problems are described on
+ * stderr; returns their number.
+ */
+int check_invariants() {
+	struct car_table *cars = &isection.cars;
+	long passed = 0, c;
+	int errors = 0, i, k;
+	char *seen;
+
+	if ((seen = calloc(cars->count + 1, 1)) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < 4; i++) {
+		struct lane *l = &isection.lanes[i];
+
+		if (l->logged != l->inc) {
+			fprintf(stderr, "lane %d: %d of %d cars crossed\n", i, l->logged, l->inc);
+			errors++;
+		}
+		for (k = 0; k < l->logged; k++) {
+			c = l->log[k].car;
+			if (c < 0 || c >= cars->count || cars->in_dir[c] != i) {
+				fprintf(stderr, "lane %d: crossed car %ld is not from this lane\n", i, c);
+				errors++;
+			} else if (seen[c]++) {
+				fprintf(stderr, "car %d crossed more than once\n", cars->id[c]);
+				errors++;
+			}
+		}
+
+		for (k = 0; k < l->passed; k++) {
+			c = l->out_cars[k];
+			if (cars->out_dir[c] != i) {
+				fprintf(stderr, "lane %d: car %d left through the wrong lane\n", i, cars->id[c]);
+				errors++;
+			}
+		}
+		passed += l->passed;
+	}
+
+	for (c = 0; c < cars->count; c++) {
+		if (!seen[c]) {
+			fprintf(stderr, "car %d never crossed\n", cars->id[c]);
+			errors++;
+		}
+	}
+	if (passed != cars->count) {
+		fprintf(stderr, "%ld cars passed, %ld were scheduled\n", passed, cars->count);
+		errors++;
+	}
+	if (isection.stats.overlaps) {
+		fprintf(stderr, "%ld crossings shared a quadrant\n", isection.stats.overlaps);
+		errors++;
+	}
+
+	free(seen);
+	return errors;
+}
+
+/**
+ * Print the result of a benchmark run that took elapsed seconds as one
+ * line of key=value pairs: throughput, time the cars of all lanes spent
+ * waiting for each quadrant, and how full each lane's buffer was.
+ */
+void print_bench_report(double elapsed) {
+	struct cross_stats *st = &isection.stats;
+	long wait_ns[4] = {0, 0, 0, 0};
+	int i, q;
+
+	for (i = 0; i < 4; i++) {
+		for (q = 0; q < 4; q++) {
+			wait_ns[q] += isection.lanes[i].quad_wait_ns[q];
+		}
+	}
+
+	printf("cars=%ld scheduler=%s lanes=%s capacity=%d batch=%d seconds=%.3f cars_per_sec=%.0f "
+		"concurrent_pct=%.2f max_concurrent=%d overlaps=%ld",
+		isection.cars.count, isection.mask_sched ? "mask" : "locks",
+		isection.lockfree_lanes ? "spsc" : "mutex", isection.lanes[0].capacity, isection.batch,
+		elapsed, isection.cars.count / elapsed,
+		st->crossings ? 100.0 * st->concurrent / st->crossings : 0.0,
+		st->max_crossing, st->overlaps);
+
+	for (q = 0; q < 4; q++) {
+		printf(" quad%d_wait_ms=%.3f", q, wait_ns[q] / 1e6);
+	}
+	for (i = 0; i < 4; i++) {
+		struct lane *l = &isection.lanes[i];
+
+		printf(" lane%d_cars=%d lane%d_occupancy_avg=%.2f lane%d_occupancy_max=%d lane%d_full_waits=%ld",
+			i, l->inc, i, l->inc ? (double) l->occupancy_sum / l->inc : 0.0,
+			i, l->occupancy_max, i, l->full_waits);
+	}
+	printf("\n");
+}
@@ -2,10 +2,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include "traffic.h"
 
 extern struct intersection isection;
 
+static inline long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Record the buffer occupancy of l right after an insertion */
+static inline void count_occupancy(struct lane *l, int in_buf) {
+	l->occupancy_sum += in_buf;
+	if (in_buf > l->occupancy_max) {
+		l->occupancy_max = in_buf;
+	}
+}
+
 /**
  * Populate the car lists by parsing a file where each line has
  * the following structure:
@@ -15,32 +33,55 @@ extern struct intersection isection;
  * Each car is added to the list that corresponds with 
  * its in_direction
  * 
+ * The file may also be a binary schedule, see load_schedule.
+ * Cars are stored in isection.cars; the lanes' in_cars and out_cars
+ * hold car numbers.
+ *
  * Note: this also updates 'inc' on each of the lanes
  */
 void parse_schedule(char *file_name) {
-    int id;
-    struct car *cur_car;
+    struct car_table *cars = &isection.cars;
+
+    load_schedule(file_name, cars);
+    assign_lanes();
+}
+
+/**
+ * Fill each lane's in_cars from isection.cars, size its out_cars and
+ * crossing log and set its 'inc'.
+ */
+void assign_lanes() {
+    struct car_table *cars = &isection.cars;
+    int outc[MAX_DIRECTION] = {0, 0, 0, 0};
     struct lane *cur_lane;
-    enum direction in_dir, out_dir;
-    FILE *f = fopen(file_name, "r");
-
-    /* parse file */
-    while (fscanf(f, "%d %d %d", &id, (int*)&in_dir, (int*)&out_dir) == 3) {
-
-        /* construct car */
-        cur_car = malloc(sizeof(struct car));
-        cur_car->id = id;
-        cur_car->in_dir = in_dir;
-        cur_car->out_dir = out_dir;
-
-        /* append new car to head of corresponding list */
-        cur_lane = &isection.lanes[in_dir];
-        cur_car->next = cur_lane->in_cars;
-        cur_lane->in_cars = cur_car;
-        cur_lane->inc++;
+    long c;
+    int i;
+
+    for (c = 0; c < cars->count; c++) {
+        isection.lanes[cars->in_dir[c]].inc++;
+        outc[cars->out_dir[c]]++;
+    }
+
+    for (i = 0; i < 4; i++) {
+        cur_lane = &isection.lanes[i];
+        cur_lane->in_cars = malloc(sizeof(int) * (cur_lane->inc + 1));
+        cur_lane->out_cars = malloc(sizeof(int) * (outc[i] + 1));
+        cur_lane->log = malloc(sizeof(struct crossing) * (cur_lane->inc + 1));
+        if (!cur_lane->in_cars || !cur_lane->out_cars || !cur_lane->log) {
+            perror("malloc");
+            exit(1);
+        }
     }
 
-    fclose(f);
+    /* cars arrive in the reverse of their schedule order, filling each
+       lane's in_cars from the back keeps it that way */
+    for (i = 0; i < 4; i++) {
+        outc[i] = isection.lanes[i].inc;
+    }
+    for (c = 0; c < cars->count; c++) {
+        cur_lane = &isection.lanes[cars->in_dir[c]];
+        cur_lane->in_cars[--outc[cars->in_dir[c]]] = c;
+    }
 }
 
 /**
@@ -48,28 +89,91 @@ void parse_schedule(char *file_name) {
  * before any cars start coming
  */
 void init_intersection() {
+	char name[16];
 	int i, j;
 	for (i = 0; i < 4; i++) {
-		pthread_mutex_init (&isection.quad[i], NULL);
-		pthread_mutex_init (&isection.lanes[i].lock, NULL);
+		snprintf(name, sizeof(name), "quad%d", i);
+		prof_mutex_init (&isection.quad[i], name);
+		snprintf(name, sizeof(name), "lane%d", i);
+		prof_mutex_init (&isection.lanes[i].lock, name);
 		pthread_cond_init (&isection.lanes[i].producer_cv, NULL);
 		pthread_cond_init (&isection.lanes[i].consumer_cv, NULL);
 		isection.lanes[i].in_cars = NULL;
 		isection.lanes[i].out_cars = NULL;
 		isection.lanes[i].inc = 0;
 		isection.lanes[i].passed = 0;
-		isection.lanes[i].capacity = LANE_LENGTH;
+		isection.lanes[i].capacity = isection.lane_capacity > 0 ?
+			isection.lane_capacity : LANE_LENGTH;
 		
 		// allocate memory for lane buffer
-		isection.lanes[i].buffer = (struct car **) malloc(sizeof(struct car *) * isection.lanes[i].capacity);
+		isection.lanes[i].buffer = (int *) malloc(sizeof(int) * isection.lanes[i].capacity);
+		if (isection.lanes[i].buffer == NULL) {
+			perror("malloc");
+			exit(1);
+		}
 		// initialize buffer values
 		for (j = 0; j < isection.lanes[i].capacity; j++) {
-			isection.lanes[i].buffer[j] = NULL;
+			isection.lanes[i].buffer[j] = -1;
 		}
 		
 		isection.lanes[i].head = 0;
 		isection.lanes[i].tail = 0;
 		isection.lanes[i].in_buf = 0;
+		
+		if (spsc_init(&isection.lanes[i].ring, isection.lanes[i].capacity) < 0) {
+			perror("spsc_init");
+			exit(1);
+		}
+	}
+}
+
+/**
+ * car_arrive in batch mode: each time the lane has room, fill every
+ * free slot with the next cars and wake the cross thread once.
+ */
+static void arrive_batched(struct lane *l) {
+	int i = 0, n, k;
+	
+	if (isection.lockfree_lanes) {
+		while (i < l->inc) {
+			if (isection.stats.enabled && spsc_count(&l->ring) == l->capacity) {
+				l->full_waits++;
+			}
+			n = spsc_push_batch(&l->ring, &l->in_cars[i], l->inc - i);
+			i += n;
+			if (isection.stats.enabled) {
+				// the batch may already be partly consumed; count it as if not
+				for (k = spsc_count(&l->ring) - n + 1; n > 0; n--, k++) {
+					count_occupancy(l, k > 0 ? k : 1);
+				}
+			}
+		}
+		return;
+	}
+	
+	while (i < l->inc) {
+		prof_mutex_lock(&l->lock);
+		if (isection.stats.enabled && l->in_buf == l->capacity) {
+			l->full_waits++;
+		}
+		while (l->in_buf == l->capacity) {
+			prof_cond_wait(&l->producer_cv, &l->lock);
+		}
+		// take as many cars as there are free slots
+		n = l->capacity - l->in_buf;
+		if (n > l->inc - i) {
+			n = l->inc - i;
+		}
+		for (k = 0; k < n; k++) {
+			l->buffer[l->tail] = l->in_cars[i++];
+			l->tail = (l->tail + 1) % l->capacity;
+			l->in_buf++;
+			if (isection.stats.enabled) {
+				count_occupancy(l, l->in_buf);
+			}
+		}
+		pthread_cond_signal(&l->consumer_cv);
+		prof_mutex_unlock(&l->lock);
 	}
 }
 
@@ -82,30 +186,248 @@ void *car_arrive(void *arg) {
     struct lane *l = arg;
 	
 	int i;
+	if (isection.batch) {
+		arrive_batched(l);
+		return NULL;
+	}
+	if (isection.lockfree_lanes) {
+		for (i = 0; i < l->inc; i++) {
+			if (isection.stats.enabled && spsc_count(&l->ring) == l->capacity) {
+				l->full_waits++;
+			}
+			// blocks only while the ring is full
+			spsc_push(&l->ring, l->in_cars[i]);
+			if (isection.stats.enabled) {
+				count_occupancy(l, spsc_count(&l->ring));
+			}
+		}
+		return NULL;
+	}
+	
 	for (i = 0; i < l->inc; i++) {
-		pthread_mutex_lock(&l->lock);
+		prof_mutex_lock(&l->lock);
+		if (isection.stats.enabled && l->in_buf == l->capacity) {
+			l->full_waits++;
+		}
 		// wait until buffer has space to add next car
 		while (l->in_buf == l->capacity) {
-			pthread_cond_wait(&l->producer_cv, &l->lock);
+			prof_cond_wait(&l->producer_cv, &l->lock);
 		}
-		struct car *cur_car;
-		// take first car from list
-		cur_car = l->in_cars;
-		// update list head
-        l->in_cars = cur_car->next;
-		// add car to buffer
-		l->buffer[l->tail] = cur_car;
+		// add next car of the list to buffer
+		l->buffer[l->tail] = l->in_cars[i];
 		// update buffer tail for next buffer addition
 		l->tail = (l->tail + 1) % l->capacity;
 		l->in_buf++;
+		if (isection.stats.enabled) {
+			count_occupancy(l, l->in_buf);
+		}
 		// notify cross thread that car(s) available in lane
 		pthread_cond_signal(&l->consumer_cv);
-		pthread_mutex_unlock(&l->lock);
+		prof_mutex_unlock(&l->lock);
 	}
 	
     return NULL;
 }
 
+/**
+ * Claim every quadrant in mask at once with a single compare-and-swap
+ * on the occupancy word, sleeping on it while any of them is taken.
+ * Cars with disjoint masks are admitted together and, since a car never
+ * holds part of its path while waiting for the rest, there is no lock
+ * order to follow.
+ */
+static void acquire_quadrants(unsigned int mask) {
+	unsigned int cur = __atomic_load_n(&isection.occupied, __ATOMIC_RELAXED);
+	
+	for (;;) {
+		if (!(cur & mask)) {
+			if (__atomic_compare_exchange_n(&isection.occupied, &cur, cur | mask, 1,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				return;
+			}
+			// cur was reloaded by the failed exchange
+			continue;
+		}
+		
+		/* announce ourselves before the final check, so release_quadrants
+		   either sees the waiter or we see its update of the word */
+		__atomic_add_fetch(&isection.occupied_waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&isection.occupied, __ATOMIC_SEQ_CST) == cur) {
+			syscall(SYS_futex, &isection.occupied, FUTEX_WAIT_PRIVATE, cur, NULL, NULL, 0);
+		}
+		__atomic_sub_fetch(&isection.occupied_waiters, 1, __ATOMIC_RELAXED);
+		cur = __atomic_load_n(&isection.occupied, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Give back the quadrants in mask and wake the cars waiting for any of
+ * them; each rechecks whether its own path is now free.
+ */
+static void release_quadrants(unsigned int mask) {
+	__atomic_and_fetch(&isection.occupied, ~mask, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&isection.occupied_waiters, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &isection.occupied, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/**
+ * Count a car with path mask entering (delta 1) or leaving (delta -1)
+ * the intersection, record whether other cars were crossing at the
+ * same time and check that none of them was using the same quadrants.
+ */
+static void count_crossing(unsigned int mask, int delta) {
+	struct cross_stats *st = &isection.stats;
+	int n = __atomic_add_fetch(&st->crossing, delta, __ATOMIC_RELAXED);
+	int max;
+	
+	if (delta < 0) {
+		__atomic_and_fetch(&st->check_occupied, ~mask, __ATOMIC_RELAXED);
+		return;
+	}
+	if (__atomic_fetch_or(&st->check_occupied, mask, __ATOMIC_RELAXED) & mask) {
+		__atomic_add_fetch(&st->overlaps, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&st->crossings, 1, __ATOMIC_RELAXED);
+	if (n > 1) {
+		__atomic_add_fetch(&st->concurrent, 1, __ATOMIC_RELAXED);
+	}
+	max = __atomic_load_n(&st->max_crossing, __ATOMIC_RELAXED);
+	while (n > max && !__atomic_compare_exchange_n(&st->max_crossing, &max, n, 1,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Take the quadrants on cur_car's path, pass through the
+ * intersection and release them again. Passing through only takes
+ * the next crossing sequence number and records it in the lane's
+ * log; the log is printed once all cars are through.
+ */
+static void cross_intersection(struct lane *l, int cur_car) {
+	struct car_table *cars = &isection.cars;
+	struct crossing *entry = &l->log[l->logged++];
+	int stats = isection.stats.enabled;
+	long t0 = 0, t1;
+	
+	// quadrants needed for car to cross intersection
+	unsigned int mask = compute_path_mask(cars->in_dir[cur_car], cars->out_dir[cur_car]);
+	
+	int q;
+	if (isection.mask_sched) {
+		if (stats) {
+			t0 = now_ns();
+		}
+		acquire_quadrants(mask);
+		if (stats) {
+			// the whole path was waited for at once
+			t1 = now_ns();
+			for (q = 0; q < 4; q++) {
+				if (mask & QUAD(q)) {
+					l->quad_wait_ns[q] += t1 - t0;
+				}
+			}
+		}
+	} else {
+		for (q = 0; q < 4; q++) {
+			if (mask & QUAD(q)) {
+				if (stats) {
+					t0 = now_ns();
+				}
+				// acquire locks necessary to go through intersection, in lock order
+				prof_mutex_lock(&isection.quad[q]);
+				if (stats) {
+					l->quad_wait_ns[q] += now_ns() - t0;
+				}
+			}
+		}
+	}
+	
+	if (stats) {
+		count_crossing(mask, 1);
+	}
+	
+	/* once necessary quadrants acquired, cur_car can pass through
+	   intersection; crossings that share a quadrant get their sequence
+	   numbers in the order they really happened */
+	entry->seq = __atomic_fetch_add(&isection.crossing_seq, 1, __ATOMIC_RELAXED);
+	
+	if (stats) {
+		count_crossing(mask, -1);
+	}
+	
+	if (isection.mask_sched) {
+		release_quadrants(mask);
+	} else {
+		for (q = 0; q < 4; q++) {
+			if (mask & QUAD(q)) {
+				// release locks after intersection passed
+				prof_mutex_unlock(&isection.quad[q]);
+			}
+		}
+	}
+	
+	entry->car = cur_car;
+}
+
+/**
+ * Add cur_car to the out_cars of the lane it leaves through.
+ */
+static void exit_intersection(int cur_car) {
+	struct lane *out = &isection.lanes[isection.cars.out_dir[cur_car]];
+	
+	prof_mutex_lock(&out->lock);
+	
+	// add current car to out_cars of the lane it goes out
+	out->out_cars[out->passed] = cur_car;
+	out->passed++;
+	
+	prof_mutex_unlock(&out->lock);
+}
+
+/**
+ * car_cross in batch mode: each time cars are queued, take all of them
+ * (up to the lane capacity) at once, free their slots and wake the
+ * arrive thread, then cross them one by one. The lane lock is not held
+ * while crossing, as with the mask scheduler.
+ */
+static void cross_batched(struct lane *l) {
+	int *batch = malloc(sizeof(int) * l->capacity);
+	int i = 0, n, k;
+	
+	if (batch == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	
+	while (i < l->inc) {
+		if (isection.lockfree_lanes) {
+			n = spsc_pop_batch(&l->ring, batch, l->capacity);
+		} else {
+			prof_mutex_lock(&l->lock);
+			while (l->in_buf == 0) {
+				prof_cond_wait(&l->consumer_cv, &l->lock);
+			}
+			n = l->in_buf;
+			for (k = 0; k < n; k++) {
+				batch[k] = l->buffer[l->head];
+				l->head = (l->head + 1) % l->capacity;
+			}
+			l->in_buf = 0;
+			pthread_cond_signal(&l->producer_cv);
+			prof_mutex_unlock(&l->lock);
+		}
+		
+		for (k = 0; k < n; k++) {
+			cross_intersection(l, batch[k]);
+			exit_intersection(batch[k]);
+		}
+		i += n;
+	}
+	
+	free(batch);
+}
+
 /**
  * Move cars from a single lane across the intersection. Cars
  * crossing the intersection must abide the rules of the road
@@ -116,139 +438,75 @@ void *car_cross(void *arg) {
     struct lane *l = arg;
 	
 	int i;
+	if (isection.batch) {
+		cross_batched(l);
+		free(l->buffer);
+		spsc_destroy(&l->ring);
+		return NULL;
+	}
+	if (isection.lockfree_lanes) {
+		for (i = 0; i < l->inc; i++) {
+			// blocks only while the ring is empty
+			int cur_car = spsc_pop(&l->ring);
+			cross_intersection(l, cur_car);
+			exit_intersection(cur_car);
+		}
+		free(l->buffer);
+		spsc_destroy(&l->ring);
+		return NULL;
+	}
+	
 	for (i = 0; i < l->inc; i++) {
-		pthread_mutex_lock(&l->lock);
+		prof_mutex_lock(&l->lock);
 		// wait until buffer has next car to read from it
 		while (l->in_buf == 0) {
-			pthread_cond_wait(&l->consumer_cv, &l->lock);
+			prof_cond_wait(&l->consumer_cv, &l->lock);
 		}
-		struct car *cur_car;
+		int cur_car;
 		// take first car from list
 		cur_car = l->buffer[l->head];
 		// update buffer head for next buffer read
 		l->head = (l->head + 1) % l->capacity;
 		l->in_buf--;
 		
-		// get path needed for car to cross intersection
-		int *path = compute_path(cur_car->in_dir, cur_car->out_dir);
-		
-		int q;
-		for (q = 0; q < 4; q++) {
-			if (path[q] < 4) {
-				// acquire locks necessary to go through intersection
-				pthread_mutex_lock(&isection.quad[path[q]]);
-			}
-		}
-		
-		/* once necessary quadrants acquired, cur_car can pass through
-		   intersection and its info is printed */
-		printf("%d %d %d\n", cur_car->in_dir, cur_car->out_dir, cur_car->id);
-		
-		for (q = 0; q < 4; q++) {
-			if (path[q] < 4) {
-				// release locks after intersection passed
-				pthread_mutex_unlock(&isection.quad[path[q]]);
-			}
-		}
-		
-		free(path);
-		
 		/* notify arrive thread that space available in lane that the car
-		   arrived from */
+		   arrived from; the lane lock only guards the buffer, so drop it
+		   before crossing */
 		pthread_cond_signal(&l->producer_cv);
-		pthread_mutex_unlock(&l->lock);
-		
-		pthread_mutex_lock(&(isection.lanes[cur_car->out_dir].lock));
+		prof_mutex_unlock(&l->lock);
 		
-		// add current car to out_cars of the lane it goes out
-		cur_car->next = isection.lanes[cur_car->out_dir].out_cars;
-		isection.lanes[cur_car->out_dir].out_cars = cur_car;
-		isection.lanes[cur_car->out_dir].passed++;
-		
-		pthread_mutex_unlock(&(isection.lanes[cur_car->out_dir].lock));
+		cross_intersection(l, cur_car);
+		exit_intersection(cur_car);
 	}
 	free(l->buffer);
+	spsc_destroy(&l->ring);
 	
     return NULL;
 }
 
 /**
- * Given a car's in_dir and out_dir return a sorted 
- * list of the quadrants the car will pass through.
+ * Print every crossing, as "<in_dir> <out_dir> <id>", in the order the
+ * cars crossed, by merging the lanes' logs on their sequence numbers.
  */
-int *compute_path(enum direction in_dir, enum direction out_dir) {
-	
-	int *path = (int *) malloc(sizeof(int) * 4); //max 4 quadrant path length
-	
-	//default invalid quadrant indeces
-	path[0] = 4;
-	path[1] = 4;
-	path[2] = 4;
-	path[3] = 4;
-	
-	if (in_dir == NORTH) {
-		path[0] = 1;
-		if (out_dir == NORTH) {
-			path[0] = 0;
-			path[1] = 1;
-			path[2] = 2;
-			path[3] = 3;
-		} else if (out_dir == EAST) {
-			path[1] = 2;
-			path[2] = 3;
-		} else if (out_dir == SOUTH) {
-			path[1] = 2;
-		}
-	}
-	
-	else if (in_dir == EAST) {
-		path[0] = 0;
-		if (out_dir == EAST) {
-			path[0] = 0;
-			path[1] = 1;
-			path[2] = 2;
-			path[3] = 3;
-		} else if (out_dir == SOUTH) {
-			path[1] = 1;
-			path[2] = 2;
-		} else if (out_dir == WEST) {
-			path[1] = 1;
-		}
-	}
-	
-	else if (in_dir == SOUTH) {
-		path[0] = 3;
-		if (out_dir == SOUTH) {
-			path[0] = 0;
-			path[1] = 1;
-			path[2] = 2;
-			path[3] = 3;
-		} else if (out_dir == WEST) {
-			path[0] = 0;
-			path[1] = 1;
-			path[2] = 3;
-		} else if (out_dir == NORTH) {
-			path[0] = 0;
-			path[1] = 3;
-		}
-	}
-	
-	else if (in_dir == WEST) {
-		path[0] = 2;
-		if (out_dir == WEST) {
-			path[0] = 0;
-			path[1] = 1;
-			path[2] = 2;
-			path[3] = 3;
-		} else if (out_dir == NORTH) {
-			path[0] = 0;
-			path[1] = 2;
-			path[2] = 3;
-		} else if (out_dir == EAST) {
-			path[1] = 3;
-		}
-	}
-	
-	return path;
-	return NULL;
-}
\ No newline at end of file
+void print_crossings() {
+	struct car_table *cars = &isection.cars;
+	int pos[4] = {0, 0, 0, 0};
+	int i, next;
+	
+	for (;;) {
+		next = -1;
+		for (i = 0; i < 4; i++) {
+			struct lane *l = &isection.lanes[i];
+			if (pos[i] < l->logged &&
+				(next < 0 || l->log[pos[i]].seq < isection.lanes[next].log[pos[next]].seq)) {
+				next = i;
+			}
+		}
+		if (next < 0) {
+			break;
+		}
+		
+		int c = isection.lanes[next].log[pos[next]++].car;
+		printf("%d %d %d\n", cars->in_dir[c], cars->out_dir[c], cars->id[c]);
+	}
+}
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include "grid.h"
+#include "rand.h"
+
+#define MAXLINE 256
+
+/*
+ * Crossings per unit of width + height after which a car that drives
+ * until it leaves the grid parks anyway, should its turns keep it
+ * circling (left turns only around a block, say)
+ */
+#define MAX_HOPS_FACTOR 64
+
+/**
+ * Append a car entering at (x, y) from in_dir to the scenario; with
+ * hops <= 0 it gets the most the grid allows. Returns -1 if out of
+ * memory.
+ */
+static int add_car(struct grid *g, int x, int y, enum direction in_dir, int hops) {
+	struct gcar *car;
+
+	if (g->ncars == g->cars_capacity) {
+		long capacity = g->cars_capacity ? g->cars_capacity * 2 : 1024;
+		struct gcar *cars = realloc(g->cars, sizeof(struct gcar) * capacity);
+		if (cars == NULL) {
+			return -1;
+		}
+		g->cars = cars;
+		g->cars_capacity = capacity;
+	}
+
+	car = &g->cars[g->ncars];
+	car->id = g->ncars++;
+	car->in_dir = in_dir;
+	car->out_dir = in_dir;
+	car->hops = hops > 0 ? hops : MAX_HOPS_FACTOR * (g->width + g->height);
+	car->node = y * g->width + x;
+	car->next = NULL;
+	car->rng = (g->seed ^ (car->id * 2654435761U)) | 1;
+
+	return 0;
+}
+
+/**
+ * Read a scenario file. Each line is one of the following, and
+ * 'grid' must come before any cars are placed:
+ *
+ * grid <width> <height>
+ * workers <count>
+ * quantum <phases per step>
+ * turns <straight> <left> <right> <uturn>
+ * seed <n>
+ * spawn <count> <hops>          cars entering at random edge lanes
+ * car <x> <y> <in_dir> <hops>   a car entering (x, y) from in_dir
+ *
+ * Blank lines and lines starting with '#' are ignored. A car drives
+ * until it has crossed <hops> intersections or leaves the grid; with
+ * hops <= 0 it drives until it leaves the grid, or has crossed
+ * MAX_HOPS_FACTOR * (width + height) intersections if its turns keep
+ * it from leaving.
+ *
+ * Returns -1 and reports the offending line on error.
+ */
+int grid_load(struct grid *g, const char *file_name) {
+	char line[MAXLINE], word[32];
+	int a, b, c, d, lineno = 0, i;
+	unsigned int rng;
+	FILE *f;
+
+	memset(g, 0, sizeof(struct grid));
+	g->nworkers = 4;
+	g->quantum = 8;
+	g->turns[STRAIGHT] = 6;
+	g->turns[LEFT] = 2;
+	g->turns[RIGHT] = 2;
+	g->turns[UTURN] = 0;
+	g->seed = 1;
+
+	if ((f = fopen(file_name, "r")) == NULL) {
+		perror(file_name);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (sscanf(line, "%31s", word) != 1 || word[0] == '#') {
+			continue;
+		}
+
+		if (strcmp(word, "grid") == 0 && sscanf(line, "%*s %d %d", &a, &b) == 2 &&
+			a > 0 && b > 0 && g->ncars == 0) {
+			g->width = a;
+			g->height = b;
+		} else if (strcmp(word, "workers") == 0 && sscanf(line, "%*s %d", &a) == 1 && a > 0) {
+			g->nworkers = a;
+		} else if (strcmp(word, "quantum") == 0 && sscanf(line, "%*s %d", &a) == 1 && a > 0) {
+			g->quantum = a;
+		} else if (strcmp(word, "turns") == 0 &&
+			sscanf(line, "%*s %d %d %d %d", &a, &b, &c, &d) == 4 &&
+			a >= 0 && b >= 0 && c >= 0 && d >= 0 && a + b + c + d > 0) {
+			g->turns[STRAIGHT] = a;
+			g->turns[LEFT] = b;
+			g->turns[RIGHT] = c;
+			g->turns[UTURN] = d;
+		} else if (strcmp(word, "seed") == 0 && sscanf(line, "%*s %d", &a) == 1) {
+			g->seed = a ? a : 1;
+		} else if (strcmp(word, "spawn") == 0 && sscanf(line, "%*s %d %d", &a, &b) == 2 &&
+			a >= 0 && g->width > 0) {
+			rng = g->seed * 2654435761U + g->ncars + 1;
+			rng = rng ? rng : 1;
+			for (i = 0; i < a; i++) {
+				enum direction side = rt_rand32(&rng) % MAX_DIRECTION;
+				int x = rt_rand32(&rng) % g->width, y = rt_rand32(&rng) % g->height;
+
+				// enter from outside the grid on that side
+				if (side == NORTH) {
+					y = 0;
+				} else if (side == SOUTH) {
+					y = g->height - 1;
+				} else if (side == WEST) {
+					x = 0;
+				} else {
+					x = g->width - 1;
+				}
+				if (add_car(g, x, y, side, b) < 0) {
+					perror("realloc");
+					fclose(f);
+					return -1;
+				}
+			}
+		} else if (strcmp(word, "car") == 0 &&
+			sscanf(line, "%*s %d %d %d %d", &a, &b, &c, &d) == 4 &&
+			a >= 0 && a < g->width && b >= 0 && b < g->height &&
+			c >= 0 && c < MAX_DIRECTION) {
+			if (add_car(g, a, b, c, d) < 0) {
+				perror("realloc");
+				fclose(f);
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "%s:%d: invalid line: %s", file_name, lineno, line);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+	if (g->width == 0) {
+		fprintf(stderr, "%s: no grid size given\n", file_name);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Queue intersection i on its home worker's deque. The caller must
+ * have set its scheduled flag, so it is queued at most once.
+ */
+static void schedule_node(struct grid *g, int i) {
+	struct gworker *w = &g->workers[g->nodes[i].home];
+
+	pthread_mutex_lock(&w->lock);
+	w->deque[(w->first + w->count) % w->capacity] = i;
+	__atomic_store_n(&w->count, w->count + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* Take the most recently queued intersection of w, or -1 */
+static int pop_own(struct gworker *w) {
+	int i = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->count > 0) {
+		__atomic_store_n(&w->count, w->count - 1, __ATOMIC_RELAXED);
+		i = w->deque[(w->first + w->count) % w->capacity];
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return i;
+}
+
+/* Take the oldest queued intersection of any other worker, or -1 */
+static int steal(struct grid *g, struct gworker *self) {
+	int start = rt_rand32(&self->rng) % g->nworkers;
+	int k, i = -1;
+
+	for (k = 0; k < g->nworkers && i < 0; k++) {
+		struct gworker *w = &g->workers[(start + k) % g->nworkers];
+
+		if (w == self || __atomic_load_n(&w->count, __ATOMIC_RELAXED) == 0) {
+			continue;
+		}
+		pthread_mutex_lock(&w->lock);
+		if (w->count > 0) {
+			i = w->deque[w->first];
+			w->first = (w->first + 1) % w->capacity;
+			__atomic_store_n(&w->count, w->count - 1, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+	if (i >= 0) {
+		self->steals++;
+	}
+
+	return i;
+}
+
+/**
+ * Pick the car's turn at the intersection it just entered
+ * from the scenario's turn weights.
+ */
+static void choose_turn(struct grid *g, struct gcar *car) {
+	int total = g->turns[STRAIGHT] + g->turns[LEFT] + g->turns[RIGHT] + g->turns[UTURN];
+	int r = rt_rand32(&car->rng) % total;
+	enum direction d = car->in_dir;
+
+	if ((r -= g->turns[STRAIGHT]) < 0) {
+		car->out_dir = (d + 2) % MAX_DIRECTION;
+	} else if ((r -= g->turns[LEFT]) < 0) {
+		car->out_dir = (d + 3) % MAX_DIRECTION;
+	} else if ((r -= g->turns[RIGHT]) < 0) {
+		car->out_dir = (d + 1) % MAX_DIRECTION;
+	} else {
+		car->out_dir = d;
+	}
+}
+
+/* Append car to the lane of n it entered by */
+static void enqueue(struct grid *g, struct gnode *n, struct gcar *car) {
+	choose_turn(g, car);
+	car->next = NULL;
+	if (n->tail[car->in_dir]) {
+		n->tail[car->in_dir]->next = car;
+	} else {
+		n->head[car->in_dir] = car;
+	}
+	n->tail[car->in_dir] = car;
+	n->queued++;
+}
+
+/**
+ * Hand a car that crossed intersection i to the neighbour it drives
+ * into. Returns 1 if the car instead left the grid or parked.
+ */
+static int forward(struct grid *g, int i, struct gcar *car) {
+	int x = i % g->width, y = i / g->width;
+	struct gnode *n;
+	struct gcar *top;
+
+	if (car->out_dir == NORTH) {
+		y--;
+	} else if (car->out_dir == SOUTH) {
+		y++;
+	} else if (car->out_dir == WEST) {
+		x--;
+	} else {
+		x++;
+	}
+	if (--car->hops == 0 || x < 0 || x >= g->width || y < 0 || y >= g->height) {
+		return 1;
+	}
+
+	// enter the neighbour from the side facing this intersection
+	car->in_dir = (car->out_dir + 2) % MAX_DIRECTION;
+	i = car->node = y * g->width + x;
+	n = &g->nodes[i];
+
+	top = __atomic_load_n(&n->inbox, __ATOMIC_RELAXED);
+	do {
+		car->next = top;
+	} while (!__atomic_compare_exchange_n(&n->inbox, &top, car, 1,
+		__ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	if (!__atomic_exchange_n(&n->scheduled, 1, __ATOMIC_SEQ_CST)) {
+		schedule_node(g, i);
+	}
+	return 0;
+}
+
+/**
+ * Run intersection i for up to quantum crossing phases. In a phase the
+ * front car of every lane crosses unless its path overlaps the path of
+ * a car already admitted in that phase. Returns the number of cars that
+ * finished their trip.
+ */
+static int process_node(struct grid *g, int i) {
+	struct gnode *n = &g->nodes[i];
+	struct gcar *car, *prev = NULL, *next;
+	int phase, k, pending, finished = 0;
+	unsigned int occupied, mask;
+
+	// the inbox stack is newest first, restore arrival order
+	car = __atomic_exchange_n(&n->inbox, NULL, __ATOMIC_SEQ_CST);
+	while (car) {
+		next = car->next;
+		car->next = prev;
+		prev = car;
+		car = next;
+	}
+	for (car = prev; car; car = next) {
+		next = car->next;
+		enqueue(g, n, car);
+	}
+
+	for (phase = 0; phase < g->quantum && n->queued; phase++) {
+		occupied = 0;
+		for (k = 0; k < MAX_DIRECTION; k++) {
+			enum direction d = (n->next_lane + k) % MAX_DIRECTION;
+
+			if ((car = n->head[d]) == NULL) {
+				continue;
+			}
+			mask = compute_path_mask(d, car->out_dir);
+			if (mask & occupied) {
+				continue;
+			}
+			occupied |= mask;
+
+			if ((n->head[d] = car->next) == NULL) {
+				n->tail[d] = NULL;
+			}
+			n->queued--;
+			n->crossings++;
+			finished += forward(g, i, car);
+		}
+		n->next_lane = (n->next_lane + 1) % MAX_DIRECTION;
+	}
+
+	/* unschedule, then look again: a neighbour that pushed while the
+	   flag was still set relies on us to requeue the intersection. The
+	   lanes belong to whoever schedules it next, so read them first. */
+	pending = n->queued;
+	__atomic_store_n(&n->scheduled, 0, __ATOMIC_SEQ_CST);
+	if ((pending || __atomic_load_n(&n->inbox, __ATOMIC_SEQ_CST)) &&
+		!__atomic_exchange_n(&n->scheduled, 1, __ATOMIC_SEQ_CST)) {
+		schedule_node(g, i);
+	}
+
+	return finished;
+}
+
+static void *worker_run(void *arg) {
+	struct gworker *w = arg;
+	struct grid *g = w->grid;
+	int i;
+
+	while (__atomic_load_n(&g->finished, __ATOMIC_RELAXED) < g->ncars) {
+		if ((i = pop_own(w)) < 0 && (i = steal(g, w)) < 0) {
+			sched_yield();
+			continue;
+		}
+		w->steps++;
+		__atomic_add_fetch(&g->finished, process_node(g, i), __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/**
+ * Queue every car at its first intersection, run the worker pool
+ * until all cars are done and return the elapsed wall time in seconds.
+ */
+double grid_run(struct grid *g) {
+	int nnodes = g->width * g->height;
+	struct timespec start, end;
+	long c;
+	int i;
+
+	g->nodes = calloc(nnodes, sizeof(struct gnode));
+	g->workers = calloc(g->nworkers, sizeof(struct gworker));
+	if (g->nodes == NULL || g->workers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	// partition the grid into contiguous blocks of intersections
+	for (i = 0; i < nnodes; i++) {
+		g->nodes[i].home = (long) i * g->nworkers / nnodes;
+		g->workers[g->nodes[i].home].capacity++;
+	}
+	for (i = 0; i < g->nworkers; i++) {
+		g->workers[i].grid = g;
+		g->workers[i].rng = g->seed + i + 1;
+		pthread_mutex_init(&g->workers[i].lock, NULL);
+		g->workers[i].deque = malloc(sizeof(int) * (g->workers[i].capacity + 1));
+		if (g->workers[i].deque == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		g->workers[i].capacity++;
+	}
+
+	for (c = 0; c < g->ncars; c++) {
+		struct gcar *car = &g->cars[c];
+		i = car->node;
+		enqueue(g, &g->nodes[i], car);
+		if (!g->nodes[i].scheduled) {
+			g->nodes[i].scheduled = 1;
+			schedule_node(g, i);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < g->nworkers; i++) {
+		pthread_create(&g->workers[i].thread, NULL, worker_run, &g->workers[i]);
+	}
+	for (i = 0; i < g->nworkers; i++) {
+		pthread_join(g->workers[i].thread, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void grid_free(struct grid *g) {
+	int i;
+
+	for (i = 0; g->workers && i < g->nworkers; i++) {
+		pthread_mutex_destroy(&g->workers[i].lock);
+		free(g->workers[i].deque);
+	}
+	free(g->workers);
+	free(g->nodes);
+	free(g->cars);
+	memset(g, 0, sizeof(struct grid));
+}
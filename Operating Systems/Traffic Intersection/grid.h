@@ -0,0 +1,115 @@
+#ifndef __GRID_H__
+#define __GRID_H__
+
+#include <pthread.h>
+#include "traffic.h"
+
+/*
+ * City-scale simulation: a width x height grid of intersections in which
+ * the cars leaving one intersection through out_dir enter the neighbour
+ * on that side. Instead of two threads per lane, a fixed pool of workers
+ * processes intersections: every intersection has a home worker, becomes
+ * ready when cars are queued at it, and ready intersections of a busy
+ * worker are stolen by idle ones.
+ */
+
+/* turns a car can take, as indices of grid.turns */
+enum turn {
+    STRAIGHT,
+    LEFT,
+    RIGHT,
+    UTURN,
+    MAX_TURN
+};
+
+/* a car travelling through the grid */
+struct gcar {
+    /* inbox stack or lane queue of the intersection the car is at */
+    struct gcar     *next;
+
+    int             id;
+
+    /* index (y * width + x) of the intersection the car is at */
+    int             node;
+
+    /* side of the current intersection the car entered from and leaves by */
+    enum direction  in_dir, out_dir;
+
+    /* intersections left to cross before the car parks, if it has not left the grid */
+    int             hops;
+
+    /* state of the car's own random number generator, picking its turns */
+    unsigned int    rng;
+};
+
+/* one intersection of the grid */
+struct gnode {
+    /*
+     * Cars sent by the neighbours, pushed lock-free onto a stack which
+     * the processing worker takes as a whole
+     */
+    struct gcar     *inbox __attribute__((aligned(64)));
+
+    /* set while the intersection is queued on or being run by a worker */
+    int             scheduled;
+
+    /* entry lanes in arrival order, only touched by the processing worker */
+    struct gcar     *head[MAX_DIRECTION], *tail[MAX_DIRECTION];
+    int             queued;
+
+    /* lane served first in the next crossing phase */
+    int             next_lane;
+
+    /* number of cars that crossed this intersection */
+    long            crossings;
+
+    /* worker whose deque the intersection is queued on */
+    int             home;
+};
+
+/* a worker thread and its deque of ready intersections */
+struct gworker {
+    struct grid     *grid;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+
+    /* ring of intersection indices: owner pops newest, thieves take oldest;
+       count changes under lock but thieves peek at it without */
+    int             *deque;
+    int             capacity, first, count;
+
+    /* statistics */
+    long            steps, steals;
+
+    unsigned int    rng;
+};
+
+/* a scenario and the state of its simulation */
+struct grid {
+    int             width, height;
+    struct gnode    *nodes;
+
+    int             nworkers;
+    struct gworker  *workers;
+
+    /* maximum crossing phases per processing step of an intersection */
+    int             quantum;
+
+    /* relative weights of the turns in enum turn */
+    int             turns[MAX_TURN];
+
+    unsigned int    seed;
+
+    /* all cars of the scenario */
+    struct gcar     *cars;
+    long            ncars, cars_capacity;
+
+    /* cars that have left the grid or parked */
+    long            finished;
+};
+
+int grid_load(struct grid *g, const char *file_name);
+double grid_run(struct grid *g);
+void grid_free(struct grid *g);
+
+#endif
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "grid.h"
+
+/*
+ * Run a grid scenario (see grid_load for the file format) and report
+ * its throughput in simulated cars and intersection crossings per second.
+ */
+int main(int argc, char *argv[]) {
+    struct grid g;
+    long crossings = 0, steps = 0, steals = 0;
+    int workers = 0, opt, i;
+    double elapsed;
+
+    while ((opt = getopt(argc, argv, "w:")) != -1) {
+        switch (opt) {
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-w workers] <scenario_file>\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (argc - optind != 1) {
+        printf("Usage: %s [-w workers] <scenario_file>\n", argv[0]);
+        exit(1);
+    }
+
+    if (grid_load(&g, argv[optind]) < 0) {
+        exit(1);
+    }
+    if (workers > 0) {
+        g.nworkers = workers;
+    }
+
+    elapsed = grid_run(&g);
+
+    for (i = 0; i < g.width * g.height; i++) {
+        crossings += g.nodes[i].crossings;
+    }
+    for (i = 0; i < g.nworkers; i++) {
+        steps += g.workers[i].steps;
+        steals += g.workers[i].steals;
+    }
+    printf("intersections=%d workers=%d cars=%ld crossings=%ld steps=%ld steals=%ld "
+           "seconds=%.3f cars_per_sec=%.0f crossings_per_sec=%.0f\n",
+           g.width * g.height, g.nworkers, g.ncars, crossings, steps, steals,
+           elapsed, g.ncars / elapsed, crossings / elapsed);
+
+    grid_free(&g);
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "traffic.h"
+
+/*
+ * Benchmark of a single lane handing cars from its arrive thread to its
+ * cross thread, comparing the mutex/condition variable circular buffer
+ * used by car_arrive/car_cross with the lock-free SPSC ring. Nothing
+ * crosses the intersection, so only the hand-off itself is measured.
+ */
+
+static int ncars;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* producer side of car_arrive */
+static void *mutex_arrive(void *arg) {
+    struct lane *l = arg;
+    int i;
+
+    for (i = 0; i < ncars; i++) {
+        prof_mutex_lock(&l->lock);
+        while (l->in_buf == l->capacity) {
+            prof_cond_wait(&l->producer_cv, &l->lock);
+        }
+        l->buffer[l->tail] = i;
+        l->tail = (l->tail + 1) % l->capacity;
+        l->in_buf++;
+        pthread_cond_signal(&l->consumer_cv);
+        prof_mutex_unlock(&l->lock);
+    }
+    return NULL;
+}
+
+/* consumer side of car_cross; returns the number of cars out of order */
+static void *mutex_cross(void *arg) {
+    struct lane *l = arg;
+    long bad = 0;
+    int i;
+
+    for (i = 0; i < ncars; i++) {
+        prof_mutex_lock(&l->lock);
+        while (l->in_buf == 0) {
+            prof_cond_wait(&l->consumer_cv, &l->lock);
+        }
+        if (l->buffer[l->head] != i) {
+            bad++;
+        }
+        l->head = (l->head + 1) % l->capacity;
+        l->in_buf--;
+        pthread_cond_signal(&l->producer_cv);
+        prof_mutex_unlock(&l->lock);
+    }
+    return (void *) bad;
+}
+
+static void *spsc_arrive(void *arg) {
+    struct lane *l = arg;
+    int i;
+
+    for (i = 0; i < ncars; i++) {
+        spsc_push(&l->ring, i);
+    }
+    return NULL;
+}
+
+static void *spsc_cross(void *arg) {
+    struct lane *l = arg;
+    long bad = 0;
+    int i;
+
+    for (i = 0; i < ncars; i++) {
+        if (spsc_pop(&l->ring) != i) {
+            bad++;
+        }
+    }
+    return (void *) bad;
+}
+
+/* car_arrive in batch mode: fill every free slot per lock hold */
+static void *mutex_arrive_batch(void *arg) {
+    struct lane *l = arg;
+    int i = 0, n;
+
+    while (i < ncars) {
+        prof_mutex_lock(&l->lock);
+        while (l->in_buf == l->capacity) {
+            prof_cond_wait(&l->producer_cv, &l->lock);
+        }
+        for (n = l->capacity - l->in_buf; n > 0 && i < ncars; n--) {
+            l->buffer[l->tail] = i++;
+            l->tail = (l->tail + 1) % l->capacity;
+            l->in_buf++;
+        }
+        pthread_cond_signal(&l->consumer_cv);
+        prof_mutex_unlock(&l->lock);
+    }
+    return NULL;
+}
+
+/* car_cross in batch mode: drain every queued car per lock hold */
+static void *mutex_cross_batch(void *arg) {
+    struct lane *l = arg;
+    long bad = 0;
+    int i = 0;
+
+    while (i < ncars) {
+        prof_mutex_lock(&l->lock);
+        while (l->in_buf == 0) {
+            prof_cond_wait(&l->consumer_cv, &l->lock);
+        }
+        for (; l->in_buf > 0; l->in_buf--, i++) {
+            if (l->buffer[l->head] != i) {
+                bad++;
+            }
+            l->head = (l->head + 1) % l->capacity;
+        }
+        pthread_cond_signal(&l->producer_cv);
+        prof_mutex_unlock(&l->lock);
+    }
+    return (void *) bad;
+}
+
+static void *spsc_arrive_batch(void *arg) {
+    struct lane *l = arg;
+    int *cars = malloc(sizeof(int) * ncars);
+    int i;
+
+    if (cars == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < ncars; i++) {
+        cars[i] = i;
+    }
+    for (i = 0; i < ncars; ) {
+        i += spsc_push_batch(&l->ring, &cars[i], ncars - i);
+    }
+    free(cars);
+    return NULL;
+}
+
+static void *spsc_cross_batch(void *arg) {
+    struct lane *l = arg;
+    int *batch = malloc(sizeof(int) * l->capacity);
+    long bad = 0;
+    int i = 0, k, n;
+
+    if (batch == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while (i < ncars) {
+        n = spsc_pop_batch(&l->ring, batch, l->capacity);
+        for (k = 0; k < n; k++, i++) {
+            if (batch[k] != i) {
+                bad++;
+            }
+        }
+    }
+    free(batch);
+    return (void *) bad;
+}
+
+static void run(const char *name, int capacity,
+                void *(*arrive)(void *), void *(*cross)(void *)) {
+    /* lanes outlive their run, the lock profile is reported at exit */
+    static struct lane lanes[4];
+    static int runs;
+    struct lane *l = &lanes[runs++ % 4];
+    pthread_t in_thread, cross_thread;
+    void *bad;
+    double start, elapsed;
+
+    memset(l, 0, sizeof(*l));
+    prof_mutex_init(&l->lock, name);
+    pthread_cond_init(&l->producer_cv, NULL);
+    pthread_cond_init(&l->consumer_cv, NULL);
+    l->capacity = capacity;
+    l->buffer = malloc(sizeof(int) * capacity);
+    if (!l->buffer || spsc_init(&l->ring, capacity) < 0) {
+        perror("malloc");
+        exit(1);
+    }
+
+    start = now();
+    pthread_create(&cross_thread, NULL, cross, l);
+    pthread_create(&in_thread, NULL, arrive, l);
+    pthread_join(in_thread, NULL);
+    pthread_join(cross_thread, &bad);
+    elapsed = now() - start;
+
+    printf("lane=%s capacity=%d cars=%d out_of_order=%ld seconds=%.3f cars_per_sec=%.0f\n",
+           name, capacity, ncars, (long) bad, elapsed, ncars / elapsed);
+
+    spsc_destroy(&l->ring);
+    free(l->buffer);
+    prof_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->producer_cv);
+    pthread_cond_destroy(&l->consumer_cv);
+}
+
+int main(int argc, char *argv[]) {
+    int capacity = LANE_LENGTH, opt;
+
+    ncars = 10000000;
+    while ((opt = getopt(argc, argv, "n:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ncars = atoi(optarg);
+            break;
+        case 'c':
+            capacity = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-n cars] [-c lane_capacity]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (ncars <= 0 || capacity <= 0) {
+        printf("Usage: %s [-n cars] [-c lane_capacity]\n", argv[0]);
+        exit(1);
+    }
+
+    run("mutex", capacity, mutex_arrive, mutex_cross);
+    run("spsc", capacity, spsc_arrive, spsc_cross);
+    run("mutex-batch", capacity, mutex_arrive_batch, mutex_cross_batch);
+    run("spsc-batch", capacity, spsc_arrive_batch, spsc_cross_batch);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lockprof.h"
+
+/*
+ * Instrumentation of struct prof_mutex, see lockprof.h. Without
+ * LOCK_PROFILE everything is inline in the header and this file is empty.
+ */
+
+#ifdef LOCK_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_cycles() __rdtsc()
+#else
+/* no cheap cycle counter, count nanoseconds instead */
+static inline unsigned long long read_cycles(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#define MAX_PROFILED 64
+
+static struct prof_mutex *profiled[MAX_PROFILED];
+static int nprofiled;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* cycle counter and clock when the first mutex was set up, to convert cycles to time */
+static unsigned long long start_cycles;
+static double start_ns;
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static inline int bucket(unsigned long long cycles) {
+	int b = cycles ? 63 - __builtin_clzll(cycles) : 0;
+	return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+static long hist_total(const long *hist) {
+	long total = 0;
+	int b;
+
+	for (b = 0; b < PROF_BUCKETS; b++) {
+		total += hist[b];
+	}
+	return total;
+}
+
+/* upper bound, in cycles, of the bucket holding the given fraction of hist's samples */
+static unsigned long long percentile(const long *hist, double fraction) {
+	long seen = 0, total = hist_total(hist);
+	int b;
+
+	for (b = 0; b < PROF_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen > 0 && seen >= total * fraction) {
+			break;
+		}
+	}
+	return 2ULL << (b < PROF_BUCKETS ? b : PROF_BUCKETS - 1);
+}
+
+static void print_hist(const char *what, const char *name, const long *hist) {
+	int b;
+
+	fprintf(stderr, "lock=%s %s_hist", name, what);
+	for (b = 0; b < PROF_BUCKETS; b++) {
+		if (hist[b]) {
+			fprintf(stderr, " %llu:%ld", 1ULL << b, hist[b]);
+		}
+	}
+	fprintf(stderr, "\n");
+}
+
+/**
+ * Print the counters and histograms of every profiled mutex, one
+ * key=value line each, followed by its histograms as
+ * "<bucket lower bound in cycles>:<count>" pairs.
+ */
+static void prof_report(void) {
+	double ns_per_cycle = 1;
+	unsigned long long cycles = read_cycles() - start_cycles;
+	int i;
+
+	if (cycles) {
+		ns_per_cycle = (now_ns() - start_ns) / cycles;
+	}
+
+	for (i = 0; i < nprofiled; i++) {
+		struct prof_mutex *m = profiled[i];
+		// a hold ends at every unlock and every condition variable wait
+		long holds = hist_total(m->hold_hist);
+
+		fprintf(stderr, "lock=%s acquired=%ld contended=%ld contended_pct=%.2f "
+			"wait_avg_ns=%.0f wait_p99_ns=%.0f hold_avg_ns=%.0f hold_p50_ns=%.0f hold_p99_ns=%.0f\n",
+			m->name, m->acquired, m->contended,
+			m->acquired ? 100.0 * m->contended / m->acquired : 0.0,
+			m->contended ? m->wait_cycles * ns_per_cycle / m->contended : 0.0,
+			m->contended ? percentile(m->wait_hist, 0.99) * ns_per_cycle : 0.0,
+			holds ? m->hold_cycles * ns_per_cycle / holds : 0.0,
+			holds ? percentile(m->hold_hist, 0.5) * ns_per_cycle : 0.0,
+			holds ? percentile(m->hold_hist, 0.99) * ns_per_cycle : 0.0);
+		print_hist("wait", m->name, m->wait_hist);
+		print_hist("hold", m->name, m->hold_hist);
+	}
+}
+
+/**
+ * Set up m and add it to the mutexes reported at exit under name.
+ * Mutexes beyond MAX_PROFILED still work but are not reported.
+ */
+void prof_mutex_init(struct prof_mutex *m, const char *name) {
+	memset(m, 0, sizeof(*m));
+	pthread_mutex_init(&m->mutex, NULL);
+	snprintf(m->name, sizeof(m->name), "%s", name);
+
+	pthread_mutex_lock(&registry_lock);
+	if (nprofiled == 0) {
+		start_cycles = read_cycles();
+		start_ns = now_ns();
+		atexit(prof_report);
+	}
+	if (nprofiled < MAX_PROFILED) {
+		profiled[nprofiled++] = m;
+	}
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/**
+ * Lock m, timing the wait only if a first try finds it taken so that
+ * uncontended acquisitions cost one extra read of the cycle counter.
+ */
+void prof_mutex_lock(struct prof_mutex *m) {
+	unsigned long long t0, t1, wait;
+
+	if (pthread_mutex_trylock(&m->mutex) == 0) {
+		m->acquired_at = read_cycles();
+		m->acquired++;
+		return;
+	}
+
+	t0 = read_cycles();
+	pthread_mutex_lock(&m->mutex);
+	t1 = read_cycles();
+
+	wait = t1 - t0;
+	m->acquired_at = t1;
+	m->acquired++;
+	m->contended++;
+	m->wait_cycles += wait;
+	m->wait_hist[bucket(wait)]++;
+}
+
+/* account the time m has been held since acquired_at */
+static inline void end_hold(struct prof_mutex *m) {
+	unsigned long long hold = read_cycles() - m->acquired_at;
+
+	m->hold_cycles += hold;
+	m->hold_hist[bucket(hold)]++;
+}
+
+void prof_mutex_unlock(struct prof_mutex *m) {
+	end_hold(m);
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/**
+ * pthread_cond_wait on m. The time asleep is not counted as held; the
+ * lock taken again on wakeup starts a new hold but not a new acquisition.
+ */
+void prof_cond_wait(pthread_cond_t *cv, struct prof_mutex *m) {
+	end_hold(m);
+	pthread_cond_wait(cv, &m->mutex);
+	m->acquired_at = read_cycles();
+}
+
+#endif
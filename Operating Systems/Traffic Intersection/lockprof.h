@@ -0,0 +1,64 @@
+#ifndef __LOCKPROF_H__
+#define __LOCKPROF_H__
+
+#include <pthread.h>
+
+/*
+ * Mutex that, when built with -DLOCK_PROFILE, counts its acquisitions
+ * and the contended ones (those that found it taken) and keeps
+ * histograms of how long it was waited for and held. Times are taken
+ * from the time stamp counter and bucketed by powers of two cycles.
+ * Every profiled mutex is reported on stderr when the program exits.
+ *
+ * Without LOCK_PROFILE a struct prof_mutex is a bare pthread_mutex_t
+ * and the functions below are plain calls of their pthread versions.
+ */
+
+/* histogram buckets; bucket b counts times of [2^b, 2^(b+1)) cycles */
+#define PROF_BUCKETS 40
+
+struct prof_mutex {
+    pthread_mutex_t     mutex;
+#ifdef LOCK_PROFILE
+    char                name[16];
+
+    /* all written only by the owner of mutex */
+    long                acquired, contended;
+    unsigned long long  wait_cycles, hold_cycles;
+    unsigned long long  acquired_at;
+    long                wait_hist[PROF_BUCKETS], hold_hist[PROF_BUCKETS];
+#endif
+};
+
+#ifdef LOCK_PROFILE
+
+void prof_mutex_init(struct prof_mutex *m, const char *name);
+void prof_mutex_lock(struct prof_mutex *m);
+void prof_mutex_unlock(struct prof_mutex *m);
+void prof_cond_wait(pthread_cond_t *cv, struct prof_mutex *m);
+
+#else
+
+static inline void prof_mutex_init(struct prof_mutex *m, const char *name) {
+	pthread_mutex_init(&m->mutex, NULL);
+}
+
+static inline void prof_mutex_lock(struct prof_mutex *m) {
+	pthread_mutex_lock(&m->mutex);
+}
+
+static inline void prof_mutex_unlock(struct prof_mutex *m) {
+	pthread_mutex_unlock(&m->mutex);
+}
+
+static inline void prof_cond_wait(pthread_cond_t *cv, struct prof_mutex *m) {
+	pthread_cond_wait(cv, &m->mutex);
+}
+
+#endif
+
+static inline void prof_mutex_destroy(struct prof_mutex *m) {
+	pthread_mutex_destroy(&m->mutex);
+}
+
+#endif
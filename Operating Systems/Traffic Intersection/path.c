@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include "traffic.h"
+
+/**
+ * Quadrants passed through for every (in_dir, out_dir) pair, as a
+ * bitmask of QUAD() bits. A car turns right through the quadrant at its
+ * entry, and each further turn adds the next quadrant counterclockwise;
+ * a U-turn needs the whole intersection.
+ */
+static const unsigned char path_masks[MAX_DIRECTION][MAX_DIRECTION] = {
+	[NORTH] = {
+		[WEST]  = QUAD(1),
+		[SOUTH] = QUAD(1) | QUAD(2),
+		[EAST]  = QUAD(1) | QUAD(2) | QUAD(3),
+		[NORTH] = QUAD(0) | QUAD(1) | QUAD(2) | QUAD(3),
+	},
+	[WEST] = {
+		[SOUTH] = QUAD(2),
+		[EAST]  = QUAD(2) | QUAD(3),
+		[NORTH] = QUAD(0) | QUAD(2) | QUAD(3),
+		[WEST]  = QUAD(0) | QUAD(1) | QUAD(2) | QUAD(3),
+	},
+	[SOUTH] = {
+		[EAST]  = QUAD(3),
+		[NORTH] = QUAD(0) | QUAD(3),
+		[WEST]  = QUAD(0) | QUAD(1) | QUAD(3),
+		[SOUTH] = QUAD(0) | QUAD(1) | QUAD(2) | QUAD(3),
+	},
+	[EAST] = {
+		[NORTH] = QUAD(0),
+		[WEST]  = QUAD(0) | QUAD(1),
+		[SOUTH] = QUAD(0) | QUAD(1) | QUAD(2),
+		[EAST]  = QUAD(0) | QUAD(1) | QUAD(2) | QUAD(3),
+	},
+};
+
+/**
+ * Given a car's in_dir and out_dir return the bitmask of
+ * the quadrants the car will pass through (bit q for quadrant q).
+ */
+unsigned int compute_path_mask(enum direction in_dir, enum direction out_dir) {
+	if ((unsigned int) in_dir >= MAX_DIRECTION || (unsigned int) out_dir >= MAX_DIRECTION) {
+		return 0;
+	}
+	return path_masks[in_dir][out_dir];
+}
+
+/**
+ * Given a car's in_dir and out_dir return a sorted 
+ * list of the quadrants the car will pass through.
+ * Unused entries of the 4 element list are set to 4.
+ * The list is malloc'd and must be freed by the caller.
+ */
+int *compute_path(enum direction in_dir, enum direction out_dir) {
+	
+	int *path = (int *) malloc(sizeof(int) * 4); //max 4 quadrant path length
+	unsigned int mask = compute_path_mask(in_dir, out_dir);
+	int q, len = 0;
+	
+	if (path == NULL) {
+		return NULL;
+	}
+	
+	for (q = 0; q < 4; q++) {
+		if (mask & QUAD(q)) {
+			path[len++] = q;
+		}
+	}
+	//default invalid quadrant indeces
+	while (len < 4) {
+		path[len++] = 4;
+	}
+	
+	return path;
+}
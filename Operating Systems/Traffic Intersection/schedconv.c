@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "traffic.h"
+
+/*
+ * Convert a schedule (text or binary) into the binary schedule format,
+ * which the traffic program loads without parsing.
+ */
+int main(int argc, char *argv[]) {
+    struct car_table cars;
+
+    if (argc != 3) {
+        printf("Usage: %s <schedules_file> <binary_schedules_file>\n", argv[0]);
+        exit(1);
+    }
+
+    load_schedule(argv[1], &cars);
+    if (save_schedule_binary(argv[2], &cars) < 0) {
+        exit(1);
+    }
+    printf("%ld cars written to %s\n", cars.count, argv[2]);
+
+    return 0;
+}
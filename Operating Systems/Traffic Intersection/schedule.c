@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "traffic.h"
+
+/*
+ * Loading of schedule files into a struct car_table.
+ *
+ * A text schedule is mapped into memory and its integers are scanned in
+ * place; a binary schedule (see struct schedule_header) already holds
+ * the arrays of a car table, so the table simply points into the mapping.
+ */
+
+/*
+ * header of a binary schedule, followed by int32_t id[count],
+ * uint8_t in_dir[count] and uint8_t out_dir[count]
+ */
+struct schedule_header {
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        unused;
+    uint64_t        count;
+};
+
+#define SCHEDULE_MAGIC "TRAFSCHD"
+#define SCHEDULE_VERSION 2
+
+/**
+ * Scan one decimal integer, as fscanf's %d would, from [p, end).
+ * Returns a pointer past it, or NULL if there is no integer there.
+ */
+static const char *scan_int(const char *p, const char *end, int *value) {
+	int neg = 0, v = 0;
+
+	while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r' ||
+		*p == '\v' || *p == '\f')) {
+		p++;
+	}
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = *p++ == '-';
+	}
+	if (p == end || (unsigned int) (*p - '0') > 9) {
+		return NULL;
+	}
+	while (p < end && (unsigned int) (*p - '0') <= 9) {
+		v = v * 10 + (*p++ - '0');
+	}
+
+	*value = neg ? -v : v;
+	return p;
+}
+
+/* Size the arrays of t for capacity cars, keeping the first t->count */
+static void resize_table(struct car_table *t, long capacity) {
+	if ((t->id = realloc(t->id, sizeof(int) * capacity)) == NULL ||
+		(t->in_dir = realloc(t->in_dir, capacity)) == NULL ||
+		(t->out_dir = realloc(t->out_dir, capacity)) == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+}
+
+/**
+ * Parse the "<id> <in_direction> <out_direction>" triples of a text
+ * schedule. The arrays are sized by counting lines first and only
+ * grow if several cars share a line.
+ */
+static void parse_text(const char *file_name, const char *data, size_t size, struct car_table *t) {
+	const char *p = data, *end = data + size;
+	int id, in_dir, out_dir;
+	long capacity = 1;
+
+	for (p = data; (p = memchr(p, '\n', end - p)) != NULL; p++) {
+		capacity++;
+	}
+	resize_table(t, capacity);
+
+	p = data;
+	while ((p = scan_int(p, end, &id)) && (p = scan_int(p, end, &in_dir)) &&
+		(p = scan_int(p, end, &out_dir))) {
+		if (in_dir < 0 || in_dir >= MAX_DIRECTION || out_dir < 0 || out_dir >= MAX_DIRECTION) {
+			fprintf(stderr, "%s: car %d has an invalid direction\n", file_name, id);
+			exit(1);
+		}
+		if (t->count == capacity) {
+			capacity *= 2;
+			resize_table(t, capacity);
+		}
+		t->id[t->count] = id;
+		t->in_dir[t->count] = in_dir;
+		t->out_dir[t->count] = out_dir;
+		t->count++;
+	}
+}
+
+/**
+ * Point t at the arrays of a mapped binary schedule. The mapping is
+ * left in place for as long as the program runs.
+ */
+static void map_binary(const char *file_name, char *data, size_t size, struct car_table *t) {
+	struct schedule_header *h = (struct schedule_header *) data;
+	long i;
+
+	if (h->version != SCHEDULE_VERSION ||
+		h->count > (size - sizeof(*h)) / (sizeof(int32_t) + 2)) {
+		fprintf(stderr, "%s: corrupt binary schedule\n", file_name);
+		exit(1);
+	}
+
+	t->count = h->count;
+	t->id = (int *) (h + 1);
+	t->in_dir = (unsigned char *) (t->id + t->count);
+	t->out_dir = t->in_dir + t->count;
+
+	for (i = 0; i < t->count; i++) {
+		if ((t->in_dir[i] | t->out_dir[i]) >= MAX_DIRECTION) {
+			fprintf(stderr, "%s: car %d has an invalid direction\n", file_name, t->id[i]);
+			exit(1);
+		}
+	}
+}
+
+/**
+ * Load all cars of a text or binary schedule, in file order, into t.
+ * Exits with an error message if the file cannot be read or is malformed.
+ */
+void load_schedule(const char *file_name, struct car_table *t) {
+	struct stat st;
+	char *data;
+	int fd;
+
+	memset(t, 0, sizeof(struct car_table));
+	if ((fd = open(file_name, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror(file_name);
+		exit(1);
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		resize_table(t, 1);
+		return;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	close(fd);
+
+	if ((size_t) st.st_size >= sizeof(struct schedule_header) &&
+		memcmp(data, SCHEDULE_MAGIC, 8) == 0) {
+		map_binary(file_name, data, st.st_size, t);
+		return;
+	}
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	parse_text(file_name, data, st.st_size, t);
+	munmap(data, st.st_size);
+}
+
+/**
+ * Write the cars of t as a binary schedule, which load_schedule maps
+ * without parsing. Returns -1 on error.
+ */
+int save_schedule_binary(const char *file_name, struct car_table *t) {
+	struct schedule_header h;
+	FILE *f;
+
+	if ((f = fopen(file_name, "w")) == NULL) {
+		perror(file_name);
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SCHEDULE_MAGIC, 8);
+	h.version = SCHEDULE_VERSION;
+	h.count = t->count;
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(t->id, sizeof(int), t->count, f);
+	fwrite(t->in_dir, 1, t->count, f);
+	fwrite(t->out_dir, 1, t->count, f);
+
+	if (ferror(f) || fclose(f) == EOF) {
+		perror(file_name);
+		return -1;
+	}
+	return 0;
+}
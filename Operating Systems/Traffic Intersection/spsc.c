@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "spsc.h"
+
+/* number of polls of the other side's counter before parking */
+#define SPIN_LIMIT 128
+
+/* SPIN_LIMIT, or 0 on a uniprocessor where spinning cannot succeed */
+static int spin_limit = SPIN_LIMIT;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/**
+ * Wait until *word no longer holds old and return its new value.
+ * Spin first, then advertise through *sleeping that a wake is needed
+ * and sleep on the futex; FUTEX_WAIT returns at once if *word already
+ * changed, so a wake between the check and the wait is never lost.
+ */
+static unsigned int wait_while(unsigned int *word, unsigned int old, int *sleeping) {
+	unsigned int cur;
+	int spins;
+
+	for (spins = 0; spins < spin_limit; spins++) {
+		if ((cur = __atomic_load_n(word, __ATOMIC_ACQUIRE)) != old) {
+			return cur;
+		}
+		cpu_relax();
+	}
+
+	for (;;) {
+		// pairs with the store of word and the load of *sleeping in wake_sleeper
+		__atomic_store_n(sleeping, 1, __ATOMIC_SEQ_CST);
+		if ((cur = __atomic_load_n(word, __ATOMIC_SEQ_CST)) != old) {
+			break;
+		}
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, old, NULL, NULL, 0);
+	}
+	__atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+
+	return cur;
+}
+
+/**
+ * Wake the other side if it parked on word. Called after word has been
+ * advanced with a seq_cst store, which orders that store before the
+ * seq_cst read of *sleeping. Clearing the flag makes sure a sleeper is
+ * woken only once, however many times word advances before it gets to
+ * run.
+ */
+static inline void wake_sleeper(unsigned int *word, int *sleeping) {
+	if (__atomic_load_n(sleeping, __ATOMIC_SEQ_CST) &&
+		__atomic_exchange_n(sleeping, 0, __ATOMIC_RELAXED)) {
+		syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+/**
+ * Prepare an empty ring holding up to capacity items.
+ * Returns -1 if the slots could not be allocated.
+ */
+int spsc_init(struct spsc_ring *r, unsigned int capacity) {
+	if (sysconf(_SC_NPROCESSORS_ONLN) == 1) {
+		spin_limit = 0;
+	}
+	
+	r->head = 0;
+	r->cached_tail = 0;
+	r->consumer_sleeping = 0;
+	r->tail = 0;
+	r->cached_head = 0;
+	r->producer_sleeping = 0;
+	r->capacity = capacity;
+	r->slots = calloc(capacity, sizeof(int));
+
+	return r->slots ? 0 : -1;
+}
+
+void spsc_destroy(struct spsc_ring *r) {
+	free(r->slots);
+	r->slots = NULL;
+}
+
+/**
+ * Append item to the ring, parking while it is full.
+ * Must only be called from the single producer thread.
+ */
+void spsc_push(struct spsc_ring *r, int item) {
+	unsigned int tail = r->tail;
+
+	if (tail - r->cached_head == r->capacity) {
+		// full as far as we know; head moving at all frees a slot
+		r->cached_head = wait_while(&r->head, tail - r->capacity, &r->producer_sleeping);
+	}
+
+	r->slots[tail % r->capacity] = item;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+	wake_sleeper(&r->tail, &r->consumer_sleeping);
+}
+
+/**
+ * Remove the oldest item from the ring, parking while it is empty.
+ * Must only be called from the single consumer thread.
+ */
+int spsc_pop(struct spsc_ring *r) {
+	unsigned int head = r->head;
+	int item;
+
+	if (head == r->cached_tail) {
+		r->cached_tail = wait_while(&r->tail, head, &r->consumer_sleeping);
+	}
+
+	item = r->slots[head % r->capacity];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+
+	wake_sleeper(&r->head, &r->producer_sleeping);
+
+	return item;
+}
+
+/**
+ * Append the first items of items[0..n) that fit, at least one,
+ * parking only while the ring is full. All of them are published with
+ * a single store of tail. Returns the number appended.
+ * Must only be called from the single producer thread.
+ */
+unsigned int spsc_push_batch(struct spsc_ring *r, const int *items, unsigned int n) {
+	unsigned int tail = r->tail;
+	unsigned int i, room = r->capacity - (tail - r->cached_head);
+
+	if (room < n) {
+		r->cached_head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		room = r->capacity - (tail - r->cached_head);
+	}
+	if (room == 0) {
+		r->cached_head = wait_while(&r->head, tail - r->capacity, &r->producer_sleeping);
+		room = r->capacity - (tail - r->cached_head);
+	}
+	if (n > room) {
+		n = room;
+	}
+
+	for (i = 0; i < n; i++) {
+		r->slots[(tail + i) % r->capacity] = items[i];
+	}
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_SEQ_CST);
+
+	wake_sleeper(&r->tail, &r->consumer_sleeping);
+
+	return n;
+}
+
+/**
+ * Remove up to max of the oldest items into items, at least one,
+ * parking only while the ring is empty. Returns the number removed.
+ * Must only be called from the single consumer thread.
+ */
+unsigned int spsc_pop_batch(struct spsc_ring *r, int *items, unsigned int max) {
+	unsigned int head = r->head;
+	unsigned int i, n = r->cached_tail - head;
+
+	if (n < max) {
+		r->cached_tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		n = r->cached_tail - head;
+	}
+	if (n == 0) {
+		r->cached_tail = wait_while(&r->tail, head, &r->consumer_sleeping);
+		n = r->cached_tail - head;
+	}
+	if (n > max) {
+		n = max;
+	}
+
+	for (i = 0; i < n; i++) {
+		items[i] = r->slots[(head + i) % r->capacity];
+	}
+	__atomic_store_n(&r->head, head + n, __ATOMIC_SEQ_CST);
+
+	wake_sleeper(&r->head, &r->producer_sleeping);
+
+	return n;
+}
+
+unsigned int spsc_count(struct spsc_ring *r) {
+	return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
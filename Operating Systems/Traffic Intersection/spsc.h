@@ -0,0 +1,55 @@
+#ifndef __SPSC_H__
+#define __SPSC_H__
+
+#define CACHE_LINE 64
+
+/*
+ * Lock-free single producer / single consumer ring buffer of ints.
+ *
+ * head and tail are free running counters; the slot of a counter is
+ * counter % capacity, the ring is empty when head == tail and full when
+ * tail - head == capacity. The producer publishes a slot with a store
+ * of tail and the consumer frees one with a store of head.
+ *
+ * A side that finds the ring empty (or full) spins briefly and then parks
+ * on a futex on the other side's counter. The other side only issues a
+ * wake system call when it sees the sleeping flag set. The counter
+ * stores, and the stores and loads of the sleeping flags, are seq_cst,
+ * so that a side setting its flag and then checking the counter, and the
+ * other advancing the counter and then checking the flag, cannot both
+ * miss each other's store.
+ */
+struct spsc_ring {
+    /* written by the consumer */
+    unsigned int    head __attribute__((aligned(CACHE_LINE)));
+    unsigned int    cached_tail;
+    int             consumer_sleeping;
+
+    /* written by the producer */
+    unsigned int    tail __attribute__((aligned(CACHE_LINE)));
+    unsigned int    cached_head;
+    int             producer_sleeping;
+
+    /* read only after init */
+    int             *slots __attribute__((aligned(CACHE_LINE)));
+    unsigned int    capacity;
+};
+
+int spsc_init(struct spsc_ring *r, unsigned int capacity);
+void spsc_destroy(struct spsc_ring *r);
+
+/* blocking push and pop, parking only while the ring is full or empty */
+void spsc_push(struct spsc_ring *r, int item);
+int spsc_pop(struct spsc_ring *r);
+
+/*
+ * batched push and pop, moving as many items as there are free slots
+ * or queued items (at least one) with a single update of tail or head
+ */
+unsigned int spsc_push_batch(struct spsc_ring *r, const int *items, unsigned int n);
+unsigned int spsc_pop_batch(struct spsc_ring *r, int *items, unsigned int max);
+
+/* number of items in the ring; only a snapshot unless called by producer or consumer */
+unsigned int spsc_count(struct spsc_ring *r);
+
+#endif
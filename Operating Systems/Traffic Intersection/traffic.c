@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include "traffic.h"
 
 struct intersection isection;
@@ -9,34 +10,120 @@ struct intersection isection;
  * Prints the state of each lanes out_cars.
  */
 void verify() {
-    int i;
-    struct car *cur;
+    int i, k;
+    struct car_table *cars = &isection.cars;
 
     printf("---\n");
 
     /* iterate through lanes */
     for (i = 0; i < 4; i++) {
 
-        /* iterate through all cars in the lanes out_cars */
-        for (cur = isection.lanes[i].out_cars; cur != NULL; cur = cur->next) {
-            printf("%d %d %d\n", cur->in_dir, cur->out_dir, cur->id);
+        /* iterate through all cars in the lanes out_cars, most recent first */
+        for (k = isection.lanes[i].passed - 1; k >= 0; k--) {
+            int c = isection.lanes[i].out_cars[k];
+            printf("%d %d %d\n", cars->in_dir[c], cars->out_dir[c], cars->id[c]);
         }
     }
     
 	printf("===\n");
 }
 
+static void usage(char *prog) {
+    printf("Usage: %s [-l] [-m] [-B] [-c capacity] [-t] <schedules_file>\n"
+           "       %s -b cars [-k north:west:south:east] [-r seed] [-w file] [-l] [-m] [-B] [-c capacity]\n",
+           prog, prog);
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
-    int i;
+    int i, opt;
     pthread_t in_threads[4], cross_threads[4];
+    struct timespec start, end;
+    double elapsed;
+    long bench_cars = 0;
+    int weights[4] = {1, 1, 1, 1};
+    unsigned int seed = 1;
+    char *save_file = NULL;
+
+    while ((opt = getopt(argc, argv, "lmtBc:b:k:r:w:")) != -1) {
+        switch (opt) {
+        case 'l':
+            /* hand cars over through the lock-free lane rings */
+            isection.lockfree_lanes = 1;
+            break;
+        case 'm':
+            /* admit cars with disjoint paths through the occupancy word */
+            isection.mask_sched = 1;
+            break;
+        case 'B':
+            /* move cars in and out of the lanes in batches */
+            isection.batch = 1;
+            break;
+        case 'c':
+            isection.lane_capacity = atoi(optarg);
+            if (isection.lane_capacity <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+            /* report crossing rate and concurrency on stderr */
+            isection.stats.enabled = 1;
+            break;
+        case 'b':
+            /* run a generated schedule of this many cars and report on stdout */
+            bench_cars = atol(optarg);
+            break;
+        case 'k':
+            /* relative share of the cars arriving from each direction */
+            if (sscanf(optarg, "%d:%d:%d:%d", &weights[0], &weights[1],
+                       &weights[2], &weights[3]) != 4) {
+                usage(argv[0]);
+            }
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            /* keep the generated schedule, to replay it with traffic <file> */
+            save_file = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
 
-    if (argc != 2) {
-        printf("Usage: %s <schedules_file>\n", argv[0]);
-        exit(1);
+    if (bench_cars) {
+        if (argc != optind || bench_cars < 0 || weights[0] < 0 || weights[1] < 0 ||
+            weights[2] < 0 || weights[3] < 0 ||
+            weights[0] + weights[1] + weights[2] + weights[3] <= 0) {
+            usage(argv[0]);
+        }
+        isection.stats.enabled = 1;
+    } else if (argc - optind != 1) {
+        usage(argv[0]);
     }
 
     init_intersection();
-    parse_schedule(argv[1]);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (bench_cars) {
+        generate_schedule(&isection.cars, bench_cars, weights, seed);
+        if (save_file && save_schedule_binary(save_file, &isection.cars) < 0) {
+            exit(1);
+        }
+        assign_lanes();
+    } else {
+        parse_schedule(argv[optind]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (isection.stats.enabled && !bench_cars) {
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(stderr, "cars=%ld load_seconds=%.3f cars_loaded_per_sec=%.0f\n",
+                isection.cars.count, elapsed, isection.cars.count / elapsed);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     /* spin up threads */
     for (i = 0; i < 4; i++) {
@@ -58,6 +145,25 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (bench_cars) {
+        print_bench_report(elapsed);
+        return check_invariants() ? 1 : 0;
+    }
+
+    if (isection.stats.enabled) {
+        fprintf(stderr, "scheduler=%s crossings=%ld seconds=%.3f crossings_per_sec=%.0f "
+                "concurrent=%ld concurrent_pct=%.2f max_concurrent=%d\n",
+                isection.mask_sched ? "mask" : "locks", isection.stats.crossings, elapsed,
+                isection.stats.crossings / elapsed, isection.stats.concurrent,
+                isection.stats.crossings ? 100.0 * isection.stats.concurrent / isection.stats.crossings : 0.0,
+                isection.stats.max_crossing);
+    }
+
+    print_crossings();
 	verify();
 
     return 0;
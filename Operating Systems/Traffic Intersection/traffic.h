@@ -2,9 +2,15 @@
 #define __TRAFFIC_H__
 
 #include <pthread.h>
+#include "spsc.h"
+#include "lockprof.h"
 
+/* default lane capacity, see intersection.lane_capacity */
 #define LANE_LENGTH 10
 
+/* bit of quadrant q (0 based, so quad[q]) in a path mask */
+#define QUAD(q) (1 << (q))
+
 /* directions */
 enum direction {
     NORTH,
@@ -14,33 +20,44 @@ enum direction {
     MAX_DIRECTION
 };
 
-/* representation of a car entering the intersection */
-struct car {
+/*
+ * All cars of the schedule, as parallel arrays indexed by car number
+ * (the position of the car in the schedule). Lanes refer to cars by
+ * these numbers.
+ */
+struct car_table {
     /* id that uniquely identifies each car */
-    int             id;
+    int             *id;
 
     /* direction from which the car is entering and leaving */
-    enum direction  in_dir, out_dir;
+    unsigned char   *in_dir, *out_dir;
+
+    /* number of cars */
+    long            count;
+};
 
-    /* support for singly linked list */
-    struct car      *next;
+/* one entry of a crossing log: car number and its place in the global crossing order */
+struct crossing {
+    long            seq;
+    int             car;
 };
 
 /* entry lane feeding into the intersection */
 struct lane {
     /* synchronization */
-    pthread_mutex_t lock;
+    struct prof_mutex lock;
     pthread_cond_t  producer_cv, consumer_cv;
 
-    /* list of cars that are pending to pass through this lane */
-    struct car      *in_cars;
+    /* cars that are pending to pass through this lane, in arrival order */
+    int             *in_cars;
 
     /*
-     * list of cars that have passed the intersection into this lane.
+     * cars that have passed the intersection into this lane, in the
+     * order they passed; 'passed' of them are filled in.
      * This list should only be appended to and left in memory for us
      * to use during testing. Please do not free the list or any of the cars
      */
-    struct car      *out_cars;
+    int             *out_cars;
 
     /* number of cars passing through this lane */
     int             inc;
@@ -48,8 +65,8 @@ struct lane {
     /* number of cars that have passed through this lane */
     int             passed;
 
-    /* circular buffer implementation */
-    struct car      **buffer;
+    /* circular buffer implementation, holding car numbers */
+    int             *buffer;
 
     /* index of the first element element in the list */
     int             head;
@@ -62,6 +79,52 @@ struct lane {
 
     /* number of elements currently in the list */
     int             in_buf;
+
+    /* lock-free replacement for the circular buffer, see lockfree_lanes */
+    struct spsc_ring ring;
+
+    /*
+     * crossings made by this lane's cross thread, in order; 'logged' of
+     * the 'inc' entries are filled in. print_crossings() merges the logs
+     * of all lanes by seq.
+     */
+    struct crossing *log;
+    int             logged;
+
+    /* statistics, kept while isection.stats is enabled */
+
+    /* cars in the buffer right after each insertion, summed, and the most seen */
+    long            occupancy_sum;
+    int             occupancy_max;
+
+    /* insertions that found the buffer full and had to wait */
+    long            full_waits;
+
+    /* time this lane's cars spent waiting for each quadrant */
+    long            quad_wait_ns[4];
+};
+
+/* counts of how cars share the intersection, see traffic -t and -b */
+struct cross_stats {
+    /* set to collect the counts below */
+    int             enabled;
+
+    /* number of cars currently crossing */
+    int             crossing;
+
+    /* most cars seen crossing at the same time */
+    int             max_crossing;
+
+    /* cars that crossed, and how many of them entered while others were crossing */
+    long            crossings, concurrent;
+
+    /*
+     * quadrants in use by crossing cars, kept independently of the
+     * scheduler, and the number of crossings that found one of their
+     * quadrants already in use (which must never happen)
+     */
+    unsigned int    check_occupied;
+    long            overlaps;
 };
 
 /* complete representation of the intersection */
@@ -76,17 +139,62 @@ struct intersection {
                    S
     Locks are ordered in priority 1 > 2 > 3 > 4, to avoid deadlock
     */
-    pthread_mutex_t quad[4];
+    struct prof_mutex quad[4];
 
     struct lane       lanes[4];
+
+    /* all cars of the schedule */
+    struct car_table  cars;
+
+    /*
+     * If set, cars are handed from the arrive thread to the cross thread
+     * of a lane through its lock-free ring instead of the mutex and
+     * condition variable protected circular buffer
+     */
+    int               lockfree_lanes;
+
+    /* cars each lane's buffer holds, set before init_intersection; 0 means LANE_LENGTH */
+    int               lane_capacity;
+
+    /*
+     * If set, the arrive thread fills all free slots of its lane and the
+     * cross thread takes all queued cars at once, with one lock hold and
+     * one signal (or one ring update) per batch instead of per car
+     */
+    int               batch;
+
+    /*
+     * If set, cars claim their quadrants through the occupancy word
+     * instead of quad[]: bit q (see QUAD) is set while quadrant q is in
+     * use, and cars with disjoint paths cross at the same time
+     */
+    int               mask_sched;
+    unsigned int      occupied;
+    int               occupied_waiters;
+
+    /* next crossing sequence number, taken while holding the quadrants */
+    long              crossing_seq;
+
+    struct cross_stats stats;
 };
 
 /* forward declaration of logic functions */
 void parse_schedule(char *f_name);
+void assign_lanes();
+void load_schedule(const char *file_name, struct car_table *cars);
+int save_schedule_binary(const char *file_name, struct car_table *cars);
 void init_intersection();
 
+void print_crossings();
+
+/* benchmark mode, see bench.c */
+void generate_schedule(struct car_table *cars, long count, int weights[4], unsigned int seed);
+int check_invariants();
+void print_bench_report(double elapsed);
+
 void *car_arrive(void *arg);
 void *car_cross(void *arg);
 int *compute_path(enum direction in_dir, enum direction out_dir);
+unsigned int compute_path_mask(enum direction in_dir, enum direction out_dir);
 
 #endif
\ No newline at end of file
@@ -3,11 +3,16 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include "bytebuf.h"
 
 #ifndef PORT
   #define PORT 50186
 #endif
 
+// bytes asked for per read, and the longest line kept before giving up
+#define READ_SIZE 4096
+#define MAX_LINE 65536
+
 int setup(void) {
   int on = 1, status;
   struct sockaddr_in self;
@@ -44,34 +49,22 @@ int setup(void) {
   return listenfd;
 }
 
-/*Search the first inbuf characters of buf for a network newline ("\r\n").
-  Return the location of the '\r' if the network newline is found,
-  or -1 otherwise.
-*/
-
-int find_network_newline(const char *buf, int inbuf) {
-  
-  for (int i = 0; i < inbuf - 1; i++) {
-      if (buf[i] == '\r' && buf[i+1] == '\n') {
-          return i;
-      }
-  }
-
-  return -1; // return the location of '\r' if found
-}
-
 int main() {
   int listenfd;
-  int fd, nbytes;
-  char buf[30];
-  int inbuf; // how many bytes currently in buffer?
-  int room; // how much room left in buffer?
-  char *after; // pointer to position after the (valid) data in buf
-  int where; // location of network newline
+  int fd;
+  ssize_t nbytes;
+  ssize_t where; // location of network newline
+  struct rt_bytebuf buf; // bytes received and not yet printed
+  char *line;
 
   struct sockaddr_in peer;
   socklen_t socklen;
 
+  if (rt_bytebuf_init(&buf, READ_SIZE) != 0) {
+    perror("malloc");
+    exit(1);
+  }
+
   listenfd = setup();
   while (1) {
     socklen = sizeof(peer);
@@ -82,48 +75,30 @@ int main() {
     } else {
       printf("New connection on port %d\n", ntohs(peer.sin_port));
 
-      // Receive messages
-      inbuf = 0;          // buffer is empty; has no bytes
-      room = sizeof(buf); // room == capacity of the whole buffer
-      after = buf;        // start writing at beginning of buf
+      // Receive messages; a read may hold several lines, or part of one
+      rt_bytebuf_consume(&buf, rt_bytebuf_len(&buf));
+      while ((nbytes = rt_bytebuf_read(&buf, fd, READ_SIZE)) > 0) {
+        while ((where = rt_bytebuf_find(&buf, "\r\n", 2)) >= 0) {
+          // output the full line, not including the "\r\n"
+          line = rt_bytebuf_data(&buf);
+          line[where] = '\0';
+          printf("Next message: %s\n", line);
 
-      while ((nbytes = read(fd, after, room)) > 0) {
-        // update inbuf
-        inbuf += nbytes;
-        
-        where = find_network_newline(buf, inbuf);
-        
-        if (where >= 0) { // have a full line
+          // remove the full line from the buffer
+          rt_bytebuf_consume(&buf, where + 2);
+        }
 
-          // output the full line, not including the "\r\n"
-          // put a '\0' in the correct place first
-          // (Replace the "\r\n" with appropriate characters so the 
-          // message prints correctly to stdout.)
-          
-          buf[where] = '\n';
-          buf[where + 1] = '\0';
-          
-          printf("Next message: %s", buf);          
-          
-          // update inbuf and remove the full line from the buffer
-          
-          inbuf -= (where + 2);
-          for (int i = 0; i < inbuf; i++) {
-              buf[i] = buf[i + where + 2];
-          }
-          for (int j = inbuf; j < 30; j++) {
-              buf[j] = '\0';
-          }
+        if (rt_bytebuf_len(&buf) > MAX_LINE) {
+          fprintf(stderr, "Line longer than %d bytes, closing connection\n", MAX_LINE);
+          break;
         }
-		
-        // update room and after, in preparation for the next read
-        room = 30 - inbuf;
-        after = buf + inbuf;
-       
+      }
+      if (nbytes < 0) {
+        perror("read");
       }
       close(fd);
     }
   }
+  rt_bytebuf_destroy(&buf);
   return 0;
 }
-   
@@ -9,18 +9,21 @@
 #include <libgen.h>
 #include "ftree.h"
 #include "hash.h"
+#include "bufio.h"
 
 #define MAX_ENTS 100
 
 int INITIAL_FLAG = 1; // 1 for initial call of copy_ftree, 0 afterwards
 
 /*
- * Generates path, given parent and child in file tree
+ * Generates path, given parent and child in file tree.
+ * Exits if the result does not fit in PATH_MAX.
  */
 void set_path(char* path, char *parent, char *child) {
-	strncpy(path, parent, PATH_MAX);
-	path[strlen(parent)] = '/';
-	strncat(path, child, PATH_MAX - strlen(path));
+	if (snprintf(path, PATH_MAX, "%s/%s", parent, child) >= PATH_MAX) {
+		fprintf(stderr, "Path too long: %s/%s\n", parent, child);
+		exit(-1);
+	}
 }
 
 /*
@@ -33,20 +36,29 @@ void overwrite(FILE *src, FILE *dest, char *dest_path, mode_t perms) {
 		exit(-1);
 	}
 	
-	char curr_byte;
-	
-	while(fread(&curr_byte, 1, 1, src) == 1) { // read one byte at a time from src
-		if (fwrite(&curr_byte, 1, 1, dest) != 1) { // write one byte at a time to dest
-			fprintf(stderr, "File write error\n");
-			exit(-1);
-		}
-		if (ferror(src) != 0) {
-			fprintf(stderr, "File stream error\n");
-			exit(-1);
-		}
+	// copy all of src, in the kernel where the file systems allow it
+	if (lseek(fileno(src), 0L, SEEK_SET) < 0) {
+		perror("lseek");
+		exit(-1);
+	}
+	if (rt_copy_fd(fileno(src), fileno(dest)) < 0) {
+		perror("copy");
+		exit(-1);
 	}
 }
 
+/*
+ * Return whether src and dest hash to the same value
+ */
+int same_hash(FILE *src, FILE *dest) {
+	char *src_hash = hash(src), *dest_hash = hash(dest);
+	int same = check_hash(src_hash, dest_hash, BLOCK_SIZE) == BLOCK_SIZE;
+
+	free(src_hash);
+	free(dest_hash);
+	return same;
+}
+
 /*
  * Copy file from src_path to dest_path, overwriting if necessary
  */
@@ -93,7 +105,7 @@ void copy_file(char *src_path, char *dest_path, mode_t perms) {
 				exit(-1);
 			}
 			overwrite(src, dest, dest_path, perms);
-		} else if (hash(src) != hash(dest)) {
+		} else if (!same_hash(src, dest)) {
 			// close and open streams after they're hashed
 			if (fclose(src) == EOF) {
 				perror("fclose");
@@ -144,6 +156,8 @@ int copy_ftree(const char *src, const char *dest) {
    			perror("mkdir");
    			exit(-1);
    		}
+   	} else {
+   		closedir(src_copy);
    	}
 	
 	struct stat src_stat;
@@ -178,11 +192,6 @@ int copy_ftree(const char *src, const char *dest) {
 		}
 	}
 
-	if (closedir(src_dir) < 0) {
-		perror("closedir");
-	    exit(-1);
-	}
-	
 	struct stat curr_stat;
 	char curr_path[PATH_MAX], new_path[PATH_MAX]; // new paths for src and dest in recursive call
 	int r; // for fork parent/child checking
@@ -221,6 +230,8 @@ int copy_ftree(const char *src, const char *dest) {
     				perror("mkdir");
     				exit(-1);
     			}
+    		} else {
+    			closedir(sub_dir);
     		}
     		    		
     		r =  fork();
@@ -230,6 +241,7 @@ int copy_ftree(const char *src, const char *dest) {
     			exit(-1);
     		} else if (r == 0) {
     			// perform recursive copy and set exit status of child process appropriately
+    			closedir(src_dir);
     			exit(copy_ftree(curr_path, new_path));
     		} else if (r > 0) {
     			
@@ -253,6 +265,12 @@ int copy_ftree(const char *src, const char *dest) {
     	}
 		}
 	}
+
+	// the entries point into src_dir, so close it only once they are used
+	if (closedir(src_dir) < 0) {
+		perror("closedir");
+	    exit(-1);
+	}
 	free(src_ents);
     return processes;
 }
@@ -1,7 +1,10 @@
 #ifndef _HASH_H_
 #define _HASH_H_
 
+#define BLOCK_SIZE 8
+
 // Hash manipulation helper functions
 char *hash(FILE *f);
+int check_hash(const char *hash1, const char *hash2, long block_size);
 
 #endif // _HASH_H_
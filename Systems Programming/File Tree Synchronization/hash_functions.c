@@ -3,8 +3,6 @@
 #include <stdlib.h>
 #include "hash.h"
 
-#define BLOCK_SIZE 8
-
 char *hash(FILE *f) {
     // initialize hash_val
     char *hash_val = malloc(sizeof(char)*BLOCK_SIZE);
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*
+ * Load and latency harness for the password path.
+ *
+ * For every requested user count a synthetic password file is generated
+ * under DATA_DIR/<users>/pass.txt, and a fixed, seeded sequence of login
+ * attempts (a mix of valid, bad-password and unknown-user attempts) is
+ * replayed through each mode:
+ *
+ *   checkpasswd - fork/exec ./checkpasswd per check (which in turn
+ *                 forks/execs ./validate), exactly as a user would run it
+ *   validate    - fork/exec ./validate per check, skipping checkpasswd
+ *   scan        - the same linear scan validate does, but in-process
+ *   hash        - the password file is loaded once into a hash table
+ *
+ * Each mode prints one line of key=value pairs with the number of
+ * checks, mismatches against the expected result, checks/sec and the
+ * p50/p99 latency of a single check.
+ */
+
+#define DATA_DIR "bench_data"
+#define MAXLINE 256
+#define DIRLEN 64
+/* size of the userid and password fields checkpasswd reads */
+#define FIELDLEN 10
+/* users are numbered with 7 digits, so the names fit in FIELDLEN */
+#define MAX_USERS 10000000
+
+/* exit codes of validate */
+#define RES_VERIFIED 0
+#define RES_ERROR 1
+#define RES_BAD_PASSWORD 2
+#define RES_BAD_USER 3
+
+/* a single login attempt, as typed into checkpasswd */
+struct attempt {
+    char userid[FIELDLEN];
+    char password[FIELDLEN];
+    int expected;
+};
+
+/* user and password of a line of the password file, for the hash mode */
+struct entry {
+    char *user;
+    char *password;
+};
+
+struct pass_table {
+    struct entry *slots;
+    unsigned long mask;
+    char *data;
+};
+
+static char validate_path[PATH_MAX];
+static char checkpasswd_path[PATH_MAX];
+static unsigned long rng_state = 88172645463325252UL;
+
+/* xorshift64, so the attempt sequence is reproducible for a given seed */
+static unsigned long next_rand(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* name of user i < MAX_USERS; 8 characters, like every field checkpasswd reads */
+static void user_name(char buf[FIELDLEN], long i) {
+    snprintf(buf, FIELDLEN, "u%07lu", (unsigned long)i % MAX_USERS);
+}
+
+static void user_password(char buf[FIELDLEN], long i) {
+    snprintf(buf, FIELDLEN, "p%07lu", (unsigned long)(i * 2654435761UL) % MAX_USERS);
+}
+
+/*
+ * Generate DATA_DIR/<users>/pass.txt unless it already exists, and link
+ * validate next to it, since checkpasswd execs "./validate" and validate
+ * opens "pass.txt" relative to the working directory.
+ */
+static void prepare_dir(char *dir, long users) {
+    char path[PATH_MAX], name[FIELDLEN], password[FIELDLEN];
+    struct stat st;
+    FILE *f;
+    long i;
+
+    mkdir(DATA_DIR, 0755);
+    snprintf(dir, DIRLEN, "%s/%ld", DATA_DIR, users);
+    mkdir(dir, 0755);
+
+    snprintf(path, sizeof(path), "%s/validate", dir);
+    unlink(path);
+    if (symlink(validate_path, path) == -1) {
+        perror("symlink");
+        exit(1);
+    }
+
+    snprintf(path, sizeof(path), "%s/pass.txt", dir);
+    if (stat(path, &st) == 0)
+        return;
+
+    if (!(f = fopen(path, "w"))) {
+        perror("fopen");
+        exit(1);
+    }
+    for (i = 0; i < users; i++) {
+        user_name(name, i);
+        user_password(password, i);
+        fprintf(f, "%s:%s\n", name, password);
+    }
+    if (fclose(f) == EOF) {
+        perror("fclose");
+        exit(1);
+    }
+}
+
+/* Build the attempt sequence, weighted by the valid:bad:unknown mix */
+static struct attempt *make_attempts(int n, long users, int mix[3]) {
+    struct attempt *a = calloc(n, sizeof(struct attempt));
+    int total = mix[0] + mix[1] + mix[2];
+    int i, pick;
+    long u;
+
+    if (!a) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < n; i++) {
+        pick = next_rand() % total;
+        u = next_rand() % users;
+        if (pick < mix[0]) {
+            user_name(a[i].userid, u);
+            user_password(a[i].password, u);
+            a[i].expected = RES_VERIFIED;
+        } else if (pick < mix[0] + mix[1]) {
+            user_name(a[i].userid, u);
+            snprintf(a[i].password, FIELDLEN, "q%07ld", u % MAX_USERS);
+            a[i].expected = RES_BAD_PASSWORD;
+        } else {
+            snprintf(a[i].userid, FIELDLEN, "x%07ld", u % MAX_USERS);
+            user_password(a[i].password, u);
+            a[i].expected = RES_BAD_USER;
+        }
+    }
+    return a;
+}
+
+/* Run checkpasswd in dir with the attempt typed on its stdin */
+static int check_checkpasswd(char *dir, struct attempt *a) {
+    int in[2], out[2], status, n, len = 0;
+    char input[32], output[MAXLINE];
+    pid_t pid;
+
+    if (pipe(in) == -1 || pipe(out) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        close(in[1]);
+        close(out[0]);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        if (chdir(dir) == -1) {
+            perror("chdir");
+            exit(1);
+        }
+        execl(checkpasswd_path, "checkpasswd", NULL);
+        perror("exec");
+        exit(1);
+    }
+    close(in[0]);
+    close(out[1]);
+    n = snprintf(input, sizeof(input), "%s\n%s\n", a->userid, a->password);
+    if (write(in[1], input, n) == -1) {
+        perror("write to pipe");
+    }
+    close(in[1]);
+    while (len < MAXLINE - 1 && (n = read(out[0], output + len, MAXLINE - 1 - len)) > 0) {
+        len += n;
+    }
+    output[len] = '\0';
+    close(out[0]);
+    waitpid(pid, &status, 0);
+
+    if (strstr(output, "Password verified"))
+        return RES_VERIFIED;
+    if (strstr(output, "Invalid password"))
+        return RES_BAD_PASSWORD;
+    if (strstr(output, "No such user"))
+        return RES_BAD_USER;
+    return RES_ERROR;
+}
+
+/* Run validate in dir, writing the two 10 byte chunks checkpasswd would */
+static int check_validate(char *dir, struct attempt *a) {
+    int fd[2], status;
+    pid_t pid;
+
+    if (pipe(fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        close(fd[1]);
+        dup2(fd[0], STDIN_FILENO);
+        if (chdir(dir) == -1) {
+            perror("chdir");
+            exit(1);
+        }
+        execl(validate_path, "validate", NULL);
+        perror("exec");
+        exit(1);
+    }
+    close(fd[0]);
+    if (write(fd[1], a->userid, sizeof(a->userid)) == -1 ||
+        write(fd[1], a->password, sizeof(a->password)) == -1) {
+        perror("write to pipe");
+    }
+    close(fd[1]);
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status))
+        return RES_ERROR;
+    return WEXITSTATUS(status);
+}
+
+/* validate's matching loop, run in-process against dir/pass.txt */
+static int check_scan(char *dir, struct attempt *a) {
+    char path[PATH_MAX], userid[30], line[MAXLINE];
+    int user_length, result = RES_BAD_USER;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/pass.txt", dir);
+    snprintf(userid, sizeof(userid), "%s:", a->userid);
+    user_length = strlen(userid);
+    strcat(userid, a->password);
+    if (!(fp = fopen(path, "r"))) {
+        perror("fopen");
+        exit(1);
+    }
+    while (fgets(line, sizeof(line) - 1, fp)) {
+        line[strlen(line) - 1] = '\0';
+        if (strcmp(userid, line) == 0) {
+            result = RES_VERIFIED;
+            break;
+        } else if (strncmp(userid, line, user_length) == 0) {
+            result = RES_BAD_PASSWORD;
+            break;
+        }
+    }
+    fclose(fp);
+    return result;
+}
+
+static unsigned long hash_str(const char *s) {
+    unsigned long h = 14695981039346656037UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/*
+ * Load dir/pass.txt into an open addressing table keyed by user id.
+ * As in validate, the first line for a user wins.
+ */
+static void load_table(struct pass_table *t, char *dir, long users) {
+    char path[PATH_MAX], *p, *end, *colon;
+    unsigned long size = 2, i;
+    struct stat st;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/pass.txt", dir);
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror("open");
+        exit(1);
+    }
+    while (size < (unsigned long)users * 2)
+        size <<= 1;
+    t->mask = size - 1;
+    t->slots = calloc(size, sizeof(struct entry));
+    t->data = malloc(st.st_size + 1);
+    if (!t->slots || !t->data) {
+        perror("malloc");
+        exit(1);
+    }
+    if (read(fd, t->data, st.st_size) != st.st_size) {
+        perror("read");
+        exit(1);
+    }
+    close(fd);
+    t->data[st.st_size] = '\0';
+
+    for (p = t->data; *p; p = end + 1) {
+        if (!(end = strchr(p, '\n')))
+            break;
+        *end = '\0';
+        if (!(colon = strchr(p, ':')))
+            continue;
+        *colon = '\0';
+        for (i = hash_str(p) & t->mask; t->slots[i].user; i = (i + 1) & t->mask) {
+            if (strcmp(t->slots[i].user, p) == 0)
+                break;
+        }
+        if (!t->slots[i].user) {
+            t->slots[i].user = p;
+            t->slots[i].password = colon + 1;
+        }
+    }
+}
+
+static int check_hash(struct pass_table *t, struct attempt *a) {
+    unsigned long i;
+
+    for (i = hash_str(a->userid) & t->mask; t->slots[i].user; i = (i + 1) & t->mask) {
+        if (strcmp(t->slots[i].user, a->userid) == 0) {
+            if (strcmp(t->slots[i].password, a->password) == 0)
+                return RES_VERIFIED;
+            return RES_BAD_PASSWORD;
+        }
+    }
+    return RES_BAD_USER;
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Replay the attempts through one mode, stopping early once the time
+ * budget is used up, and print the throughput and latency line.
+ */
+static void run_mode(const char *mode, char *dir, long users,
+                     struct attempt *attempts, int n, double budget) {
+    struct pass_table table = {NULL, 0, NULL};
+    long *lat, start, t0, elapsed;
+    int i, result, errors = 0;
+
+    if (strcmp(mode, "hash") == 0)
+        load_table(&table, dir, users);
+    if (!(lat = malloc(sizeof(long) * n))) {
+        perror("malloc");
+        exit(1);
+    }
+
+    start = now_ns();
+    for (i = 0; i < n; i++) {
+        t0 = now_ns();
+        if (strcmp(mode, "checkpasswd") == 0)
+            result = check_checkpasswd(dir, &attempts[i]);
+        else if (strcmp(mode, "validate") == 0)
+            result = check_validate(dir, &attempts[i]);
+        else if (strcmp(mode, "scan") == 0)
+            result = check_scan(dir, &attempts[i]);
+        else
+            result = check_hash(&table, &attempts[i]);
+        lat[i] = now_ns() - t0;
+        if (result != attempts[i].expected)
+            errors++;
+        if ((lat[i] + t0 - start) / 1e9 > budget) {
+            i++;
+            break;
+        }
+    }
+    elapsed = now_ns() - start;
+    n = i;
+
+    qsort(lat, n, sizeof(long), cmp_long);
+    printf("mode=%s users=%ld checks=%d errors=%d checks_per_sec=%.1f "
+           "p50_us=%.1f p99_us=%.1f\n", mode, users, n, errors,
+           n / (elapsed / 1e9), lat[n / 2] / 1e3, lat[(n * 99) / 100] / 1e3);
+    fflush(stdout);
+
+    free(lat);
+    if (strcmp(mode, "hash") == 0) {
+        free(table.slots);
+        free(table.data);
+    }
+}
+
+static void usage(char *prog) {
+    fprintf(stderr, "Usage: %s [-n attempts] [-m valid:badpw:unknown] [-t seconds]\n"
+            "       [-s seed] [-M mode,...] users...\n"
+            "modes: checkpasswd, validate, scan, hash\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    char modes[MAXLINE] = "checkpasswd,validate,scan,hash";
+    char dir[DIRLEN], mode_list[MAXLINE], *mode;
+    int attempts = 1000, mix[3] = {60, 20, 20};
+    double budget = 10.0;
+    struct attempt *a;
+    long users;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "n:m:t:s:M:")) != -1) {
+        switch (opt) {
+        case 'n':
+            attempts = atoi(optarg);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%d:%d:%d", &mix[0], &mix[1], &mix[2]) != 3 ||
+                mix[0] < 0 || mix[1] < 0 || mix[2] < 0 ||
+                mix[0] + mix[1] + mix[2] == 0)
+                usage(argv[0]);
+            break;
+        case 't':
+            budget = atof(optarg);
+            break;
+        case 's':
+            rng_state = strtoul(optarg, NULL, 10) | 1;
+            break;
+        case 'M':
+            snprintf(modes, sizeof(modes), "%s", optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc || attempts <= 0)
+        usage(argv[0]);
+
+    if (!realpath("./validate", validate_path) ||
+        !realpath("./checkpasswd", checkpasswd_path)) {
+        perror("validate and checkpasswd must be built");
+        exit(1);
+    }
+
+    for (i = optind; i < argc; i++) {
+        if ((users = atol(argv[i])) <= 0 || users > MAX_USERS)
+            usage(argv[0]);
+        prepare_dir(dir, users);
+        a = make_attempts(attempts, users, mix);
+
+        snprintf(mode_list, sizeof(mode_list), "%s", modes);
+        for (mode = strtok(mode_list, ","); mode; mode = strtok(NULL, ",")) {
+            if (strcmp(mode, "checkpasswd") && strcmp(mode, "validate") &&
+                strcmp(mode, "scan") && strcmp(mode, "hash"))
+                usage(argv[0]);
+            run_mode(mode, dir, users, a, attempts, budget);
+        }
+        free(a);
+    }
+
+    return 0;
+}
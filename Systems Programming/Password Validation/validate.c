@@ -17,7 +17,7 @@
 int main(void){
     int n, user_length;
     char userid[30];
-    char password[10];
+    char password[11];
     
     if ((n = read(STDIN_FILENO, userid, 10)) == -1) {
         perror("read");
@@ -0,0 +1,40 @@
+# Turns the lines of key=value pairs every benchmark prints into one
+# JSON report, {"profile": ..., "results": [{...}, ...]}; other lines
+# are skipped. Values that read as numbers are written as numbers.
+#
+#	awk -v profile=release -v cflags=-O2 -v date=... -f bench_json.awk log
+
+function quote(s) {
+	gsub(/\\/, "\\\\", s)
+	gsub(/"/, "\\\"", s)
+	gsub(/\t/, "\\t", s)
+	return "\"" s "\""
+}
+
+function value(v) {
+	if (v ~ /^-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][-+]?[0-9]+)?$/)
+		return v
+	return quote(v)
+}
+
+BEGIN {
+	printf "{\n  \"profile\": %s,\n  \"cflags\": %s,\n  \"date\": %s,\n  \"results\": [",
+		quote(profile), quote(cflags), quote(date)
+	n = 0
+}
+
+{
+	for (i = 1; i <= NF; i++)
+		if ($i !~ /^[A-Za-z_][A-Za-z0-9_]*=/)
+			next
+	obj = ""
+	for (i = 1; i <= NF; i++) {
+		eq = index($i, "=")
+		obj = obj (i > 1 ? ", " : "") quote(substr($i, 1, eq - 1)) ": " value(substr($i, eq + 1))
+	}
+	printf "%s\n    {%s}", n++ ? "," : "", obj
+}
+
+END {
+	printf "%s]\n}\n", n ? "\n  " : ""
+}
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include "arena.h"
+
+static struct rt_arena_chunk *new_chunk(size_t size) {
+	struct rt_arena_chunk *c;
+
+	if ((c = malloc(sizeof(struct rt_arena_chunk) + size)) == NULL)
+		return NULL;
+	c->next = NULL;
+	c->size = size;
+	return c;
+}
+
+/**
+ * Prepare an empty arena that takes memory chunk_size bytes at a time.
+ * Returns -1 if the first chunk could not be allocated.
+ */
+int rt_arena_init(struct rt_arena *a, size_t chunk_size) {
+	a->chunk_size = chunk_size;
+	if ((a->chunks = new_chunk(chunk_size)) == NULL)
+		return -1;
+	a->next = a->chunks->data;
+	a->end = a->next + chunk_size;
+	return 0;
+}
+
+void rt_arena_destroy(struct rt_arena *a) {
+	struct rt_arena_chunk *c, *next;
+
+	for (c = a->chunks; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	a->chunks = NULL;
+	a->next = a->end = NULL;
+}
+
+/**
+ * Free everything allocated from the arena at once. The newest chunk
+ * is kept for the allocations that follow; the others are freed.
+ */
+void rt_arena_reset(struct rt_arena *a) {
+	struct rt_arena_chunk *c, *next;
+
+	for (c = a->chunks->next; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	a->chunks->next = NULL;
+	a->next = a->chunks->data;
+	a->end = a->next + a->chunks->size;
+}
+
+/**
+ * Slow path of rt_arena_alloc: start a new chunk and allocate from it;
+ * the rest of the old chunk is wasted. An object too large to share a
+ * chunk with others gets one of its own, and the old chunk stays in
+ * use.
+ */
+void *rt_arena_grow(struct rt_arena *a, size_t size) {
+	struct rt_arena_chunk *c;
+
+	if (size > a->chunk_size / 4) {
+		if ((c = new_chunk(size)) == NULL)
+			return NULL;
+		c->next = a->chunks->next;
+		a->chunks->next = c;
+		return c->data;
+	}
+
+	if ((c = new_chunk(a->chunk_size)) == NULL)
+		return NULL;
+	c->next = a->chunks;
+	a->chunks = c;
+	a->next = c->data + size;
+	a->end = c->data + c->size;
+	return c->data;
+}
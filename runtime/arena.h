@@ -0,0 +1,53 @@
+#ifndef _RT_ARENA_H
+#define _RT_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Arena allocator: objects are carved out of large chunks by bumping a
+ * pointer, and are only ever freed all at once, by rt_arena_reset or
+ * rt_arena_destroy. Allocation is a compare and an add unless the
+ * current chunk is used up. An arena must only be used by one thread
+ * at a time.
+ */
+
+/* alignment of everything rt_arena_alloc returns */
+#define RT_ARENA_ALIGN		16
+
+struct rt_arena_chunk {
+	struct rt_arena_chunk *next;
+	size_t size;
+	char data[] __attribute__((aligned(RT_ARENA_ALIGN)));
+};
+
+struct rt_arena {
+	/* the chunk being carved, first in the list */
+	struct rt_arena_chunk *chunks;
+	char *next;
+	char *end;
+
+	/* size of a new chunk, unless an object needs a larger one */
+	size_t chunk_size;
+};
+
+int rt_arena_init(struct rt_arena *a, size_t chunk_size);
+void rt_arena_destroy(struct rt_arena *a);
+void rt_arena_reset(struct rt_arena *a);
+
+void *rt_arena_grow(struct rt_arena *a, size_t size);
+
+/**
+ * Allocate size bytes, aligned to RT_ARENA_ALIGN, that stay valid until
+ * the arena is reset or destroyed. Returns NULL if out of memory.
+ */
+static inline void *rt_arena_alloc(struct rt_arena *a, size_t size) {
+	char *p = a->next;
+
+	size = (size + RT_ARENA_ALIGN - 1) & ~(size_t) (RT_ARENA_ALIGN - 1);
+	if ((size_t) (a->end - p) < size)
+		return rt_arena_grow(a, size);
+	a->next = p + size;
+	return p;
+}
+
+#endif /* _RT_ARENA_H */
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "bufio.h"
+
+/* bytes moved at a time by rt_copy_fd when it has to copy through memory */
+#define COPY_BUFFER	(128 * 1024)
+
+/**
+ * Prepare to read fd through a buffer of size bytes.
+ * Returns -1 if out of memory.
+ */
+int rt_reader_init(struct rt_reader *r, int fd, size_t size) {
+	r->fd = fd;
+	r->size = size;
+	r->pos = r->len = 0;
+	r->buf = malloc(size);
+	return r->buf ? 0 : -1;
+}
+
+void rt_reader_destroy(struct rt_reader *r) {
+	free(r->buf);
+	r->buf = NULL;
+}
+
+/**
+ * Refill the buffer, which must be empty, with one read. Returns the
+ * number of bytes read, 0 at end of file, or -1 on error; errno is 0
+ * at end of file.
+ */
+int rt_reader_fill(struct rt_reader *r) {
+	ssize_t n;
+
+	do {
+		n = read(r->fd, r->buf, r->size);
+	} while (n == -1 && errno == EINTR);
+	if (n == 0)
+		errno = 0;
+	r->pos = 0;
+	r->len = n > 0 ? n : 0;
+	return n;
+}
+
+/**
+ * Read n bytes into dst, fewer only at end of file. Reads of at least a
+ * buffer's worth bypass the buffer. Returns the number of bytes read,
+ * or -1 on error.
+ */
+ssize_t rt_reader_read(struct rt_reader *r, void *dst, size_t n) {
+	char *d = dst;
+	size_t done = 0, k;
+	ssize_t got;
+
+	while (done < n) {
+		if (r->pos < r->len) {
+			k = r->len - r->pos < n - done ? r->len - r->pos : n - done;
+			memcpy(d + done, r->buf + r->pos, k);
+			r->pos += k;
+			done += k;
+		} else if (n - done >= r->size) {
+			got = read(r->fd, d + done, n - done);
+			if (got == -1 && errno == EINTR)
+				continue;
+			if (got <= 0)
+				return got == 0 ? (ssize_t) done : -1;
+			done += got;
+		} else {
+			got = rt_reader_fill(r);
+			if (got <= 0)
+				return got == 0 ? (ssize_t) done : -1;
+		}
+	}
+	return done;
+}
+
+/**
+ * Write all n bytes from src to fd, retrying partial and interrupted
+ * writes. Returns n, or -1 on error.
+ */
+ssize_t rt_write_full(int fd, const void *src, size_t n) {
+	const char *s = src;
+	size_t done = 0;
+	ssize_t k;
+
+	while (done < n) {
+		k = write(fd, s + done, n - done);
+		if (k == -1 && errno == EINTR)
+			continue;
+		if (k == -1)
+			return -1;
+		done += k;
+	}
+	return n;
+}
+
+/**
+ * Prepare to write fd through a buffer of size bytes.
+ * Returns -1 if out of memory.
+ */
+int rt_writer_init(struct rt_writer *w, int fd, size_t size) {
+	w->fd = fd;
+	w->size = size;
+	w->len = 0;
+	w->buf = malloc(size);
+	return w->buf ? 0 : -1;
+}
+
+/**
+ * Write out what is buffered. Returns -1 on error, in which case the
+ * bytes stay buffered.
+ */
+int rt_writer_flush(struct rt_writer *w) {
+	if (w->len > 0 && rt_write_full(w->fd, w->buf, w->len) == -1)
+		return -1;
+	w->len = 0;
+	return 0;
+}
+
+/**
+ * Flush and free the buffer. Returns -1 if the flush failed.
+ */
+int rt_writer_destroy(struct rt_writer *w) {
+	int ret = rt_writer_flush(w);
+
+	free(w->buf);
+	w->buf = NULL;
+	return ret;
+}
+
+/**
+ * Append n bytes from src. Writes of at least a buffer's worth bypass
+ * the buffer. Returns -1 on error.
+ */
+int rt_writer_write(struct rt_writer *w, const void *src, size_t n) {
+	if (w->size - w->len >= n) {
+		memcpy(w->buf + w->len, src, n);
+		w->len += n;
+		return 0;
+	}
+	if (rt_writer_flush(w) != 0)
+		return -1;
+	if (n >= w->size)
+		return rt_write_full(w->fd, src, n) == -1 ? -1 : 0;
+	memcpy(w->buf, src, n);
+	w->len = n;
+	return 0;
+}
+
+/**
+ * Copy everything from the current offset of in to the end of file to
+ * out. The kernel copies between files itself where it can; otherwise
+ * the bytes go through a buffer of COPY_BUFFER bytes. Returns the
+ * number of bytes copied, or -1 on error.
+ */
+ssize_t rt_copy_fd(int in, int out) {
+	ssize_t n, total = 0;
+	char *buf;
+
+	for (;;) {
+		n = copy_file_range(in, NULL, out, NULL, COPY_BUFFER * 64, 0);
+		if (n > 0) {
+			total += n;
+			continue;
+		}
+		if (n == 0)
+			return total;
+		if (errno == EINTR)
+			continue;
+		// not both regular files, or not on a file system that can
+		if (total == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+			errno == EOPNOTSUPP || errno == EBADF))
+			break;
+		return -1;
+	}
+
+	if ((buf = malloc(COPY_BUFFER)) == NULL)
+		return -1;
+	for (;;) {
+		n = read(in, buf, COPY_BUFFER);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		if (rt_write_full(out, buf, n) == -1) {
+			n = -1;
+			break;
+		}
+		total += n;
+	}
+	free(buf);
+	return n == -1 ? -1 : total;
+}
@@ -0,0 +1,66 @@
+#ifndef _RT_BUFIO_H
+#define _RT_BUFIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Buffered reading and writing of file descriptors, and copying between
+ * them. Unlike stdio, every call reports errors to the caller, as -1
+ * with errno set, and retries reads and writes that are interrupted or
+ * only partly done, so callers can decide what an error means.
+ */
+
+struct rt_reader {
+	int fd;
+	char *buf;
+	size_t size;
+
+	/* the unread bytes are buf[pos..len) */
+	size_t pos;
+	size_t len;
+};
+
+struct rt_writer {
+	int fd;
+	char *buf;
+	size_t size;
+
+	/* bytes in buf not written yet */
+	size_t len;
+};
+
+int rt_reader_init(struct rt_reader *r, int fd, size_t size);
+void rt_reader_destroy(struct rt_reader *r);
+ssize_t rt_reader_read(struct rt_reader *r, void *dst, size_t n);
+int rt_reader_fill(struct rt_reader *r);
+
+int rt_writer_init(struct rt_writer *w, int fd, size_t size);
+int rt_writer_destroy(struct rt_writer *w);
+int rt_writer_write(struct rt_writer *w, const void *src, size_t n);
+int rt_writer_flush(struct rt_writer *w);
+
+ssize_t rt_write_full(int fd, const void *src, size_t n);
+ssize_t rt_copy_fd(int in, int out);
+
+/**
+ * Returns the next byte, or -1 at end of file or on error (errno is
+ * then set and non-zero).
+ */
+static inline int rt_reader_getc(struct rt_reader *r) {
+	if (r->pos == r->len && rt_reader_fill(r) <= 0)
+		return -1;
+	return (unsigned char) r->buf[r->pos++];
+}
+
+/**
+ * Append one byte. Returns -1 on error.
+ */
+static inline int rt_writer_putc(struct rt_writer *w, int c) {
+	if (w->len == w->size && rt_writer_flush(w) != 0)
+		return -1;
+	w->buf[w->len++] = c;
+	return 0;
+}
+
+#endif /* _RT_BUFIO_H */
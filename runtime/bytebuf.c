@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "bytebuf.h"
+
+/**
+ * Prepare an empty buffer with room for cap bytes to start with.
+ * Returns -1 if out of memory.
+ */
+int rt_bytebuf_init(struct rt_bytebuf *b, size_t cap) {
+	b->start = b->len = 0;
+	b->cap = cap > 0 ? cap : 1;
+	b->data = malloc(b->cap);
+	return b->data ? 0 : -1;
+}
+
+void rt_bytebuf_destroy(struct rt_bytebuf *b) {
+	free(b->data);
+	b->data = NULL;
+}
+
+/**
+ * Make room for n more bytes after the ones held, moving them to the
+ * front or growing the buffer if need be. Returns -1 if out of memory.
+ */
+int rt_bytebuf_reserve(struct rt_bytebuf *b, size_t n) {
+	size_t cap = b->cap;
+	char *data;
+
+	if (b->cap - b->start - b->len >= n)
+		return 0;
+	if (b->start > 0) {
+		memmove(b->data, b->data + b->start, b->len);
+		b->start = 0;
+		if (b->cap - b->len >= n)
+			return 0;
+	}
+	while (cap - b->len < n)
+		cap *= 2;
+	if ((data = realloc(b->data, cap)) == NULL)
+		return -1;
+	b->data = data;
+	b->cap = cap;
+	return 0;
+}
+
+/**
+ * Append n bytes from p. Returns -1 if out of memory.
+ */
+int rt_bytebuf_append(struct rt_bytebuf *b, const void *p, size_t n) {
+	if (rt_bytebuf_reserve(b, n) != 0)
+		return -1;
+	memcpy(b->data + b->start + b->len, p, n);
+	b->len += n;
+	return 0;
+}
+
+/**
+ * Append what one read of up to max bytes from fd returns. Returns the
+ * number of bytes read, 0 at end of file, or -1 with errno set.
+ */
+ssize_t rt_bytebuf_read(struct rt_bytebuf *b, int fd, size_t max) {
+	ssize_t n;
+
+	if (rt_bytebuf_reserve(b, max) != 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	n = read(fd, b->data + b->start + b->len, max);
+	if (n > 0)
+		b->len += n;
+	return n;
+}
+
+/**
+ * Drop the first n bytes held (all of them if there are fewer).
+ */
+void rt_bytebuf_consume(struct rt_bytebuf *b, size_t n) {
+	if (n >= b->len) {
+		b->start = b->len = 0;
+		return;
+	}
+	b->start += n;
+	b->len -= n;
+}
+
+/**
+ * Returns the offset of the first occurrence of pat in the bytes held,
+ * or -1 if there is none.
+ */
+ssize_t rt_bytebuf_find(const struct rt_bytebuf *b, const void *pat, size_t patlen) {
+	const char *data = rt_bytebuf_data(b), *p;
+
+	if (patlen == 1)
+		p = memchr(data, *(const char *) pat, b->len);
+	else
+		p = memmem(data, b->len, pat, patlen);
+	return p ? p - data : -1;
+}
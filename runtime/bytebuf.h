@@ -0,0 +1,41 @@
+#ifndef _RT_BYTEBUF_H
+#define _RT_BYTEBUF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Growable byte buffer for framing streams: bytes are appended at the
+ * end (or read into it straight from a file descriptor) and consumed
+ * from the front. Consuming only moves the start of the data; the data
+ * is moved back to the front of the buffer only when the room at the
+ * end runs out, and the buffer doubles only when that is not enough.
+ */
+struct rt_bytebuf {
+	char *data;
+
+	/* the bytes held are data[start..start + len) */
+	size_t start;
+	size_t len;
+	size_t cap;
+};
+
+int rt_bytebuf_init(struct rt_bytebuf *b, size_t cap);
+void rt_bytebuf_destroy(struct rt_bytebuf *b);
+
+int rt_bytebuf_reserve(struct rt_bytebuf *b, size_t n);
+int rt_bytebuf_append(struct rt_bytebuf *b, const void *p, size_t n);
+ssize_t rt_bytebuf_read(struct rt_bytebuf *b, int fd, size_t max);
+void rt_bytebuf_consume(struct rt_bytebuf *b, size_t n);
+ssize_t rt_bytebuf_find(const struct rt_bytebuf *b, const void *pat, size_t patlen);
+
+/* The bytes held, rt_bytebuf_len of them */
+static inline char *rt_bytebuf_data(const struct rt_bytebuf *b) {
+	return b->data + b->start;
+}
+
+static inline size_t rt_bytebuf_len(const struct rt_bytebuf *b) {
+	return b->len;
+}
+
+#endif /* _RT_BYTEBUF_H */
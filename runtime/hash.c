@@ -0,0 +1,65 @@
+#include <string.h>
+#include "hash.h"
+
+#define P0	0xa0761d6478bd642fULL
+#define P1	0xe7037ed1a0b428dbULL
+#define P2	0x8ebc6af09c88c6e3ULL
+
+/* Fold the 128-bit product of a and b into 64 bits */
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t) a * b;
+
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t read32(const unsigned char *p) {
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+ * Returns a 64-bit hash of len bytes at key; different seeds give
+ * unrelated hashes of the same key.
+ */
+uint64_t rt_hash64(const void *key, size_t len, uint64_t seed) {
+	const unsigned char *p = key;
+	uint64_t h = seed ^ P0, a = 0, b = 0;
+	size_t left = len;
+
+	for (; left > 16; left -= 16, p += 16)
+		h = mix(read64(p) ^ P1, read64(p + 8) ^ h);
+
+	// the last 1 to 16 bytes, read as two possibly overlapping words
+	if (left >= 8) {
+		a = read64(p);
+		b = read64(p + left - 8);
+	} else if (left >= 4) {
+		a = read32(p);
+		b = read32(p + left - 4);
+	} else if (left > 0) {
+		a = (uint64_t) p[0] << 16 | (uint64_t) p[left / 2] << 8 | p[left - 1];
+	}
+	h = mix(a ^ P1, b ^ h);
+	return mix(h ^ P2, len ^ P1);
+}
+
+uint64_t rt_fnv1a64(const void *key, size_t len) {
+	const unsigned char *p = key;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
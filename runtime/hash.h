@@ -0,0 +1,31 @@
+#ifndef _RT_HASH_H
+#define _RT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hashing of byte strings for hash tables and checksums; not for
+ * anything that must resist an attacker.
+ *
+ * rt_hash64 reads its input 16 bytes at a time and mixes each block in
+ * with one 64x64->128 bit multiply, so long keys hash at several bytes
+ * per cycle; short keys take a handful of multiplies. rt_fnv1a64 is the
+ * plain byte at a time FNV-1a, kept as the reference it is measured
+ * against.
+ */
+
+uint64_t rt_hash64(const void *key, size_t len, uint64_t seed);
+uint64_t rt_fnv1a64(const void *key, size_t len);
+
+/* Hash of one 64-bit integer, e.g. a pointer or an id */
+static inline uint64_t rt_hash_u64(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+#endif /* _RT_HASH_H */
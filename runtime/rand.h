@@ -0,0 +1,24 @@
+#ifndef _RT_RAND_H
+#define _RT_RAND_H
+
+/*
+ * Cheap pseudo-random numbers for workloads and tests: xorshift32,
+ * which goes through every non-zero 32-bit value before repeating. A
+ * given seed always gives the same sequence, so a run can be repeated;
+ * not for anything that must be hard to predict.
+ */
+
+/**
+ * Returns the next number after *state and makes it the new state,
+ * which must be non-zero and then stays so.
+ */
+static inline unsigned int rt_rand32(unsigned int *state) {
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+#endif /* _RT_RAND_H */
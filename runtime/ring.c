@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include "ring.h"
+
+static size_t round_up(size_t capacity) {
+	size_t n = 2;
+
+	while (n < capacity)
+		n *= 2;
+	return n;
+}
+
+/**
+ * Prepare an empty ring of at least capacity items, rounded up to a
+ * power of 2. Returns -1 if out of memory.
+ */
+int rt_spsc_init(struct rt_spsc *r, size_t capacity) {
+	capacity = round_up(capacity);
+	r->head = r->cached_tail = 0;
+	r->tail = r->cached_head = 0;
+	r->mask = capacity - 1;
+	r->slots = calloc(capacity, sizeof(void *));
+	return r->slots ? 0 : -1;
+}
+
+void rt_spsc_destroy(struct rt_spsc *r) {
+	free(r->slots);
+	r->slots = NULL;
+}
+
+/**
+ * Append item. Returns -1 if the ring is full.
+ * Must only be called from the producer thread.
+ */
+int rt_spsc_push(struct rt_spsc *r, void *item) {
+	size_t tail = r->tail;
+
+	if (tail - r->cached_head > r->mask) {
+		r->cached_head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (tail - r->cached_head > r->mask)
+			return -1;
+	}
+	r->slots[tail & r->mask] = item;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Remove the oldest item into *item. Returns -1 if the ring is empty.
+ * Must only be called from the consumer thread.
+ */
+int rt_spsc_pop(struct rt_spsc *r, void **item) {
+	size_t head = r->head;
+
+	if (head == r->cached_tail) {
+		r->cached_tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head == r->cached_tail)
+			return -1;
+	}
+	*item = r->slots[head & r->mask];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Append as many of items[0..n) as fit, with a single update of tail.
+ * Returns the number appended, 0 if the ring is full.
+ * Must only be called from the producer thread.
+ */
+size_t rt_spsc_push_batch(struct rt_spsc *r, void *const *items, size_t n) {
+	size_t tail = r->tail, room = r->mask + 1 - (tail - r->cached_head), i;
+
+	if (room < n) {
+		r->cached_head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		room = r->mask + 1 - (tail - r->cached_head);
+	}
+	if (n > room)
+		n = room;
+	for (i = 0; i < n; i++)
+		r->slots[(tail + i) & r->mask] = items[i];
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/**
+ * Remove up to max of the oldest items into items, with a single update
+ * of head. Returns the number removed, 0 if the ring is empty.
+ * Must only be called from the consumer thread.
+ */
+size_t rt_spsc_pop_batch(struct rt_spsc *r, void **items, size_t max) {
+	size_t head = r->head, n = r->cached_tail - head, i;
+
+	if (n < max) {
+		r->cached_tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		n = r->cached_tail - head;
+	}
+	if (n > max)
+		n = max;
+	for (i = 0; i < n; i++)
+		items[i] = r->slots[(head + i) & r->mask];
+	__atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/**
+ * Prepare an empty queue of at least capacity items, rounded up to a
+ * power of 2. Returns -1 if out of memory.
+ */
+int rt_mpmc_init(struct rt_mpmc *q, size_t capacity) {
+	size_t i;
+
+	capacity = round_up(capacity);
+	if ((q->cells = aligned_alloc(RT_CACHE_LINE,
+		(capacity * sizeof(struct rt_mpmc_cell) + RT_CACHE_LINE - 1) & ~(size_t) (RT_CACHE_LINE - 1))) == NULL)
+		return -1;
+	for (i = 0; i < capacity; i++)
+		q->cells[i].seq = i;
+	q->mask = capacity - 1;
+	q->enqueue_pos = 0;
+	q->dequeue_pos = 0;
+	return 0;
+}
+
+void rt_mpmc_destroy(struct rt_mpmc *q) {
+	free(q->cells);
+	q->cells = NULL;
+}
+
+/**
+ * Append item. Returns -1 if the queue is full.
+ */
+int rt_mpmc_push(struct rt_mpmc *q, void *item) {
+	struct rt_mpmc_cell *c;
+	size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED), seq;
+	long diff;
+
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - pos);
+		if (diff == 0) {
+			// the cell is free for this lap; claim it
+			if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// still holds the item of the last lap
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	c->item = item;
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Remove the oldest item into *item. Returns -1 if the queue is empty.
+ */
+int rt_mpmc_pop(struct rt_mpmc *q, void **item) {
+	struct rt_mpmc_cell *c;
+	size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED), seq;
+	long diff;
+
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// no item has been put in it yet
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	*item = c->item;
+	__atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return 0;
+}
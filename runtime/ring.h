@@ -0,0 +1,68 @@
+#ifndef _RT_RING_H
+#define _RT_RING_H
+
+#include <stddef.h>
+
+#define RT_CACHE_LINE		64
+
+/*
+ * Bounded lock-free queues of pointers. Neither ever blocks: a push to
+ * a full queue or a pop from an empty one fails at once, and the caller
+ * decides whether to spin, yield or sleep (see spsc.c in Traffic
+ * Intersection for a ring that parks on a futex instead).
+ *
+ * rt_spsc is for one producer and one consumer thread. head and tail
+ * are free running counters, each written by one side only; each side
+ * keeps a copy of the other's counter and only rereads it when the
+ * copy says the ring is full or empty, so the two sides rarely touch
+ * each other's cache lines.
+ *
+ * rt_mpmc is for any number of producers and consumers. Every cell
+ * carries a sequence number that says whose turn it is: a producer
+ * claims position pos by moving enqueue_pos from pos to pos + 1 once
+ * the cell's sequence is pos, and hands it on by setting it to pos + 1;
+ * a consumer takes it when it is pos + 1 and frees it for the next lap
+ * with pos + capacity.
+ */
+
+struct rt_spsc {
+	/* written by the consumer */
+	size_t head __attribute__((aligned(RT_CACHE_LINE)));
+	size_t cached_tail;
+
+	/* written by the producer */
+	size_t tail __attribute__((aligned(RT_CACHE_LINE)));
+	size_t cached_head;
+
+	/* read only after init; capacity - 1, capacity a power of 2 */
+	void **slots __attribute__((aligned(RT_CACHE_LINE)));
+	size_t mask;
+};
+
+int rt_spsc_init(struct rt_spsc *r, size_t capacity);
+void rt_spsc_destroy(struct rt_spsc *r);
+int rt_spsc_push(struct rt_spsc *r, void *item);
+int rt_spsc_pop(struct rt_spsc *r, void **item);
+size_t rt_spsc_push_batch(struct rt_spsc *r, void *const *items, size_t n);
+size_t rt_spsc_pop_batch(struct rt_spsc *r, void **items, size_t max);
+
+struct rt_mpmc_cell {
+	size_t seq;
+	void *item;
+};
+
+struct rt_mpmc {
+	size_t enqueue_pos __attribute__((aligned(RT_CACHE_LINE)));
+	size_t dequeue_pos __attribute__((aligned(RT_CACHE_LINE)));
+
+	/* read only after init; capacity - 1, capacity a power of 2 */
+	struct rt_mpmc_cell *cells __attribute__((aligned(RT_CACHE_LINE)));
+	size_t mask;
+};
+
+int rt_mpmc_init(struct rt_mpmc *q, size_t capacity);
+void rt_mpmc_destroy(struct rt_mpmc *q);
+int rt_mpmc_push(struct rt_mpmc *q, void *item);
+int rt_mpmc_pop(struct rt_mpmc *q, void **item);
+
+#endif /* _RT_RING_H */
@@ -0,0 +1,666 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "arena.h"
+#include "ring.h"
+#include "bytebuf.h"
+#include "hash.h"
+#include "bufio.h"
+#include "rand.h"
+
+/*
+ * Microbenchmarks of the runtime library, each against what the
+ * samples did before it:
+ *
+ *	arena	-n allocations of 8 to 128 bytes, against malloc and free
+ *	ring	-n items through rt_spsc, one and 64 at a time, and through
+ *		rt_mpmc from 1, 2, ... up to -t producers and as many
+ *		consumers, against a ring behind a mutex
+ *	bytebuf	framing -m MB of "\r\n" terminated lines, arriving in reads
+ *		of random size, against shifting a fixed buffer down after
+ *		every line as bufserver did
+ *	hash	rt_hash64 against FNV-1a on keys of 8 to 4096 bytes, and
+ *		rt_hash_u64 on 8-byte keys; and how evenly rt_hash64 and
+ *		rt_hash_u64 spread consecutive integers
+ *	bufio	writing -m MB in small records through rt_writer against
+ *		stdio, and copying the file with rt_copy_fd, and a byte at
+ *		a time with rt_reader_getc and rt_writer_putc, against a
+ *		byte at a time through stdio as ftree did
+ *
+ * -c runs only the named one. Each run prints one line of key=value
+ * pairs; ok=no means a result came out wrong.
+ */
+
+static long nitems;
+static int nthreads, megabytes;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//----- arena ---------------------------------------------------
+static int bench_arena(void) {
+	void **objs = malloc(nitems * sizeof(void *));
+	struct rt_arena arena;
+	unsigned int rng = 1;
+	double start, t_arena = 0, t_malloc = 0;
+	long i;
+	int ok = 1, impl;
+
+	if (objs == NULL || rt_arena_init(&arena, 1 << 20) != 0) {
+		perror("malloc");
+		exit(1);
+	}
+	for (impl = 0; impl < 2; impl++) {
+		rng = 1;
+		start = now();
+		for (i = 0; i < nitems; i++) {
+			size_t size = 8 + rt_rand32(&rng) % 121;
+			if (impl == 0)
+				objs[i] = rt_arena_alloc(&arena, size);
+			else
+				objs[i] = malloc(size);
+			if (objs[i] == NULL) {
+				perror("malloc");
+				exit(1);
+			}
+			*(long *) objs[i] = i;
+		}
+		for (i = 0; i < nitems; i++) {
+			if (*(long *) objs[i] != i || (impl == 0 && (unsigned long) objs[i] % RT_ARENA_ALIGN != 0))
+				ok = 0;
+		}
+		if (impl == 0) {
+			rt_arena_reset(&arena);
+			t_arena = now() - start;
+		} else {
+			for (i = 0; i < nitems; i++)
+				free(objs[i]);
+			t_malloc = now() - start;
+		}
+	}
+	printf("component=arena impl=arena allocs=%ld seconds=%.3f allocs_per_sec=%.0f ok=%s\n",
+		nitems, t_arena, nitems / t_arena, ok ? "yes" : "no");
+	printf("component=arena impl=malloc allocs=%ld seconds=%.3f allocs_per_sec=%.0f ok=%s\n",
+		nitems, t_malloc, nitems / t_malloc, ok ? "yes" : "no");
+
+	rt_arena_destroy(&arena);
+	free(objs);
+	return ok;
+}
+//---------------------------------------------------------------
+
+//----- ring ----------------------------------------------------
+#define RING_CAPACITY	1024
+#define RING_BATCH	64
+
+enum ring_impl { RING_SPSC, RING_SPSC_BATCH, RING_MPMC, RING_MUTEX };
+static const char *ring_names[] = { "spsc", "spsc_batch", "mpmc", "mutex" };
+
+/* the ring the mutex protects */
+struct locked_ring {
+	pthread_mutex_t lock;
+	void *slots[RING_CAPACITY];
+	size_t head, tail;
+};
+
+static struct {
+	enum ring_impl impl;
+	struct rt_spsc spsc;
+	struct rt_mpmc mpmc;
+	struct locked_ring locked;
+	int producers;
+	long per_producer;
+
+	/* items still to be popped, over all consumers */
+	long left;
+} ring;
+
+struct ring_worker {
+	pthread_t thread;
+	int id;
+	long popped, out_of_order;
+	unsigned long long sum;
+};
+
+/* item i of producer p; never NULL */
+static void *ring_item(int p, long i) {
+	return (void *) ((unsigned long) (i + 1) << 8 | p);
+}
+
+static int ring_push(void *item) {
+	int ret = -1;
+
+	switch (ring.impl) {
+	case RING_SPSC:
+	case RING_SPSC_BATCH:
+		return rt_spsc_push(&ring.spsc, item);
+	case RING_MPMC:
+		return rt_mpmc_push(&ring.mpmc, item);
+	default:
+		pthread_mutex_lock(&ring.locked.lock);
+		if (ring.locked.tail - ring.locked.head < RING_CAPACITY) {
+			ring.locked.slots[ring.locked.tail++ % RING_CAPACITY] = item;
+			ret = 0;
+		}
+		pthread_mutex_unlock(&ring.locked.lock);
+		return ret;
+	}
+}
+
+static size_t ring_pop(void **items) {
+	size_t n = 0;
+
+	switch (ring.impl) {
+	case RING_SPSC:
+		return rt_spsc_pop(&ring.spsc, items) == 0;
+	case RING_SPSC_BATCH:
+		return rt_spsc_pop_batch(&ring.spsc, items, RING_BATCH);
+	case RING_MPMC:
+		return rt_mpmc_pop(&ring.mpmc, items) == 0;
+	default:
+		pthread_mutex_lock(&ring.locked.lock);
+		if (ring.locked.tail != ring.locked.head) {
+			items[0] = ring.locked.slots[ring.locked.head++ % RING_CAPACITY];
+			n = 1;
+		}
+		pthread_mutex_unlock(&ring.locked.lock);
+		return n;
+	}
+}
+
+static void *ring_producer(void *arg) {
+	struct ring_worker *w = arg;
+	void *batch[RING_BATCH];
+	long i = 0, k;
+	size_t n;
+
+	while (i < ring.per_producer) {
+		if (ring.impl == RING_SPSC_BATCH) {
+			for (k = 0; k < RING_BATCH && i + k < ring.per_producer; k++)
+				batch[k] = ring_item(w->id, i + k);
+			while ((n = rt_spsc_push_batch(&ring.spsc, batch, k)) == 0)
+				sched_yield();
+			i += n;
+		} else {
+			while (ring_push(ring_item(w->id, i)) != 0)
+				sched_yield();
+			i++;
+		}
+	}
+	return NULL;
+}
+
+static void *ring_consumer(void *arg) {
+	struct ring_worker *w = arg;
+	long *next = calloc(ring.producers, sizeof(long));
+	void *items[RING_BATCH];
+	unsigned long v;
+	size_t n, k;
+	int p;
+
+	if (next == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	while (__atomic_load_n(&ring.left, __ATOMIC_RELAXED) > 0) {
+		if ((n = ring_pop(items)) == 0) {
+			sched_yield();
+			continue;
+		}
+		__atomic_sub_fetch(&ring.left, n, __ATOMIC_RELAXED);
+		for (k = 0; k < n; k++) {
+			v = (unsigned long) items[k];
+			p = v & 0xff;
+			// a consumer sees each producer's items in order, with gaps
+			if ((long) (v >> 8) <= next[p])
+				w->out_of_order++;
+			next[p] = v >> 8;
+			w->sum += v >> 8;
+		}
+		w->popped += n;
+	}
+	free(next);
+	return NULL;
+}
+
+static int run_ring(enum ring_impl impl, int producers) {
+	struct ring_worker *workers = calloc(2 * producers, sizeof(struct ring_worker));
+	unsigned long long sum = 0, expect;
+	long popped = 0, out_of_order = 0, total;
+	double start, elapsed;
+	int i, ok;
+
+	if (workers == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	ring.impl = impl;
+	ring.producers = producers;
+	ring.per_producer = nitems / producers;
+	total = ring.per_producer * producers;
+	ring.left = total;
+	if (rt_spsc_init(&ring.spsc, RING_CAPACITY) != 0 || rt_mpmc_init(&ring.mpmc, RING_CAPACITY) != 0) {
+		perror("malloc");
+		exit(1);
+	}
+	pthread_mutex_init(&ring.locked.lock, NULL);
+	ring.locked.head = ring.locked.tail = 0;
+
+	start = now();
+	for (i = 0; i < 2 * producers; i++) {
+		workers[i].id = i % producers;
+		if (pthread_create(&workers[i].thread, NULL, i < producers ? ring_producer : ring_consumer, &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < 2 * producers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		popped += workers[i].popped;
+		out_of_order += workers[i].out_of_order;
+		sum += workers[i].sum;
+	}
+	elapsed = now() - start;
+
+	expect = (unsigned long long) producers * ring.per_producer * (ring.per_producer + 1) / 2;
+	ok = popped == total && out_of_order == 0 && sum == expect;
+	printf("component=ring impl=%s producers=%d consumers=%d items=%ld seconds=%.3f items_per_sec=%.0f ok=%s\n",
+		ring_names[impl], producers, producers, total, elapsed, total / elapsed, ok ? "yes" : "no");
+
+	rt_spsc_destroy(&ring.spsc);
+	rt_mpmc_destroy(&ring.mpmc);
+	pthread_mutex_destroy(&ring.locked.lock);
+	free(workers);
+	return ok;
+}
+
+static int bench_ring(void) {
+	int ok = 1, n;
+
+	ok &= run_ring(RING_SPSC, 1);
+	ok &= run_ring(RING_SPSC_BATCH, 1);
+	for (n = 1; n <= nthreads; n *= 2) {
+		ok &= run_ring(RING_MPMC, n);
+		ok &= run_ring(RING_MUTEX, n);
+	}
+	return ok;
+}
+//---------------------------------------------------------------
+
+//----- bytebuf -------------------------------------------------
+/* the capacity of bufserver's buffer was a line's worth */
+#define SHIFT_BUFFER	256
+
+/* Fill stream with lines of 1 to 200 characters, each ending in "\r\n" */
+static size_t make_lines(char *stream, size_t size, long *nlines) {
+	unsigned int rng = 7;
+	size_t len = 0;
+	int k, n;
+
+	*nlines = 0;
+	for (;;) {
+		n = 1 + rt_rand32(&rng) % 200;
+		if (len + n + 2 > size)
+			return len;
+		for (k = 0; k < n; k++)
+			stream[len++] = 'a' + k % 26;
+		stream[len++] = '\r';
+		stream[len++] = '\n';
+		(*nlines)++;
+	}
+}
+
+/* What bufserver did: scan from the start, shift the rest down */
+static void frame_shift(const char *stream, size_t size, long *lines, unsigned long long *bytes) {
+	char buf[SHIFT_BUFFER];
+	unsigned int rng = 3;
+	size_t pos = 0, n;
+	int inbuf = 0, where, i;
+
+	while (pos < size) {
+		n = 1 + rt_rand32(&rng) % 4096;
+		if (n > SHIFT_BUFFER - (size_t) inbuf)
+			n = SHIFT_BUFFER - inbuf;
+		if (n > size - pos)
+			n = size - pos;
+		memcpy(buf + inbuf, stream + pos, n);
+		pos += n;
+		inbuf += n;
+		for (;;) {
+			where = -1;
+			for (i = 0; i < inbuf - 1; i++) {
+				if (buf[i] == '\r' && buf[i + 1] == '\n') {
+					where = i;
+					break;
+				}
+			}
+			if (where < 0)
+				break;
+			(*lines)++;
+			*bytes += where;
+			inbuf -= where + 2;
+			memmove(buf, buf + where + 2, inbuf);
+		}
+	}
+}
+
+static void frame_bytebuf(const char *stream, size_t size, long *lines, unsigned long long *bytes) {
+	struct rt_bytebuf b;
+	unsigned int rng = 3;
+	size_t pos = 0, n;
+	ssize_t where;
+
+	if (rt_bytebuf_init(&b, SHIFT_BUFFER) != 0) {
+		perror("malloc");
+		exit(1);
+	}
+	while (pos < size) {
+		n = 1 + rt_rand32(&rng) % 4096;
+		if (n > size - pos)
+			n = size - pos;
+		if (rt_bytebuf_append(&b, stream + pos, n) != 0) {
+			perror("malloc");
+			exit(1);
+		}
+		pos += n;
+		while ((where = rt_bytebuf_find(&b, "\r\n", 2)) >= 0) {
+			(*lines)++;
+			*bytes += where;
+			rt_bytebuf_consume(&b, where + 2);
+		}
+	}
+	rt_bytebuf_destroy(&b);
+}
+
+static int bench_bytebuf(void) {
+	size_t size = (size_t) megabytes << 20, len;
+	char *stream = malloc(size);
+	unsigned long long bytes;
+	long nlines, lines;
+	double start, elapsed;
+	int impl, ok = 1;
+
+	if (stream == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	len = make_lines(stream, size, &nlines);
+	for (impl = 0; impl < 2; impl++) {
+		lines = 0;
+		bytes = 0;
+		start = now();
+		if (impl == 0)
+			frame_bytebuf(stream, len, &lines, &bytes);
+		else
+			frame_shift(stream, len, &lines, &bytes);
+		elapsed = now() - start;
+		ok &= lines == nlines && bytes == len - 2 * nlines;
+		printf("component=bytebuf impl=%s bytes=%zu lines=%ld seconds=%.3f mb_per_sec=%.1f ok=%s\n",
+			impl == 0 ? "bytebuf" : "shift", len, lines, elapsed, len / elapsed / (1 << 20),
+			lines == nlines && bytes == len - 2 * nlines ? "yes" : "no");
+	}
+	free(stream);
+	return ok;
+}
+//---------------------------------------------------------------
+
+//----- hash ----------------------------------------------------
+#define SPREAD_KEYS	(1 << 20)
+#define SPREAD_BUCKETS	(1 << 16)
+
+static const char *hash_names[] = { "rt_hash64", "fnv1a", "rt_hash_u64" };
+
+static int bench_hash(void) {
+	static const size_t key_sizes[] = { 8, 32, 256, 4096 };
+	size_t total = (size_t) megabytes << 20, k, i, len;
+	unsigned char *data = malloc(total);
+	unsigned int *buckets = calloc(SPREAD_BUCKETS, sizeof(unsigned int)), max = 0;
+	volatile uint64_t sink = 0;
+	double start, elapsed;
+	int impl, ok;
+	uint64_t x, h;
+
+	if (data == NULL || buckets == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < total; i++)
+		data[i] = i * 131 + (i >> 9);
+
+	// 8-byte keys are also hashed as integers, with rt_hash_u64
+	for (k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+		len = key_sizes[k];
+		for (impl = 0; impl < (len == 8 ? 3 : 2); impl++) {
+			start = now();
+			for (i = 0; i + len <= total; i += len) {
+				if (impl == 0) {
+					sink += rt_hash64(data + i, len, 0);
+				} else if (impl == 1) {
+					sink += rt_fnv1a64(data + i, len);
+				} else {
+					memcpy(&x, data + i, sizeof(x));
+					sink += rt_hash_u64(x);
+				}
+			}
+			elapsed = now() - start;
+			printf("component=hash impl=%s key_bytes=%zu keys=%zu seconds=%.3f mb_per_sec=%.1f keys_per_sec=%.0f ok=yes\n",
+				hash_names[impl], len, total / len, elapsed,
+				total / elapsed / (1 << 20), total / len / elapsed);
+		}
+	}
+
+	// consecutive keys must spread evenly, and every byte and the seed must count
+	ok = 1;
+	for (impl = 0; impl < 3; impl += 2) {
+		memset(buckets, 0, SPREAD_BUCKETS * sizeof(unsigned int));
+		max = 0;
+		for (i = 0; i < SPREAD_KEYS; i++) {
+			x = i;
+			h = impl == 0 ? rt_hash64(&x, sizeof(x), 0) : rt_hash_u64(x);
+			k = h % SPREAD_BUCKETS;
+			if (++buckets[k] > max)
+				max = buckets[k];
+		}
+		ok &= max < 4 * SPREAD_KEYS / SPREAD_BUCKETS;
+		printf("component=hash impl=%s test=spread keys=%d buckets=%d max_bucket=%u mean_bucket=%d ok=%s\n",
+			hash_names[impl], SPREAD_KEYS, SPREAD_BUCKETS, max, SPREAD_KEYS / SPREAD_BUCKETS,
+			max < 4 * SPREAD_KEYS / SPREAD_BUCKETS ? "yes" : "no");
+	}
+	ok &= rt_hash64("abc", 3, 0) != rt_hash64("abd", 3, 0);
+	ok &= rt_hash64("abc", 3, 0) != rt_hash64("abc", 2, 0);
+	ok &= rt_hash64("abc", 3, 0) != rt_hash64("abc", 3, 1);
+	ok &= rt_hash64(data, 4096, 0) != rt_hash64(data + 1, 4096, 0);
+	printf("component=hash impl=rt_hash64 test=inputs ok=%s\n", ok ? "yes" : "no");
+
+	free(data);
+	free(buckets);
+	return ok;
+}
+//---------------------------------------------------------------
+
+//----- bufio ---------------------------------------------------
+static int temp_file(char *path) {
+	const char *dir = getenv("TMPDIR");
+	int fd;
+
+	snprintf(path, 256, "%s/rt_bench.XXXXXX", dir ? dir : "/tmp");
+	if ((fd = mkstemp(path)) == -1) {
+		perror("mkstemp");
+		exit(1);
+	}
+	return fd;
+}
+
+/* Hash of the whole of a file, read through rt_reader */
+static uint64_t hash_file(const char *path) {
+	struct rt_reader r;
+	char block[4096];
+	uint64_t h = 0;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1 || rt_reader_init(&r, fd, 65536) != 0) {
+		perror("open");
+		exit(1);
+	}
+	while ((n = rt_reader_read(&r, block, sizeof(block))) > 0)
+		h = rt_hash64(block, n, h);
+	rt_reader_destroy(&r);
+	close(fd);
+	return n == -1 ? 0 : h;
+}
+
+static const char *copy_names[] = { "rt_copy_fd", "rt_getc", "bytewise" };
+
+static int bench_bufio(void) {
+	size_t size = (size_t) megabytes << 20, done;
+	char record[100], src[256], other[256], dest[256];
+	struct rt_reader r;
+	struct rt_writer w;
+	unsigned int rng;
+	double start, elapsed;
+	int fd, out, impl, ok = 1, c, n;
+	FILE *f = NULL, *g = NULL;
+	uint64_t h;
+
+	memset(record, 'x', sizeof(record));
+	for (impl = 0; impl < 2; impl++) {
+		// the copies below are made of the file rt_writer writes
+		fd = temp_file(impl == 0 ? src : other);
+		rng = 5;
+		start = now();
+		if (impl == 0) {
+			if (rt_writer_init(&w, fd, 65536) != 0) {
+				perror("malloc");
+				exit(1);
+			}
+			for (done = 0; done < size; done += n) {
+				n = 1 + rt_rand32(&rng) % sizeof(record);
+				if (rt_writer_write(&w, record, n) != 0) {
+					perror("write");
+					exit(1);
+				}
+			}
+			ok &= rt_writer_destroy(&w) == 0;
+		} else {
+			if ((f = fdopen(fd, "w")) == NULL) {
+				perror("fdopen");
+				exit(1);
+			}
+			for (done = 0; done < size; done += n) {
+				n = 1 + rt_rand32(&rng) % sizeof(record);
+				fwrite(record, 1, n, f);
+			}
+			ok &= fflush(f) == 0;
+		}
+		elapsed = now() - start;
+		printf("component=bufio impl=%s op=write bytes=%zu seconds=%.3f mb_per_sec=%.1f ok=%s\n",
+			impl == 0 ? "rt_writer" : "stdio", done, elapsed, done / elapsed / (1 << 20), ok ? "yes" : "no");
+		if (impl == 0)
+			close(fd);
+		else
+			fclose(f);
+		if (impl == 1)
+			unlink(other);
+	}
+
+	// copy the file rt_writer wrote, all at once and a byte at a time
+	// through rt_reader and rt_writer and through stdio
+	h = hash_file(src);
+	for (impl = 0; impl < 3; impl++) {
+		out = temp_file(dest);
+		fd = open(src, O_RDONLY);
+		start = now();
+		if (impl == 0) {
+			ok &= rt_copy_fd(fd, out) == (ssize_t) done;
+		} else if (impl == 1) {
+			if (rt_reader_init(&r, fd, 65536) != 0 || rt_writer_init(&w, out, 65536) != 0) {
+				perror("malloc");
+				exit(1);
+			}
+			while ((c = rt_reader_getc(&r)) != -1)
+				ok &= rt_writer_putc(&w, c) == 0;
+			ok &= errno == 0;
+			ok &= rt_writer_destroy(&w) == 0;
+			rt_reader_destroy(&r);
+		} else {
+			f = fdopen(fd, "r");
+			g = fdopen(out, "w");
+			while ((c = fgetc(f)) != EOF)
+				fputc(c, g);
+			fflush(g);
+		}
+		elapsed = now() - start;
+		ok &= hash_file(dest) == h;
+		printf("component=bufio impl=%s op=copy bytes=%zu seconds=%.3f mb_per_sec=%.1f ok=%s\n",
+			copy_names[impl], done, elapsed, done / elapsed / (1 << 20), ok ? "yes" : "no");
+		if (impl < 2) {
+			close(fd);
+			close(out);
+		} else {
+			fclose(f);
+			fclose(g);
+		}
+		unlink(dest);
+	}
+	unlink(src);
+	return ok;
+}
+//---------------------------------------------------------------
+
+static void usage(char *prog) {
+	printf("Usage: %s [-c arena|ring|bytebuf|hash|bufio] [-n items] [-m megabytes] [-t max_threads]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	static const char *names[] = { "arena", "ring", "bytebuf", "hash", "bufio" };
+	static int (*benches[])(void) = { bench_arena, bench_ring, bench_bytebuf, bench_hash, bench_bufio };
+	char *only = NULL;
+	int opt, ok = 1, i, ran = 0;
+
+	nitems = 4000000;
+	megabytes = 32;
+	nthreads = 4;
+	while ((opt = getopt(argc, argv, "c:n:m:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			only = optarg;
+			break;
+		case 'n':
+			nitems = atol(optarg);
+			break;
+		case 'm':
+			megabytes = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nitems <= 0 || megabytes <= 0 || nthreads <= 0 || nthreads > 128) {
+		usage(argv[0]);
+	}
+
+	for (i = 0; i < 5; i++) {
+		if (only == NULL || strcmp(only, names[i]) == 0) {
+			ok &= benches[i]();
+			ran = 1;
+		}
+	}
+	if (!ran) {
+		usage(argv[0]);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,444 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include "arena.h"
+#include "ring.h"
+#include "bytebuf.h"
+#include "hash.h"
+#include "bufio.h"
+#include "rand.h"
+
+/*
+ * Unit tests of the runtime library, for the edge cases the samples
+ * and rt_bench rarely or never reach: objects too large to share an
+ * arena chunk and a reset after them, full and empty rings and batches
+ * that wrap around, searches that find nothing, the byte at a time
+ * reader and writer at end of file and on errors, and rt_copy_fd where
+ * the kernel cannot copy by itself. A failed check aborts with the
+ * line it is on; otherwise each component prints ok=yes.
+ */
+
+static void passed(const char *component) {
+	printf("component=%s test=unit ok=yes\n", component);
+}
+
+/* An empty temporary file, already unlinked */
+static int temp_fd(void) {
+	const char *dir = getenv("TMPDIR");
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/rt_test.XXXXXX", dir ? dir : "/tmp");
+	if ((fd = mkstemp(path)) == -1) {
+		perror("mkstemp");
+		exit(1);
+	}
+	unlink(path);
+	return fd;
+}
+
+/* A pipe holding n bytes of data, its write end closed */
+static int pipe_with(const char *data, size_t n) {
+	int p[2];
+
+	if (pipe(p) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	assert(rt_write_full(p[1], data, n) == (ssize_t) n);
+	close(p[1]);
+	return p[0];
+}
+
+/* Whether fd holds exactly the n bytes of data */
+static int holds(int fd, const char *data, size_t n) {
+	char *buf = malloc(n + 1);
+	ssize_t got;
+	int same;
+
+	assert(buf != NULL);
+	got = pread(fd, buf, n + 1, 0);
+	same = got == (ssize_t) n && memcmp(buf, data, n) == 0;
+	free(buf);
+	return same;
+}
+
+//----- arena ---------------------------------------------------
+static void test_arena(void) {
+	struct rt_arena a;
+	struct rt_arena_chunk *first;
+	char *p, *q, *big, *next;
+	int i;
+
+	assert(rt_arena_init(&a, 1024) == 0);
+	first = a.chunks;
+
+	// sizes are rounded up, so consecutive objects stay aligned
+	p = rt_arena_alloc(&a, 1);
+	q = rt_arena_alloc(&a, 17);
+	assert(q - p == RT_ARENA_ALIGN);
+	assert((uintptr_t) q % RT_ARENA_ALIGN == 0);
+
+	// an object larger than a quarter chunk that does not fit gets a
+	// chunk of its own, behind the current one, which stays in use
+	assert(rt_arena_alloc(&a, 700) == q + 32);
+	next = a.next;
+	assert(a.end - next == 272);
+	big = rt_arena_alloc(&a, 300);
+	assert(big != NULL && (uintptr_t) big % RT_ARENA_ALIGN == 0);
+	memset(big, 1, 300);
+	assert(a.chunks == first && a.next == next);
+	assert(a.chunks->next != NULL && a.chunks->next->size == 304);
+	p = rt_arena_alloc(&a, 16);
+	assert(p == next);
+
+	// even one larger than a whole chunk
+	big = rt_arena_alloc(&a, 5000);
+	assert(big != NULL);
+	memset(big, 2, 5000);
+	assert(a.chunks == first && a.chunks->next->size == 5008);
+
+	// filling the chunk starts a new one in front
+	while (a.chunks == first) {
+		p = rt_arena_alloc(&a, 200);
+		assert(p != NULL);
+	}
+	assert(p == a.chunks->data && a.chunks->next == first);
+	assert(a.chunks->size == 1024);
+
+	// a reset frees every chunk but the newest, large ones included,
+	// and allocation starts over at its beginning
+	rt_arena_reset(&a);
+	assert(a.chunks->next == NULL && a.chunks->size == 1024);
+	assert(a.next == a.chunks->data);
+	for (i = 0; i < 64; i++)
+		assert(rt_arena_alloc(&a, 16) == a.chunks->data + 16 * i);
+	assert(a.chunks->next == NULL);
+
+	// and a reset right after a large object
+	big = rt_arena_alloc(&a, 4096);
+	assert(big != NULL && a.chunks->next != NULL);
+	rt_arena_reset(&a);
+	assert(a.chunks->next == NULL && a.next == a.chunks->data);
+
+	rt_arena_destroy(&a);
+	assert(a.chunks == NULL);
+	passed("arena");
+}
+//---------------------------------------------------------------
+
+//----- ring ----------------------------------------------------
+static void test_ring(void) {
+	void *items[16], *item;
+	struct rt_spsc r;
+	struct rt_mpmc q;
+	long i, lap;
+
+	// capacity rounds up to a power of 2
+	assert(rt_spsc_init(&r, 5) == 0);
+	assert(rt_spsc_pop(&r, &item) == -1);
+	for (i = 0; i < 8; i++)
+		assert(rt_spsc_push(&r, (void *) i) == 0);
+	assert(rt_spsc_push(&r, (void *) i) == -1);
+	for (i = 0; i < 8; i++) {
+		assert(rt_spsc_pop(&r, &item) == 0);
+		assert(item == (void *) i);
+	}
+	assert(rt_spsc_pop(&r, &item) == -1);
+
+	// batches that wrap around the end of the slots, and stop when full
+	for (i = 0; i < 16; i++)
+		items[i] = (void *) (i + 100);
+	assert(rt_spsc_push_batch(&r, items, 5) == 5);
+	assert(rt_spsc_pop_batch(&r, items, 3) == 3);
+	assert(items[0] == (void *) 100 && items[2] == (void *) 102);
+	for (i = 0; i < 16; i++)
+		items[i] = (void *) (i + 200);
+	assert(rt_spsc_push_batch(&r, items, 16) == 6);
+	assert(rt_spsc_push_batch(&r, items, 1) == 0);
+	assert(rt_spsc_pop_batch(&r, items, 16) == 8);
+	assert(items[0] == (void *) 103 && items[1] == (void *) 104);
+	for (i = 2; i < 8; i++)
+		assert(items[i] == (void *) (i + 198));
+	assert(rt_spsc_pop_batch(&r, items, 16) == 0);
+	rt_spsc_destroy(&r);
+
+	// the same through rt_mpmc, over several laps
+	assert(rt_mpmc_init(&q, 3) == 0);
+	assert(rt_mpmc_pop(&q, &item) == -1);
+	for (lap = 0; lap < 10; lap++) {
+		for (i = 0; i < 4; i++)
+			assert(rt_mpmc_push(&q, (void *) (lap * 4 + i)) == 0);
+		assert(rt_mpmc_push(&q, NULL) == -1);
+		for (i = 0; i < 4; i++) {
+			assert(rt_mpmc_pop(&q, &item) == 0);
+			assert(item == (void *) (lap * 4 + i));
+		}
+		assert(rt_mpmc_pop(&q, &item) == -1);
+	}
+	rt_mpmc_destroy(&q);
+	passed("ring");
+}
+//---------------------------------------------------------------
+
+//----- bytebuf -------------------------------------------------
+static void test_bytebuf(void) {
+	static const char text[] = "GET / HTTP/1.0\r\nHost: x\r\n\r\n";
+	struct rt_bytebuf b;
+	char block[100];
+	size_t cap;
+	int fd;
+
+	assert(rt_bytebuf_init(&b, 16) == 0);
+
+	// nothing held, nothing found
+	assert(rt_bytebuf_find(&b, "\n", 1) == -1);
+	assert(rt_bytebuf_find(&b, "\r\n", 2) == -1);
+
+	assert(rt_bytebuf_append(&b, "abcdefgh", 8) == 0);
+	assert(rt_bytebuf_find(&b, "x", 1) == -1);
+	assert(rt_bytebuf_find(&b, "hx", 2) == -1);
+	assert(rt_bytebuf_find(&b, "abcdefghi", 9) == -1);
+	assert(rt_bytebuf_find(&b, "h", 1) == 7);
+	assert(rt_bytebuf_find(&b, "gh", 2) == 6);
+
+	// offsets count from the first byte still held
+	rt_bytebuf_consume(&b, 3);
+	assert(rt_bytebuf_len(&b) == 5 && rt_bytebuf_data(&b)[0] == 'd');
+	assert(rt_bytebuf_find(&b, "bc", 2) == -1);
+	assert(rt_bytebuf_find(&b, "de", 2) == 0);
+
+	// what was consumed makes room before the buffer grows
+	assert(rt_bytebuf_append(&b, "ijklmnopq", 9) == 0);
+	assert(b.cap == 16 && b.start == 0);
+	assert(memcmp(rt_bytebuf_data(&b), "defghijklmnopq", 14) == 0);
+
+	// and it doubles when that is not enough
+	assert(rt_bytebuf_append(&b, "rstuvw", 6) == 0);
+	assert(b.cap == 32 && rt_bytebuf_len(&b) == 20);
+	assert(memcmp(rt_bytebuf_data(&b), "defghijklmnopqrstuvw", 20) == 0);
+
+	// consuming more than is held empties it
+	rt_bytebuf_consume(&b, 100);
+	assert(rt_bytebuf_len(&b) == 0 && b.start == 0);
+
+	// reads append, and report end of file and errors
+	fd = pipe_with(text, sizeof(text) - 1);
+	cap = b.cap;
+	while (rt_bytebuf_read(&b, fd, 4) > 0)
+		;
+	assert(rt_bytebuf_len(&b) == sizeof(text) - 1 && b.cap >= cap);
+	assert(rt_bytebuf_find(&b, "\r\n\r\n", 4) == (ssize_t) sizeof(text) - 5);
+	close(fd);
+	fd = temp_fd();
+	close(fd);
+	errno = 0;
+	assert(rt_bytebuf_read(&b, fd, sizeof(block)) == -1 && errno == EBADF);
+
+	rt_bytebuf_destroy(&b);
+	passed("bytebuf");
+}
+//---------------------------------------------------------------
+
+//----- hash ----------------------------------------------------
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void test_hash(void) {
+	unsigned char key[80], other[96];
+	uint64_t *hashes, h, x;
+	unsigned int rng = 1, changed;
+	size_t len, i;
+	int bit;
+
+	// FNV-1a as published
+	assert(rt_fnv1a64("", 0) == 0xcbf29ce484222325ULL);
+	assert(rt_fnv1a64("a", 1) == 0xaf63dc4c8601ec8cULL);
+	assert(rt_fnv1a64("foobar", 6) == 0x85944171f73967e8ULL);
+
+	// rt_hash64 reads only the len bytes at key, wherever they lie,
+	// and each of them counts, as do the length and the seed
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = rt_rand32(&rng);
+	for (len = 0; len <= 64; len++) {
+		h = rt_hash64(key, len, 7);
+		memset(other, 0xee, sizeof(other));
+		memcpy(other + 3, key, len);
+		assert(rt_hash64(other + 3, len, 7) == h);
+		assert(rt_hash64(key, len, 8) != h);
+		assert(rt_hash64(key, len + 1, 7) != h);
+		for (i = 0; i < len; i++) {
+			other[3 + i] ^= 0x10;
+			assert(rt_hash64(other + 3, len, 7) != h);
+			other[3 + i] ^= 0x10;
+		}
+	}
+
+	// rt_hash_u64 is one to one: no two of many integers collide
+	hashes = malloc((1 << 16) * sizeof(uint64_t));
+	assert(hashes != NULL);
+	for (i = 0; i < 1 << 16; i++)
+		hashes[i] = rt_hash_u64(i << 20);
+	qsort(hashes, 1 << 16, sizeof(uint64_t), cmp_u64);
+	for (i = 1; i < 1 << 16; i++)
+		assert(hashes[i] != hashes[i - 1]);
+	free(hashes);
+
+	// and flipping any one input bit flips about half the output bits
+	for (bit = 0; bit < 64; bit++) {
+		changed = 0;
+		for (i = 0; i < 256; i++) {
+			x = (uint64_t) rt_rand32(&rng) << 32 | rt_rand32(&rng);
+			changed += __builtin_popcountll(rt_hash_u64(x) ^ rt_hash_u64(x ^ 1ULL << bit));
+		}
+		assert(changed > 256 * 28 && changed < 256 * 36);
+	}
+	passed("hash");
+}
+//---------------------------------------------------------------
+
+//----- bufio ---------------------------------------------------
+static void test_bufio(void) {
+	static const char text[] = "hello, world\n";
+	char data[100000], copy[sizeof(data)];
+	struct rt_reader r;
+	struct rt_writer w;
+	unsigned int rng = 3;
+	size_t i;
+	int fd, out, c;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = rt_rand32(&rng);
+
+	// getc through a buffer smaller than the input, to the end of file
+	fd = pipe_with(text, sizeof(text) - 1);
+	assert(rt_reader_init(&r, fd, 3) == 0);
+	for (i = 0; i < sizeof(text) - 1; i++)
+		assert(rt_reader_getc(&r) == text[i]);
+	errno = EAGAIN;
+	assert(rt_reader_getc(&r) == -1 && errno == 0);
+	assert(rt_reader_getc(&r) == -1 && errno == 0);
+	rt_reader_destroy(&r);
+	close(fd);
+
+	// bytes at or above 0x80 are not taken for the end of file
+	fd = pipe_with("\xff\x80", 2);
+	assert(rt_reader_init(&r, fd, 16) == 0);
+	assert(rt_reader_getc(&r) == 0xff && rt_reader_getc(&r) == 0x80);
+	assert(rt_reader_getc(&r) == -1);
+	rt_reader_destroy(&r);
+	close(fd);
+
+	// an error is told apart from the end of file by errno
+	fd = open("/dev/null", O_WRONLY);
+	assert(fd != -1 && rt_reader_init(&r, fd, 16) == 0);
+	assert(rt_reader_getc(&r) == -1 && errno == EBADF);
+	rt_reader_destroy(&r);
+	close(fd);
+
+	// getc and reads that bypass the buffer mix
+	fd = temp_fd();
+	assert(rt_write_full(fd, data, sizeof(data)) == sizeof(data));
+	lseek(fd, 0, SEEK_SET);
+	assert(rt_reader_init(&r, fd, 1000) == 0);
+	assert(rt_reader_getc(&r) == (unsigned char) data[0]);
+	assert(rt_reader_read(&r, copy, 5000) == 5000);
+	assert(memcmp(copy, data + 1, 5000) == 0);
+	assert(rt_reader_getc(&r) == (unsigned char) data[5001]);
+	assert(rt_reader_read(&r, copy, sizeof(copy)) == sizeof(data) - 5002);
+	assert(memcmp(copy, data + 5002, sizeof(data) - 5002) == 0);
+	assert(rt_reader_read(&r, copy, 1) == 0);
+	rt_reader_destroy(&r);
+	close(fd);
+
+	// putc writes a full buffer out before it takes the next byte,
+	// and what is left is written when the writer is destroyed
+	fd = temp_fd();
+	assert(rt_writer_init(&w, fd, 4) == 0);
+	for (i = 0; i < 10; i++)
+		assert(rt_writer_putc(&w, data[i]) == 0);
+	assert(holds(fd, data, 8) && w.len == 2);
+	assert(rt_writer_write(&w, data + 10, 5000) == 0);
+	assert(rt_writer_putc(&w, data[5010]) == 0);
+	assert(holds(fd, data, 5010));
+	assert(rt_writer_destroy(&w) == 0);
+	assert(holds(fd, data, 5011));
+	close(fd);
+
+	// a byte that does not fit after a failed write is refused, and
+	// the buffered ones are kept
+	fd = open("/dev/null", O_RDONLY);
+	assert(fd != -1 && rt_writer_init(&w, fd, 2) == 0);
+	assert(rt_writer_putc(&w, 'a') == 0 && rt_writer_putc(&w, 'b') == 0);
+	assert(rt_writer_putc(&w, 'c') == -1 && errno == EBADF);
+	assert(w.len == 2 && memcmp(w.buf, "ab", 2) == 0);
+	assert(rt_writer_destroy(&w) == -1);
+	close(fd);
+
+	// rt_copy_fd between files, from the current offset
+	fd = temp_fd();
+	out = temp_fd();
+	assert(rt_write_full(fd, data, sizeof(data)) == sizeof(data));
+	lseek(fd, 100, SEEK_SET);
+	assert(rt_copy_fd(fd, out) == sizeof(data) - 100);
+	assert(holds(out, data + 100, sizeof(data) - 100));
+	assert(rt_copy_fd(fd, out) == 0);
+	close(out);
+
+	// from a pipe, which the kernel cannot copy from by itself, so the
+	// bytes go through memory
+	c = pipe_with(data, 60000);
+	out = temp_fd();
+	assert(rt_copy_fd(c, out) == 60000);
+	assert(holds(out, data, 60000));
+	close(c);
+
+	// and errors on either side
+	lseek(fd, 0, SEEK_SET);
+	c = open("/dev/null", O_RDONLY);
+	assert(c != -1 && rt_copy_fd(fd, c) == -1);
+	assert(rt_copy_fd(c, out) == 0);
+	close(c);
+	c = open("/dev/null", O_WRONLY);
+	assert(c != -1 && rt_copy_fd(c, out) == -1);
+	close(c);
+	close(out);
+	close(fd);
+	passed("bufio");
+}
+//---------------------------------------------------------------
+
+//----- rand ----------------------------------------------------
+static void test_rand(void) {
+	unsigned int a = 1, b = 1, x;
+	int i;
+
+	// the sequence the benchmarks' workloads are made of
+	assert(rt_rand32(&a) == 270369 && a == 270369);
+	assert(rt_rand32(&a) == 67634689);
+	for (i = 0; i < 1000000; i++) {
+		x = rt_rand32(&b);
+		assert(x != 0 && x == b);
+	}
+	passed("rand");
+}
+//---------------------------------------------------------------
+
+int main(void) {
+	test_arena();
+	test_ring();
+	test_bytebuf();
+	test_hash();
+	test_bufio();
+	test_rand();
+	return 0;
+}